@@ -0,0 +1,853 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_BINDING_H
+#   define XML_BINDING_H
+
+#   include "reader.h"
+#   include <cerrno>
+#   include <clocale>
+#   include <cstdio>
+#   include <cstdlib>
+#   include <cstring>
+#   include <limits>
+#   include <string>
+#   include <tuple>
+#   include <type_traits>
+#   include <utility>
+#   include <vector>
+
+/**
+ * @file xml/binding.h
+ *
+ * @brief Declarative binding of XML elements to C++ structures.
+ *
+ * A structure is made bindable by listing its fields with
+ * @c XMLRW_BINDING, in the same namespace as the structure:
+ *
+ * @code
+ * struct point {
+ *     int x;
+ *     int y;
+ *     std::string label;
+ *     std::vector<std::string> tags;
+ * };
+ *
+ * XMLRW_BINDING(point,
+ *               XMLRW_ATTRIBUTE(point, x),
+ *               XMLRW_ATTRIBUTE(point, y),
+ *               XMLRW_ELEMENT(point, label),
+ *               XMLRW_ELEMENT_NAMED(point, tags, "tag"))
+ * @endcode
+ *
+ * @c xml::bind then fills a @c point from an element such as
+ * `<point x="1" y="2"><label>origin</label><tag>a</tag><tag>b</tag></point>`.
+ *
+ * The field list is a compile-time constant; so matching a name is an
+ * unrolled sequence of length and byte comparisons against the declared
+ * names, and values are converted directly from the reader's buffer.
+ *
+ * A field may be:
+ *  - any type for which @c xml::value_traits is defined (strings, @c bool,
+ *    integers and floating point types by default);
+ *  - a bindable structure (for elements only); or
+ *  - a @c std::vector of either (for elements only), which collects
+ *    repeated elements.
+ *
+ * Elements are matched by local name; unmatched elements are skipped.
+ * Attributes are matched by local name and namespace: in no namespace,
+ * unless the field names one with @c XMLRW_ATTRIBUTE_NS.  Text content is
+ * converted once the element ends, so it may be split by CDATA sections,
+ * comments, or entity references.
+ */
+
+namespace xml
+{
+    /**
+     * @brief Scratch space for @c xml::value_traits::format.
+     */
+    struct format_buffer {
+        char data[64];
+    };
+
+    /**
+     * @brief Conversion between text and field values.
+     *
+     * Specialize this to bind fields of other types.  A specialization
+     * provides a static member function
+     * `bool parse(const string_ref & text, T & value)` that returns
+     * @c false if @p text is not a valid representation; and, for use with
+     * @c xml::serialize,
+     * `const char * format(const T & value, format_buffer & buf)` that
+     * returns a null-terminated representation of @p value, either in
+     * @p buf or in storage that lives as long as @p value.
+     */
+    template <typename T, typename Enable = void>
+    struct value_traits;
+
+    namespace detail {
+
+        inline bool is_xml_space(const char c) throw ()
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        inline string_ref trim(const string_ref & text) throw ()
+        {
+            const char * first = text.begin();
+            const char * last = text.end();
+            while (first != last && is_xml_space(*first)) { ++first; }
+            while (last != first && is_xml_space(*(last - 1))) { --last; }
+            return string_ref{first, std::size_t(last - first)};
+        }
+
+        //
+        // Whether text has the lexical form of a finite xs:double: an
+        // optional sign, digits with an optional decimal point, and an
+        // optional exponent.
+        //
+        inline bool is_decimal_number(const string_ref & text) throw ()
+        {
+            const char * p = text.begin();
+            const char * const end = text.end();
+            if (p != end && (*p == '-' || *p == '+')) { ++p; }
+            bool digits = false;
+            for (; p != end && unsigned(*p - '0') <= 9; ++p) { digits = true; }
+            if (p != end && *p == '.') {
+                for (++p; p != end && unsigned(*p - '0') <= 9; ++p) {
+                    digits = true;
+                }
+            }
+            if (!digits) { return false; }
+            if (p != end && (*p == 'e' || *p == 'E')) {
+                ++p;
+                if (p != end && (*p == '-' || *p == '+')) { ++p; }
+                if (p == end) { return false; }
+                while (p != end && unsigned(*p - '0') <= 9) { ++p; }
+            }
+            return p == end;
+        }
+
+        //
+        // Conversion at the precision of the result, so that it is rounded
+        // only once.
+        //
+        inline float strto(const char * str, char ** end, float *) throw ()
+        {
+            return std::strtof(str, end);
+        }
+
+        inline double strto(const char * str, char ** end, double *) throw ()
+        {
+            return std::strtod(str, end);
+        }
+
+        inline long double strto(const char * str, char ** end,
+                                 long double *) throw ()
+        {
+            return std::strtold(str, end);
+        }
+    }
+
+    template <>
+    struct value_traits<std::string> {
+        static bool parse(const string_ref & text, std::string & value)
+        {
+            value.assign(text.data(), text.size());
+            return true;
+        }
+
+        static const char * format(const std::string & value,
+                                   format_buffer &) throw ()
+        {
+            return value.c_str();
+        }
+    };
+
+    template <>
+    struct value_traits<bool> {
+        static bool parse(const string_ref & text, bool & value) throw ()
+        {
+            const string_ref t = detail::trim(text);
+            if (t == "true" || t == "1") {
+                value = true;
+            } else if (t == "false" || t == "0") {
+                value = false;
+            } else {
+                return false;
+            }
+            return true;
+        }
+
+        static const char * format(const bool value, format_buffer &) throw ()
+        {
+            return value ? "true" : "false";
+        }
+    };
+
+    template <typename T>
+    struct value_traits<
+        T,
+        typename std::enable_if<std::is_integral<T>::value
+                                && !std::is_same<T, bool>::value>::type> {
+        static bool parse(const string_ref & text, T & value) throw ()
+        {
+            typedef typename std::make_unsigned<T>::type unsigned_type;
+
+            const string_ref t = detail::trim(text);
+            const char * p = t.begin();
+            const char * const last = t.end();
+            bool negative = false;
+            if (p != last && (*p == '-' || *p == '+')) {
+                negative = (*p == '-');
+                if (negative && !std::is_signed<T>::value) { return false; }
+                ++p;
+            }
+            if (p == last) { return false; }
+
+            const unsigned_type limit =
+                negative
+                ? unsigned_type(unsigned_type(std::numeric_limits<T>::max())
+                                + 1)
+                : unsigned_type(std::numeric_limits<T>::max());
+            unsigned_type result = 0;
+            for (; p != last; ++p) {
+                const unsigned digit = unsigned(*p - '0');
+                if (digit > 9) { return false; }
+                if (result > (limit - digit) / 10) { return false; }
+                result = unsigned_type(result * 10 + digit);
+            }
+            value = negative
+                  ? T(unsigned_type(0) - result)
+                  : T(result);
+            return true;
+        }
+
+        static const char * format(const T value, format_buffer & buf) throw ()
+        {
+            typedef typename std::make_unsigned<T>::type unsigned_type;
+
+            const bool negative = value < T(0);
+            unsigned_type magnitude = negative
+                                    ? unsigned_type(unsigned_type(0)
+                                                    - unsigned_type(value))
+                                    : unsigned_type(value);
+            char * p = buf.data + sizeof buf.data;
+            *--p = '\0';
+            do {
+                *--p = char('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude != 0);
+            if (negative) { *--p = '-'; }
+            return p;
+        }
+    };
+
+    template <typename T>
+    struct value_traits<
+        T,
+        typename std::enable_if<std::is_floating_point<T>::value>::type> {
+        //
+        // The lexical space is that of xs:double; a value too large for T
+        // is rejected.
+        //
+        static bool parse(const string_ref & text, T & value)
+        {
+            const string_ref t = detail::trim(text);
+            if (t == "INF" || t == "+INF") {
+                value = std::numeric_limits<T>::infinity();
+                return true;
+            }
+            if (t == "-INF") {
+                value = -std::numeric_limits<T>::infinity();
+                return true;
+            }
+            if (t == "NaN") {
+                value = std::numeric_limits<T>::quiet_NaN();
+                return true;
+            }
+            if (!detail::is_decimal_number(t)) { return false; }
+
+            //
+            // strtod needs a null-terminated string, with the decimal
+            // point of the C locale in place of '.'.  Copy short values to
+            // the stack rather than allocating.
+            //
+            const char * const point = std::localeconv()->decimal_point;
+            const std::size_t point_size = std::strlen(point);
+            char buf[64];
+            std::string long_value;
+            const char * str = buf;
+            if (t.size() * point_size < sizeof buf) {
+                char * q = buf;
+                for (const char c : t) {
+                    if (c == '.') {
+                        std::memcpy(q, point, point_size);
+                        q += point_size;
+                    } else {
+                        *q++ = c;
+                    }
+                }
+                *q = '\0';
+            } else {
+                for (const char c : t) {
+                    if (c == '.') {
+                        long_value += point;
+                    } else {
+                        long_value += c;
+                    }
+                }
+                str = long_value.c_str();
+            }
+            char * end = nullptr;
+            errno = 0;
+            const T result = detail::strto(str, &end, static_cast<T *>(0));
+            if (*end != '\0') { return false; }
+            if (errno == ERANGE
+                && (result == std::numeric_limits<T>::infinity()
+                    || result == -std::numeric_limits<T>::infinity())) {
+                return false;
+            }
+            value = result;
+            return true;
+        }
+
+        static const char * format(const T value, format_buffer & buf) throw ()
+        {
+            if (value != value) { return "NaN"; }
+            if (value == std::numeric_limits<T>::infinity()) { return "INF"; }
+            if (value == -std::numeric_limits<T>::infinity()) {
+                return "-INF";
+            }
+            //
+            // Enough digits that parse recovers the same value; and '.'
+            // in place of the C locale's decimal point.
+            //
+            std::snprintf(buf.data, sizeof buf.data, "%.*Lg",
+                          std::numeric_limits<T>::max_digits10,
+                          static_cast<long double>(value));
+            const char * const point = std::localeconv()->decimal_point;
+            char * const p = std::strstr(buf.data, point);
+            if (p && std::strcmp(point, ".") != 0) {
+                const std::size_t point_size = std::strlen(point);
+                *p = '.';
+                std::memmove(p + 1, p + point_size,
+                             std::strlen(p + point_size) + 1);
+            }
+            return buf.data;
+        }
+    };
+
+    enum class field_kind { element, attribute, text };
+
+    /**
+     * @brief Describes a bound field of @p Class.
+     *
+     * Create these with @c XMLRW_ELEMENT, @c XMLRW_ELEMENT_NAMED,
+     * @c XMLRW_ATTRIBUTE, @c XMLRW_ATTRIBUTE_NAMED and @c XMLRW_TEXT.
+     */
+    template <field_kind Kind, typename Class, typename Member>
+    struct field {
+        const char * name;
+        std::size_t name_size;
+        Member Class::* member;
+        const char * namespace_uri;
+        std::size_t namespace_uri_size;
+    };
+
+    template <field_kind Kind, typename Class, typename Member,
+              std::size_t N>
+    field<Kind, Class, Member> make_field(const char (&name)[N],
+                                          Member Class::* member)
+    {
+        return field<Kind, Class, Member>{name, N - 1, member, "", 0};
+    }
+
+    template <field_kind Kind, typename Class, typename Member,
+              std::size_t M, std::size_t N>
+    field<Kind, Class, Member> make_field(const char (&namespace_uri)[M],
+                                          const char (&name)[N],
+                                          Member Class::* member)
+    {
+        return field<Kind, Class, Member>{name, N - 1, member,
+                                          namespace_uri, M - 1};
+    }
+
+    template <typename T>
+    void bind(reader & r, T & object);
+
+    namespace detail {
+
+        //
+        // Bindable types are found by argument-dependent lookup of the
+        // xmlrw_binding function that XMLRW_BINDING defines.
+        //
+        template <typename T>
+        class has_binding {
+            template <typename U>
+            static auto test(int)
+                -> decltype(xmlrw_binding(static_cast<const U *>(nullptr)),
+                            std::true_type());
+
+            template <typename U>
+            static std::false_type test(...);
+
+        public:
+            static const bool value = decltype(test<T>(0))::value;
+        };
+
+        template <typename T>
+        struct is_vector : std::false_type {};
+
+        template <typename T, typename Allocator>
+        struct is_vector<std::vector<T, Allocator>> : std::true_type {};
+
+        template <typename T>
+        auto fields_of() -> decltype(xmlrw_binding(static_cast<const T *>(nullptr)))
+        {
+            return xmlrw_binding(static_cast<const T *>(nullptr));
+        }
+
+        inline bool name_equals(const string_ref & name,
+                                const char * const expected,
+                                const std::size_t expected_size) throw ()
+        {
+            return name.size() == expected_size
+                && std::memcmp(name.data(), expected, expected_size) == 0;
+        }
+
+        template <typename Field>
+        struct is_text_field : std::false_type {};
+
+        template <typename Class, typename Member>
+        struct is_text_field<field<field_kind::text, Class, Member>> :
+            std::true_type {};
+
+        template <typename Fields, std::size_t I = 0,
+                  bool End = (I == std::tuple_size<Fields>::value)>
+        struct has_text_field :
+            std::integral_constant<
+                bool,
+                is_text_field<
+                    typename std::tuple_element<I, Fields>::type>::value
+                || has_text_field<Fields, I + 1>::value> {};
+
+        template <typename Fields, std::size_t I>
+        struct has_text_field<Fields, I, true> : std::false_type {};
+
+        //
+        // Skip the rest of the element the reader is positioned on.
+        //
+        inline void skip_element(reader & r)
+        {
+            if (r.node_type() != reader::element_id || r.empty_element()) {
+                return;
+            }
+            const std::size_t depth = r.depth();
+            while (r.read()) {
+                if (r.node_type() == reader::end_element_id
+                    && r.depth() == depth) {
+                    return;
+                }
+            }
+        }
+
+        inline void append(std::string & str, const string_ref & text)
+        {
+            str.append(text.data(), text.size());
+        }
+
+        template <typename T>
+        void parse_value(reader & r, const string_ref & text, T & value)
+        {
+            if (!value_traits<T>::parse(text, value)) {
+                throw parse_error{r.line(),
+                                  "invalid value \"" + text.str() + "\""};
+            }
+        }
+
+        //
+        // Bind the text content of the element the reader is positioned
+        // on, leaving the reader on its end tag.  The content is parsed in
+        // place unless it is split across several nodes.
+        //
+        template <typename T>
+        void bind_text_content(reader & r, T & value)
+        {
+            if (r.empty_element()) {
+                parse_value(r, string_ref{}, value);
+                return;
+            }
+            const std::size_t depth = r.depth();
+            bool found = false;
+            bool split = false;
+            bool valid = false;
+            std::string joined;
+            while (r.read()) {
+                switch (r.node_type()) {
+                case reader::text_id:
+                case reader::cdata_id:
+                case reader::whitespace_id:
+                case reader::significant_whitespace_id:
+                {
+                    //
+                    // The referenced text does not survive the next read;
+                    // so convert it now, keeping a copy in case the
+                    // content turns out to be split across several nodes.
+                    // A piece need not be valid on its own.
+                    //
+                    const string_ref text = r.value_ref();
+                    if (!found) {
+                        found = true;
+                        valid = value_traits<T>::parse(text, value);
+                        joined.assign(text.data(), text.size());
+                    } else {
+                        split = true;
+                        joined.append(text.data(), text.size());
+                    }
+                    break;
+                }
+                case reader::element_id:
+                    skip_element(r);
+                    break;
+                case reader::end_element_id:
+                    if (r.depth() == depth) {
+                        if (!found || split || !valid) {
+                            parse_value(r, string_ref{joined}, value);
+                        }
+                        return;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+        template <typename T>
+        void bind_element_value(reader & r, T & value, std::false_type)
+        {
+            bind_text_content(r, value);
+        }
+
+        template <typename T>
+        void bind_element_value(reader & r, T & value, std::true_type)
+        {
+            bind(r, value);
+        }
+
+        template <typename T>
+        void bind_element_member(reader & r, T & member, std::false_type)
+        {
+            bind_element_value(r, member,
+                               std::integral_constant<bool,
+                                                      has_binding<T>::value>());
+        }
+
+        template <typename T>
+        void bind_element_member(reader & r, T & member, std::true_type)
+        {
+            typedef typename T::value_type value_type;
+            member.emplace_back();
+            bind_element_value(
+                r, member.back(),
+                std::integral_constant<bool,
+                                       has_binding<value_type>::value>());
+        }
+
+        template <std::size_t I, std::size_t N>
+        struct field_dispatch {
+            //
+            // Element fields.
+            //
+            template <typename Fields, typename Class>
+            static bool element(reader & r, const string_ref & name,
+                                const Fields & fields, Class & object)
+            {
+                return element_field(r, name, std::get<I>(fields), object)
+                    || field_dispatch<I + 1, N>::element(r, name, fields,
+                                                         object);
+            }
+
+            template <typename Class, typename Member>
+            static bool
+            element_field(reader & r, const string_ref & name,
+                          const field<field_kind::element, Class, Member> & f,
+                          Class & object)
+            {
+                if (!name_equals(name, f.name, f.name_size)) { return false; }
+                bind_element_member(
+                    r, object.*f.member,
+                    std::integral_constant<bool, is_vector<Member>::value>());
+                return true;
+            }
+
+            template <typename F, typename Class>
+            static bool element_field(reader &, const string_ref &,
+                                      const F &, Class &)
+            {
+                return false;
+            }
+
+            //
+            // Attribute fields.
+            //
+            template <typename Fields, typename Class>
+            static bool attribute(reader & r, const string_ref & name,
+                                  const string_ref & uri,
+                                  const Fields & fields, Class & object)
+            {
+                return attribute_field(r, name, uri, std::get<I>(fields),
+                                       object)
+                    || field_dispatch<I + 1, N>::attribute(r, name, uri,
+                                                           fields, object);
+            }
+
+            template <typename Class, typename Member>
+            static bool
+            attribute_field(
+                reader & r, const string_ref & name, const string_ref & uri,
+                const field<field_kind::attribute, Class, Member> & f,
+                Class & object)
+            {
+                if (!name_equals(name, f.name, f.name_size)
+                    || !name_equals(uri, f.namespace_uri,
+                                    f.namespace_uri_size)) {
+                    return false;
+                }
+                parse_value(r, r.value_ref(), object.*f.member);
+                return true;
+            }
+
+            template <typename F, typename Class>
+            static bool attribute_field(reader &, const string_ref &,
+                                        const string_ref &, const F &,
+                                        Class &)
+            {
+                return false;
+            }
+
+            //
+            // Text fields.
+            //
+            template <typename Fields, typename Class>
+            static bool text(reader & r, const string_ref & value,
+                             const Fields & fields, Class & object)
+            {
+                return text_field(r, value, std::get<I>(fields), object)
+                    || field_dispatch<I + 1, N>::text(r, value, fields,
+                                                      object);
+            }
+
+            template <typename Class, typename Member>
+            static bool
+            text_field(reader & r, const string_ref & value,
+                       const field<field_kind::text, Class, Member> & f,
+                       Class & object)
+            {
+                parse_value(r, value, object.*f.member);
+                return true;
+            }
+
+            template <typename F, typename Class>
+            static bool text_field(reader &, const string_ref &,
+                                   const F &, Class &)
+            {
+                return false;
+            }
+        };
+
+        template <std::size_t N>
+        struct field_dispatch<N, N> {
+            template <typename Fields, typename Class>
+            static bool element(reader &, const string_ref &,
+                                const Fields &, Class &)
+            {
+                return false;
+            }
+
+            template <typename Fields, typename Class>
+            static bool attribute(reader &, const string_ref &,
+                                  const string_ref &, const Fields &,
+                                  Class &)
+            {
+                return false;
+            }
+
+            template <typename Fields, typename Class>
+            static bool text(reader &, const string_ref &,
+                             const Fields &, Class &)
+            {
+                return false;
+            }
+        };
+    }
+
+    /**
+     * @brief Bind an element to a structure.
+     *
+     * If @p r is positioned on an element, that element is bound to
+     * @p object; otherwise, @p r is first advanced to the next element.
+     * On return, @p r is positioned on the element's end tag (or on the
+     * element itself, if it is empty).
+     *
+     * @tparam T    a type declared with @c XMLRW_BINDING.
+     *
+     * @param[in,out] r         a reader.
+     * @param[out]    object    the object to fill.
+     *
+     * @exception xml::parse_error  if there is an error in the input, or a
+     *                              value cannot be converted.
+     * @exception std::bad_alloc    if memory allocation fails.
+     */
+    template <typename T>
+    void bind(reader & r, T & object)
+    {
+        static_assert(detail::has_binding<T>::value,
+                      "T must be declared with XMLRW_BINDING");
+
+        while (r.node_type() != reader::element_id) {
+            if (!r.read()) {
+                throw parse_error{r.line(), "expected an element"};
+            }
+        }
+
+        typedef decltype(detail::fields_of<T>()) fields_type;
+        typedef detail::field_dispatch<0, std::tuple_size<fields_type>::value>
+            dispatch;
+        const fields_type fields = detail::fields_of<T>();
+
+        const bool empty = r.empty_element();
+        const std::size_t depth = r.depth();
+
+        if (r.move_to_first_attribute()) {
+            do {
+                dispatch::attribute(r, r.local_name_ref(), r.namespace_uri(),
+                                    fields, object);
+            } while (r.move_to_next_attribute());
+            r.move_to_element();
+        }
+
+        if (empty) { return; }
+
+        //
+        // Text is collected, if it is bound, and converted at the end tag.
+        // Whitespace alone is text only where there are no child elements.
+        //
+        const bool text_bound = detail::has_text_field<fields_type>::value;
+        std::string text;
+        bool found_text = false;
+        bool found_whitespace = false;
+        bool found_element = false;
+        while (r.read()) {
+            switch (r.node_type()) {
+            case reader::element_id:
+                found_element = true;
+                if (!dispatch::element(r, r.local_name_ref(), fields,
+                                       object)) {
+                    detail::skip_element(r);
+                }
+                break;
+            case reader::text_id:
+            case reader::cdata_id:
+                found_text = true;
+                if (text_bound) { detail::append(text, r.value_ref()); }
+                break;
+            case reader::whitespace_id:
+            case reader::significant_whitespace_id:
+                found_whitespace = true;
+                if (text_bound) { detail::append(text, r.value_ref()); }
+                break;
+            case reader::end_element_id:
+                if (r.depth() == depth) {
+                    if (found_text || (found_whitespace && !found_element)) {
+                        dispatch::text(r, string_ref{text}, fields, object);
+                    }
+                    return;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        throw parse_error{r.line(), "unexpected end of document"};
+    }
+}
+
+/**
+ * @brief Declare the bound fields of a structure.
+ *
+ * Use at namespace scope, in the namespace of @p type.
+ *
+ * @param type  the structure.
+ * @param ...   field descriptors.
+ */
+#   define XMLRW_BINDING(type, ...)                                        \
+    inline auto xmlrw_binding(const type *)                               \
+        -> decltype(std::make_tuple(__VA_ARGS__))                         \
+    {                                                                     \
+        return std::make_tuple(__VA_ARGS__);                              \
+    }
+
+/**
+ * @brief Bind a member to child elements with the member's name.
+ */
+#   define XMLRW_ELEMENT(type, member)                                     \
+    ::xml::make_field< ::xml::field_kind::element>(#member, &type::member)
+
+/**
+ * @brief Bind a member to child elements with local name @p name.
+ */
+#   define XMLRW_ELEMENT_NAMED(type, member, name)                         \
+    ::xml::make_field< ::xml::field_kind::element>(name, &type::member)
+
+/**
+ * @brief Bind a member to the attribute with the member's name.
+ */
+#   define XMLRW_ATTRIBUTE(type, member)                                   \
+    ::xml::make_field< ::xml::field_kind::attribute>(#member, &type::member)
+
+/**
+ * @brief Bind a member to the attribute with local name @p name.
+ */
+#   define XMLRW_ATTRIBUTE_NAMED(type, member, name)                       \
+    ::xml::make_field< ::xml::field_kind::attribute>(name, &type::member)
+
+/**
+ * @brief Bind a member to the attribute with local name @p name in the
+ *        namespace @p uri.
+ */
+#   define XMLRW_ATTRIBUTE_NS(type, member, uri, name)                     \
+    ::xml::make_field< ::xml::field_kind::attribute>(uri, name,            \
+                                                     &type::member)
+
+/**
+ * @brief Bind a member to the element's text content.
+ */
+#   define XMLRW_TEXT(type, member)                                        \
+    ::xml::make_field< ::xml::field_kind::text>("", &type::member)
+
+# endif // XML_BINDING_H
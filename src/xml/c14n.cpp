@@ -0,0 +1,395 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+# include "c14n.h"
+# include "digest.h"
+# include "reader.h"
+# include <algorithm>
+# include <cstring>
+# include <stdexcept>
+# include <string>
+# include <vector>
+
+/**
+ * @file xml/c14n.h
+ *
+ * @brief Streaming canonicalization.
+ */
+
+/**
+ * @class xml::canonicalization_options
+ *
+ * @brief Options for @c xml::canonicalize.
+ *
+ * @c with_comments selects Canonical XML with comments; by default,
+ * comments are omitted.
+ */
+
+namespace {
+
+    const char xmlns_uri[] = "http://www.w3.org/2000/xmlns/";
+
+    //
+    // Canonical output is staged in a fixed buffer and handed to the digest
+    // a buffer at a time.
+    //
+    class canonical_output {
+        xml::digest & out_;
+        char buf_[8192];
+        std::size_t size_;
+
+    public:
+        explicit canonical_output(xml::digest & out) throw ():
+            out_(out),
+            size_{0}
+        {}
+
+        canonical_output(const canonical_output &) = delete;
+        canonical_output & operator=(const canonical_output &) = delete;
+
+        void write(const char * data, std::size_t size)
+        {
+            if (size > sizeof this->buf_ - this->size_) {
+                this->flush();
+                if (size > sizeof this->buf_) {
+                    this->out_.update(data, size);
+                    return;
+                }
+            }
+            std::memcpy(this->buf_ + this->size_, data, size);
+            this->size_ += size;
+        }
+
+        void write(const xml::string_ref & str)
+        {
+            this->write(str.data(), str.size());
+        }
+
+        void write(const char c)
+        {
+            if (this->size_ == sizeof this->buf_) { this->flush(); }
+            this->buf_[this->size_++] = c;
+        }
+
+        void flush()
+        {
+            if (this->size_ == 0) { return; }
+            this->out_.update(this->buf_, this->size_);
+            this->size_ = 0;
+        }
+    };
+
+    //
+    // Write text escaped as for a text node (C14N 1.0, section 2.3).
+    //
+    void write_text(canonical_output & out, const xml::string_ref & text)
+    {
+        const char * run = text.begin();
+        for (const char * p = run; p != text.end(); ++p) {
+            const char * replacement;
+            switch (*p) {
+            case '&':  replacement = "&amp;";  break;
+            case '<':  replacement = "&lt;";   break;
+            case '>':  replacement = "&gt;";   break;
+            case '\r': replacement = "&#xD;";  break;
+            default: continue;
+            }
+            out.write(run, p - run);
+            out.write(replacement, std::strlen(replacement));
+            run = p + 1;
+        }
+        out.write(run, text.end() - run);
+    }
+
+    //
+    // Write text escaped as for an attribute value.
+    //
+    void write_attribute_value(canonical_output & out,
+                               const std::string & value)
+    {
+        const char * run = value.data();
+        const char * const end = value.data() + value.size();
+        for (const char * p = run; p != end; ++p) {
+            const char * replacement;
+            switch (*p) {
+            case '&':  replacement = "&amp;";  break;
+            case '<':  replacement = "&lt;";   break;
+            case '"':  replacement = "&quot;"; break;
+            case '\t': replacement = "&#x9;";  break;
+            case '\n': replacement = "&#xA;";  break;
+            case '\r': replacement = "&#xD;";  break;
+            default: continue;
+            }
+            out.write(run, p - run);
+            out.write(replacement, std::strlen(replacement));
+            run = p + 1;
+        }
+        out.write(run, end - run);
+    }
+
+    struct attribute_node {
+        bool namespace_declaration;
+        std::string sort_uri;
+        std::string sort_name;
+        std::string qualified_name;
+        std::string value;
+    };
+
+    bool canonical_order(const attribute_node * const lhs,
+                         const attribute_node * const rhs)
+    {
+        //
+        // Namespace declarations precede attributes and are ordered by
+        // prefix, with the default namespace first; attributes are
+        // ordered by namespace URI, then local name.
+        //
+        if (lhs->namespace_declaration != rhs->namespace_declaration) {
+            return lhs->namespace_declaration;
+        }
+        const int cmp = lhs->sort_uri.compare(rhs->sort_uri);
+        if (cmp != 0) { return cmp < 0; }
+        return lhs->sort_name < rhs->sort_name;
+    }
+
+    //
+    // The state carried from one element to the next.  Attribute storage
+    // is reused, so its size is bounded by the largest start tag rather
+    // than by the document.
+    //
+    class canonicalizer {
+        canonical_output & out_;
+        std::vector<attribute_node> attributes_;
+        std::vector<const attribute_node *> sorted_;
+        //
+        // The namespace declarations rendered on the open elements, and
+        // the number rendered before each was opened.
+        //
+        std::vector<xml::namespace_binding> rendered_;
+        std::vector<std::size_t> rendered_marks_;
+        std::string name_;
+
+    public:
+        explicit canonicalizer(canonical_output & out):
+            out_(out)
+        {}
+
+        canonicalizer(const canonicalizer &) = delete;
+        canonicalizer & operator=(const canonicalizer &) = delete;
+
+        void start_element(xml::reader & in);
+        void end_element(const xml::string_ref & qualified_name);
+
+    private:
+        bool rendered(const attribute_node & decl) const;
+    };
+
+    void canonicalizer::start_element(xml::reader & in)
+    {
+        const bool empty = in.empty_element();
+        const xml::string_ref qname = in.qualified_name_ref();
+        this->name_.assign(qname.data(), qname.size());
+
+        std::size_t count = 0;
+        for (bool more = in.move_to_first_attribute();
+             more;
+             more = in.move_to_next_attribute()) {
+            if (count == this->attributes_.size()) {
+                this->attributes_.emplace_back();
+            }
+            attribute_node & attr = this->attributes_[count++];
+            const xml::string_ref uri = in.namespace_uri();
+            const xml::string_ref name = in.qualified_name_ref();
+            const xml::string_ref value = in.value_ref();
+            attr.namespace_declaration = uri.size() == sizeof xmlns_uri - 1
+                && std::memcmp(uri.data(), xmlns_uri, uri.size()) == 0;
+            attr.qualified_name.assign(name.data(), name.size());
+            attr.value.assign(value.data(), value.size());
+            if (attr.namespace_declaration) {
+                attr.sort_uri.clear();
+                //
+                // The prefix; or empty for the default namespace.
+                //
+                if (attr.qualified_name == "xmlns") {
+                    attr.sort_name.clear();
+                } else {
+                    attr.sort_name.assign(attr.qualified_name, 6,
+                                          std::string::npos);
+                }
+            } else {
+                const xml::string_ref local = in.local_name_ref();
+                attr.sort_uri.assign(uri.data(), uri.size());
+                attr.sort_name.assign(local.data(), local.size());
+            }
+        }
+
+        this->sorted_.clear();
+        for (std::size_t i = 0; i < count; ++i) {
+            const attribute_node & attr = this->attributes_[i];
+            if (attr.namespace_declaration && this->rendered(attr)) {
+                continue;
+            }
+            this->sorted_.push_back(&attr);
+        }
+        std::sort(this->sorted_.begin(), this->sorted_.end(),
+                  canonical_order);
+
+        this->rendered_marks_.push_back(this->rendered_.size());
+        this->out_.write('<');
+        this->out_.write(this->name_.data(), this->name_.size());
+        for (const attribute_node * const attr: this->sorted_) {
+            if (attr->namespace_declaration) {
+                this->rendered_.push_back(
+                    xml::namespace_binding{attr->sort_name, attr->value});
+            }
+            this->out_.write(' ');
+            this->out_.write(attr->qualified_name.data(),
+                             attr->qualified_name.size());
+            this->out_.write("=\"", 2);
+            write_attribute_value(this->out_, attr->value);
+            this->out_.write('"');
+        }
+        this->out_.write('>');
+
+        //
+        // Canonical XML has no empty-element tags.
+        //
+        if (empty) { this->end_element(this->name_); }
+    }
+
+    void canonicalizer::end_element(const xml::string_ref & qualified_name)
+    {
+        if (this->rendered_marks_.empty()) {
+            throw std::logic_error{"unbalanced end tag"};
+        }
+        this->rendered_.resize(this->rendered_marks_.back());
+        this->rendered_marks_.pop_back();
+        this->out_.write("</", 2);
+        this->out_.write(qualified_name);
+        this->out_.write('>');
+    }
+
+    //
+    // Whether the nearest output ancestor already renders an identical
+    // namespace declaration, which makes this one superfluous.
+    //
+    bool canonicalizer::rendered(const attribute_node & decl) const
+    {
+        for (auto binding = this->rendered_.rbegin();
+             binding != this->rendered_.rend();
+             ++binding) {
+            if (binding->prefix == decl.sort_name) {
+                return binding->uri == decl.value;
+            }
+        }
+        //
+        // xmlns="" is only needed to undo a rendered default namespace.
+        //
+        return decl.sort_name.empty() && decl.value.empty();
+    }
+}
+
+/**
+ * @brief Feed the canonical form of a document to a digest.
+ *
+ * Reads @p in to the end of the document, passing the Canonical XML 1.0
+ * form of what it reads to @p out.  Nothing is retained beyond the current
+ * start tag and the namespace declarations in scope, so the memory used
+ * does not depend on the size of the document.
+ *
+ * Entity references must be expanded by the reader; a reader constructed
+ * with @c xml::reader_options::entities expands them, and also supplies
+ * attribute defaults declared in the DTD.
+ *
+ * @param[in,out] in        a reader, positioned before the first node to
+ *                          canonicalize; typically, newly constructed.
+ * @param[in,out] out       a digest.
+ * @param[in]     options   canonicalization options.
+ *
+ * @exception xml::parse_error      if @p in encounters a parse error.
+ * @exception std::runtime_error    if @p in reports an unexpanded entity
+ *                                  reference.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+void xml::canonicalize(reader & in, digest & out,
+                       const canonicalization_options & options)
+{
+    canonical_output output{out};
+    canonicalizer c14n{output};
+    bool seen_document_element = false;
+
+    while (in.read()) {
+        const int type = in.node_type();
+        const bool top_level = in.depth() == 0;
+        switch (type) {
+        case reader::element_id:
+            seen_document_element = true;
+            c14n.start_element(in);
+            break;
+        case reader::end_element_id:
+            c14n.end_element(in.qualified_name_ref());
+            break;
+        case reader::text_id:
+        case reader::cdata_id:
+            write_text(output, in.value_ref());
+            break;
+        case reader::whitespace_id:
+        case reader::significant_whitespace_id:
+            //
+            // Whitespace outside the document element is not part of the
+            // canonical form.
+            //
+            if (!top_level) { write_text(output, in.value_ref()); }
+            break;
+        case reader::processing_instruction_id:
+        case reader::comment_id:
+            if (type == reader::comment_id && !options.with_comments) {
+                break;
+            }
+            if (top_level && seen_document_element) { output.write('\n'); }
+            if (type == reader::comment_id) {
+                output.write("<!--", 4);
+                output.write(in.value_ref());
+                output.write("-->", 3);
+            } else {
+                output.write("<?", 2);
+                output.write(in.qualified_name_ref());
+                const string_ref data = in.value_ref();
+                if (!data.empty()) {
+                    output.write(' ');
+                    output.write(data);
+                }
+                output.write("?>", 2);
+            }
+            if (top_level && !seen_document_element) { output.write('\n'); }
+            break;
+        case 5: // entity reference
+            throw std::runtime_error{"cannot canonicalize an unexpanded "
+                                     "entity reference"};
+        default:
+            break;
+        }
+    }
+    output.flush();
+}
@@ -0,0 +1,794 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "columns.h"
+# include "binding.h"
+# include "reader.h"
+# include <cstring>
+# include <limits>
+# include <stdexcept>
+
+/**
+ * @file xml/columns.h
+ *
+ * @brief Extraction of repeated records into typed columns.
+ */
+
+/**
+ * @enum xml::column_type
+ *
+ * @brief The type of the values in a column.
+ */
+
+/**
+ * @var xml::column_type xml::column_type::boolean
+ *
+ * @brief @c true or @c false; stored one bit per row.
+ */
+
+/**
+ * @var xml::column_type xml::column_type::int32
+ *
+ * @brief A @c std::int32_t per row.
+ */
+
+/**
+ * @var xml::column_type xml::column_type::int64
+ *
+ * @brief A @c std::int64_t per row.
+ */
+
+/**
+ * @var xml::column_type xml::column_type::float32
+ *
+ * @brief A @c float per row.
+ */
+
+/**
+ * @var xml::column_type xml::column_type::float64
+ *
+ * @brief A @c double per row.
+ */
+
+/**
+ * @var xml::column_type xml::column_type::string
+ *
+ * @brief Text; stored as the concatenated values with an offset per row.
+ */
+
+/**
+ * @enum xml::invalid_value
+ *
+ * @brief What to do with a value that cannot be converted to the type of
+ *        its column.
+ */
+
+/**
+ * @var xml::invalid_value xml::invalid_value::error
+ *
+ * @brief Throw @c xml::parse_error.
+ */
+
+/**
+ * @var xml::invalid_value xml::invalid_value::null
+ *
+ * @brief Make the row null in that column.
+ */
+
+/**
+ * @class xml::column_options
+ *
+ * @brief Options for an @c xml::column_extractor.
+ */
+
+/**
+ * @var std::size_t xml::column_options::batch_size
+ *
+ * @brief The greatest number of rows in a batch.
+ */
+
+/**
+ * @var xml::invalid_value xml::column_options::on_invalid
+ *
+ * @brief What to do with a value that is not valid for its column.
+ */
+
+/**
+ * @var bool xml::column_options::empty_is_null
+ *
+ * @brief Whether an empty value is null in a column that is not a
+ *        @c xml::column_type::string column; otherwise it is invalid.
+ */
+
+/**
+ * @class xml::column
+ *
+ * @brief The values of one field for the rows of a batch.
+ *
+ * The layout is that of an Apache Arrow array:
+ *  - @c validity is a bitmap with a bit per row, least significant bit
+ *    first, set if the row has a value;
+ *  - for fixed-width types, @c data holds @c length values, 0 in null rows;
+ *  - for @c xml::column_type::boolean, @c data is a bitmap like
+ *    @c validity;
+ *  - for @c xml::column_type::string, @c data holds the values one after
+ *    another, and row @e i is the bytes from @c offsets[i] to
+ *    @c offsets[i+1].
+ */
+
+/**
+ * @var std::string xml::column::name
+ *
+ * @brief The name given to @c xml::column_extractor::add_column.
+ */
+
+/**
+ * @var xml::column_type xml::column::type
+ *
+ * @brief The type of the values.
+ */
+
+/**
+ * @var std::size_t xml::column::length
+ *
+ * @brief The number of rows.
+ */
+
+/**
+ * @var std::size_t xml::column::null_count
+ *
+ * @brief The number of null rows.
+ */
+
+/**
+ * @var std::vector<std::uint8_t> xml::column::validity
+ *
+ * @brief A bit per row, set if the row has a value.
+ */
+
+/**
+ * @var std::vector<unsigned char> xml::column::data
+ *
+ * @brief The values.
+ */
+
+/**
+ * @var std::vector<std::int32_t> xml::column::offsets
+ *
+ * @brief For a string column, @c length + 1 offsets into @c data.
+ */
+
+/**
+ * @brief Whether a row has a value.
+ *
+ * @param[in] row   a row.
+ *
+ * @return @c true if @p row has a value; @c false if it is null.
+ */
+bool xml::column::valid(const std::size_t row) const throw ()
+{
+    return (this->validity[row >> 3] >> (row & 7)) & 1;
+}
+
+/**
+ * @brief The value of a row in a boolean column.
+ *
+ * @param[in] row   a row.
+ *
+ * @return the value of @p row; @c false if it is null.
+ */
+bool xml::column::boolean(const std::size_t row) const throw ()
+{
+    return (this->data[row >> 3] >> (row & 7)) & 1;
+}
+
+/**
+ * @brief The value of a row in a string column.
+ *
+ * @param[in] row   a row.
+ *
+ * @return the value of @p row; empty if it is null.
+ */
+xml::string_ref xml::column::string(const std::size_t row) const throw ()
+{
+    const std::int32_t begin = this->offsets[row];
+    return string_ref{
+        reinterpret_cast<const char *>(this->data.data()) + begin,
+        std::size_t(this->offsets[row + 1] - begin)};
+}
+
+/**
+ * @class xml::column_batch
+ *
+ * @brief Columns for a number of records.
+ */
+
+/**
+ * @var std::size_t xml::column_batch::rows
+ *
+ * @brief The number of records.
+ */
+
+/**
+ * @var std::vector<xml::column> xml::column_batch::columns
+ *
+ * @brief The columns, in the order they were added to the extractor.
+ */
+
+namespace {
+
+    enum class value_status : std::uint8_t { none, valid, invalid };
+
+    template <typename T>
+    value_status store_fixed(xml::column & c, const std::size_t row,
+                             const xml::string_ref & text)
+    {
+        T value = T();
+        const bool ok = xml::value_traits<T>::parse(text, value);
+        if (!ok) { value = T(); }
+        c.data.resize((row + 1) * sizeof (T));
+        std::memcpy(c.data.data() + row * sizeof (T), &value, sizeof value);
+        return ok ? value_status::valid : value_status::invalid;
+    }
+
+    void set_bit(std::vector<std::uint8_t> & bits, const std::size_t i,
+                 const bool value)
+    {
+        if (bits.size() <= (i >> 3)) { bits.resize((i >> 3) + 1); }
+        const std::uint8_t mask = std::uint8_t(1u << (i & 7));
+        bits[i >> 3] = value ? std::uint8_t(bits[i >> 3] | mask)
+                             : std::uint8_t(bits[i >> 3] & ~mask);
+    }
+
+    //
+    // Write row's value, replacing any written before.
+    //
+    value_status store(xml::column & c, const std::size_t row,
+                       const xml::string_ref & text,
+                       const xml::column_options & options)
+    {
+        using xml::column_type;
+
+        if (c.type != column_type::string && options.empty_is_null
+            && xml::detail::trim(text).empty()) {
+            return value_status::none;
+        }
+        switch (c.type) {
+        case column_type::boolean:
+        {
+            bool value = false;
+            const bool ok = xml::value_traits<bool>::parse(text, value);
+            set_bit(c.data, row, ok && value);
+            return ok ? value_status::valid : value_status::invalid;
+        }
+        case column_type::int32:
+            return store_fixed<std::int32_t>(c, row, text);
+        case column_type::int64:
+            return store_fixed<std::int64_t>(c, row, text);
+        case column_type::float32:
+            return store_fixed<float>(c, row, text);
+        case column_type::float64:
+            return store_fixed<double>(c, row, text);
+        case column_type::string:
+        {
+            const std::size_t begin = std::size_t(c.offsets[row]);
+            if (begin + text.size()
+                    > std::size_t(std::numeric_limits<std::int32_t>::max())) {
+                throw std::length_error{
+                    "string column \"" + c.name
+                    + "\" exceeds 2 GiB; use a smaller batch size"};
+            }
+            c.data.resize(begin);
+            c.data.insert(c.data.end(), text.begin(), text.end());
+            c.offsets.resize(row + 2);
+            c.offsets[row + 1] = std::int32_t(c.data.size());
+            return value_status::valid;
+        }
+        }
+        return value_status::invalid;
+    }
+
+    //
+    // Complete row: a column that has no valid value gets a null.
+    //
+    void finish(xml::column & c, const std::size_t row, const bool valid)
+    {
+        using xml::column_type;
+
+        if (!valid) {
+            switch (c.type) {
+            case column_type::boolean:
+                set_bit(c.data, row, false);
+                break;
+            case column_type::int32:
+            case column_type::float32:
+                c.data.resize((row + 1) * 4);
+                std::memset(c.data.data() + row * 4, 0, 4);
+                break;
+            case column_type::int64:
+            case column_type::float64:
+                c.data.resize((row + 1) * 8);
+                std::memset(c.data.data() + row * 8, 0, 8);
+                break;
+            case column_type::string:
+                c.data.resize(std::size_t(c.offsets[row]));
+                c.offsets.resize(row + 2);
+                c.offsets[row + 1] = c.offsets[row];
+                break;
+            }
+            ++c.null_count;
+        } else if (c.type == column_type::boolean) {
+            c.data.resize((row >> 3) + 1);
+        }
+        set_bit(c.validity, row, valid);
+        c.length = row + 1;
+    }
+
+    const std::vector<std::string> split_path(const std::string & path)
+    {
+        std::vector<std::string> result;
+        std::string::size_type begin = (!path.empty() && path[0] == '/')
+                                     ? 1 : 0;
+        if (begin == path.size()) { return result; }
+        for (;;) {
+            const std::string::size_type end = path.find('/', begin);
+            result.push_back(path.substr(begin, end - begin));
+            if (result.back().empty()) {
+                throw std::invalid_argument{"invalid path \"" + path + "\""};
+            }
+            if (end == std::string::npos) { break; }
+            begin = end + 1;
+        }
+        return result;
+    }
+}
+
+struct xml::column_extractor::impl {
+    //
+    // The fields form a tree of element names under the record element,
+    // nodes[0].
+    //
+    struct node {
+        std::string name;
+        std::vector<std::size_t> children;
+        std::vector<std::size_t> text_columns;
+        std::vector<std::size_t> attribute_columns;
+    };
+
+    struct field {
+        std::string name;
+        column_type type;
+        std::string attribute;
+    };
+
+    //
+    // An element open within the current record.  Its first text node is
+    // converted in place; the text is kept only in case the content turns
+    // out to be split across several nodes.
+    //
+    struct open_element {
+        std::ptrdiff_t node;
+        std::vector<std::size_t> columns;
+        bool found;
+        bool split;
+        std::string joined;
+    };
+
+    const column_options options;
+    const std::vector<std::string> record_path;
+    std::vector<field> fields;
+    std::vector<node> nodes;
+
+    std::size_t matched;
+    std::vector<open_element> open;
+    std::size_t open_count;
+    std::vector<bool> assigned;
+    std::vector<value_status> status;
+
+    impl(const std::string & record_path, const column_options & options);
+
+    std::size_t add_column(const std::string & name,
+                           const std::string & path,
+                           column_type type);
+    void prepare(column_batch & batch) const;
+    void begin_record(reader & r, column_batch & batch);
+    void enter(reader & r, std::ptrdiff_t node, column_batch & batch);
+    void text(const reader & r, column_batch & batch);
+    void leave(const reader & r, column_batch & batch);
+    void set(column_batch & batch, std::size_t column,
+             const string_ref & text);
+    void check(const reader & r, std::size_t column,
+               const string_ref & text) const;
+    std::ptrdiff_t child(std::size_t parent, const string_ref & name) const;
+};
+
+xml::column_extractor::impl::impl(const std::string & record_path,
+                                  const column_options & options):
+    options(options),
+    record_path(split_path(record_path)),
+    nodes(1),
+    matched{0},
+    open_count{0}
+{
+    if (this->record_path.empty()) {
+        throw std::invalid_argument{"empty record path"};
+    }
+}
+
+std::size_t
+xml::column_extractor::impl::add_column(const std::string & name,
+                                        const std::string & path,
+                                        const column_type type)
+{
+    std::vector<std::string> steps =
+        (path == ".") ? std::vector<std::string>{} : split_path(path);
+    std::string attribute;
+    if (!steps.empty() && steps.back()[0] == '@') {
+        attribute = steps.back().substr(1);
+        steps.pop_back();
+        if (attribute.empty()) {
+            throw std::invalid_argument{"invalid path \"" + path + "\""};
+        }
+    }
+
+    std::size_t n = 0;
+    for (const auto & step : steps) {
+        const std::ptrdiff_t c = this->child(n, step);
+        if (c >= 0) {
+            n = std::size_t(c);
+        } else {
+            this->nodes.push_back(node{step, {}, {}, {}});
+            this->nodes[n].children.push_back(this->nodes.size() - 1);
+            n = this->nodes.size() - 1;
+        }
+    }
+
+    const std::size_t column = this->fields.size();
+    this->fields.push_back(field{name, type, attribute});
+    if (attribute.empty()) {
+        this->nodes[n].text_columns.push_back(column);
+    } else {
+        this->nodes[n].attribute_columns.push_back(column);
+    }
+    return column;
+}
+
+std::ptrdiff_t
+xml::column_extractor::impl::child(const std::size_t parent,
+                                   const string_ref & name) const
+{
+    for (const std::size_t c : this->nodes[parent].children) {
+        if (string_ref{this->nodes[c].name} == name) {
+            return std::ptrdiff_t(c);
+        }
+    }
+    return -1;
+}
+
+//
+// Empty the columns, keeping their storage.
+//
+void xml::column_extractor::impl::prepare(column_batch & batch) const
+{
+    batch.rows = 0;
+    batch.columns.resize(this->fields.size());
+    for (std::size_t i = 0; i < this->fields.size(); ++i) {
+        column & c = batch.columns[i];
+        c.name = this->fields[i].name;
+        c.type = this->fields[i].type;
+        c.length = 0;
+        c.null_count = 0;
+        c.validity.clear();
+        c.data.clear();
+        c.offsets.clear();
+        if (c.type == column_type::string) { c.offsets.push_back(0); }
+    }
+}
+
+void xml::column_extractor::impl::begin_record(reader & r,
+                                               column_batch & batch)
+{
+    this->assigned.assign(this->fields.size(), false);
+    this->status.assign(this->fields.size(), value_status::none);
+    this->open_count = 0;
+    this->enter(r, 0, batch);
+}
+
+void xml::column_extractor::impl::enter(reader & r,
+                                        const std::ptrdiff_t n,
+                                        column_batch & batch)
+{
+    if (this->open.size() == this->open_count) { this->open.emplace_back(); }
+    open_element & e = this->open[this->open_count++];
+    e.node = n;
+    e.columns.clear();
+    e.found = false;
+    e.split = false;
+    e.joined.clear();
+
+    const bool empty = r.empty_element();
+    if (n >= 0) {
+        const node & nd = this->nodes[std::size_t(n)];
+
+        //
+        // The first occurrence of a field in a record is used.
+        //
+        for (const std::size_t c : nd.text_columns) {
+            if (!this->assigned[c]) {
+                this->assigned[c] = true;
+                e.columns.push_back(c);
+            }
+        }
+        if (!nd.attribute_columns.empty() && r.move_to_first_attribute()) {
+            do {
+                const string_ref name = r.local_name_ref();
+                for (const std::size_t c : nd.attribute_columns) {
+                    if (!this->assigned[c]
+                        && string_ref{this->fields[c].attribute} == name) {
+                        this->assigned[c] = true;
+                        const string_ref value = r.value_ref();
+                        this->set(batch, c, value);
+                        this->check(r, c, value);
+                    }
+                }
+            } while (r.move_to_next_attribute());
+            r.move_to_element();
+        }
+    }
+    if (empty) { this->leave(r, batch); }
+}
+
+void xml::column_extractor::impl::text(const reader & r,
+                                       column_batch & batch)
+{
+    open_element & e = this->open[this->open_count - 1];
+    if (e.columns.empty()) { return; }
+    const string_ref text = r.value_ref();
+    if (!e.found) {
+        e.found = true;
+        for (const std::size_t c : e.columns) { this->set(batch, c, text); }
+        e.joined.assign(text.data(), text.size());
+    } else {
+        e.split = true;
+        e.joined.append(text.data(), text.size());
+    }
+}
+
+void xml::column_extractor::impl::leave(const reader & r,
+                                        column_batch & batch)
+{
+    open_element & e = this->open[--this->open_count];
+    const string_ref text = e.found ? string_ref{e.joined} : string_ref{};
+    for (const std::size_t c : e.columns) {
+        if (!e.found || e.split) { this->set(batch, c, text); }
+        this->check(r, c, text);
+    }
+
+    if (this->open_count == 0) {
+        for (std::size_t c = 0; c < batch.columns.size(); ++c) {
+            finish(batch.columns[c], batch.rows,
+                   this->status[c] == value_status::valid);
+        }
+        ++batch.rows;
+    }
+}
+
+void xml::column_extractor::impl::set(column_batch & batch,
+                                      const std::size_t column,
+                                      const string_ref & text)
+{
+    this->status[column] =
+        store(batch.columns[column], batch.rows, text, this->options);
+}
+
+void xml::column_extractor::impl::check(const reader & r,
+                                        const std::size_t column,
+                                        const string_ref & text) const
+{
+    if (this->status[column] == value_status::invalid
+        && this->options.on_invalid == invalid_value::error) {
+        throw parse_error{r.line(),
+                          "invalid value \"" + text.str()
+                          + "\" for column \"" + this->fields[column].name
+                          + "\""};
+    }
+}
+
+/**
+ * @class xml::column_extractor
+ *
+ * @brief Extracts fields of repeated records into columns.
+ *
+ * The records are the elements at a path from the document element; each
+ * becomes a row, and each column holds one field of the records:
+ *
+ * @code
+ * xml::column_extractor extract{"catalog/book"};
+ * const std::size_t price =
+ *     extract.add_column("price", "price", xml::column_type::float64);
+ * extract.add_column("id", "@id", xml::column_type::int64);
+ *
+ * xml::reader r{"catalog.xml"};
+ * xml::column_batch batch;
+ * while (extract.next_batch(r, batch)) {
+ *     const double * prices = batch.columns[price].values<double>();
+ *     ...
+ * }
+ * @endcode
+ *
+ * Values are converted directly from the reader's buffer with
+ * @c xml::value_traits, and stored contiguously in the layout described
+ * for @c xml::column.  A field that does not occur in a record is null; if
+ * it occurs more than once, the first occurrence is used.  Elements are
+ * matched by local name.
+ */
+
+/**
+ * @brief Construct.
+ *
+ * @param[in] record_path   the local names of the elements from the
+ *                          document element to a record, separated by
+ *                          `/`.
+ * @param[in] options       options.
+ *
+ * @exception std::invalid_argument if @p record_path is empty or has an
+ *                                  empty step.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::column_extractor::column_extractor(const std::string & record_path,
+                                        const column_options & options):
+    impl_{new impl{record_path, options}}
+{}
+
+/**
+ * @fn xml::column_extractor::column_extractor(const column_extractor &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Move construct.
+ */
+xml::column_extractor::column_extractor(column_extractor && e) throw ():
+    impl_{std::move(e.impl_)}
+{}
+
+/**
+ * @brief Destroy.
+ */
+xml::column_extractor::~column_extractor() throw ()
+{}
+
+/**
+ * @fn xml::column_extractor &
+ *     xml::column_extractor::operator=(const column_extractor &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Move assign.
+ */
+xml::column_extractor &
+xml::column_extractor::operator=(column_extractor && e) throw ()
+{
+    this->impl_ = std::move(e.impl_);
+    return *this;
+}
+
+/**
+ * @brief Add a column.
+ *
+ * @p path is relative to the record element: local names of elements
+ * separated by `/`, whose text content is the value; optionally ending
+ * with `@` and the local name of an attribute, whose value is the value.
+ * `.` is the text content of the record element itself.
+ *
+ * @param[in] name  the name of the column.
+ * @param[in] path  the field.
+ * @param[in] type  the type of the values.
+ *
+ * @return the index of the column in @c xml::column_batch::columns.
+ *
+ * @exception std::invalid_argument if @p path is not valid.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+std::size_t xml::column_extractor::add_column(const std::string & name,
+                                              const std::string & path,
+                                              const column_type type)
+{
+    return this->impl_->add_column(name, path, type);
+}
+
+/**
+ * @brief Extract the next batch of records.
+ *
+ * Reads @p r until @c xml::column_options::batch_size records have been
+ * extracted or the input ends; @p r is left after the last record's end
+ * tag, so the next call continues from there.  The storage of @p batch is
+ * reused.
+ *
+ * @param[in,out] r     a reader.
+ * @param[out]    batch the records.
+ *
+ * @return @c true if @p batch has any records; @c false if the input is
+ *         exhausted.
+ *
+ * @exception xml::parse_error      if the input is not well-formed; or a
+ *                                  value is not valid for its column and
+ *                                  @c xml::column_options::on_invalid is
+ *                                  @c xml::invalid_value::error.
+ * @exception std::length_error     if a string column's values in a batch
+ *                                  exceed 2 GiB.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+bool xml::column_extractor::next_batch(reader & r, column_batch & batch)
+{
+    impl & d = *this->impl_;
+    d.prepare(batch);
+    const std::size_t batch_size =
+        d.options.batch_size > 0 ? d.options.batch_size : 1;
+    while (batch.rows < batch_size && r.read()) {
+        switch (r.node_type()) {
+        case reader::element_id:
+            if (d.open_count > 0) {
+                const std::ptrdiff_t parent = d.open[d.open_count - 1].node;
+                d.enter(r,
+                        parent < 0 ? -1
+                                   : d.child(std::size_t(parent),
+                                             r.local_name_ref()),
+                        batch);
+            } else {
+                const std::size_t depth = r.depth();
+                if (depth == d.matched && depth < d.record_path.size()
+                    && r.local_name_ref() == d.record_path[depth]) {
+                    if (depth + 1 == d.record_path.size()) {
+                        d.begin_record(r, batch);
+                    } else if (!r.empty_element()) {
+                        ++d.matched;
+                    }
+                }
+            }
+            break;
+        case reader::end_element_id:
+            if (d.open_count > 0) {
+                d.leave(r, batch);
+            } else if (r.depth() < d.matched) {
+                d.matched = r.depth();
+            }
+            break;
+        case reader::text_id:
+        case reader::cdata_id:
+        case reader::whitespace_id:
+        case reader::significant_whitespace_id:
+            if (d.open_count > 0) { d.text(r, batch); }
+            break;
+        default:
+            break;
+        }
+    }
+    return batch.rows > 0;
+}
@@ -0,0 +1,113 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_COLUMNS_H
+#   define XML_COLUMNS_H
+
+#   include "string_ref.h"
+#   include <cstddef>
+#   include <cstdint>
+#   include <memory>
+#   include <string>
+#   include <vector>
+
+namespace xml
+{
+    class reader;
+
+    enum class column_type : std::uint8_t {
+        boolean,
+        int32,
+        int64,
+        float32,
+        float64,
+        string
+    };
+
+    enum class invalid_value : std::uint8_t { error, null };
+
+    struct column_options {
+        std::size_t batch_size = 64 * 1024;
+        invalid_value on_invalid = invalid_value::error;
+        bool empty_is_null = true;
+    };
+
+    struct column {
+        std::string name;
+        column_type type = column_type::string;
+        std::size_t length = 0;
+        std::size_t null_count = 0;
+        std::vector<std::uint8_t> validity;
+        std::vector<unsigned char> data;
+        std::vector<std::int32_t> offsets;
+
+        bool valid(std::size_t row) const throw ();
+        bool boolean(std::size_t row) const throw ();
+        string_ref string(std::size_t row) const throw ();
+
+        /**
+         * @brief The values of a fixed-width column.
+         *
+         * @tparam T    @c std::int32_t, @c std::int64_t, @c float or
+         *              @c double, according to @c type.
+         *
+         * @return a pointer to @c length values; null rows hold 0.
+         */
+        template <typename T>
+        const T * values() const throw ()
+        {
+            return reinterpret_cast<const T *>(this->data.data());
+        }
+    };
+
+    struct column_batch {
+        std::size_t rows = 0;
+        std::vector<column> columns;
+    };
+
+    class column_extractor {
+        struct impl;
+        std::unique_ptr<impl> impl_;
+
+    public:
+        explicit column_extractor(
+            const std::string & record_path,
+            const column_options & options = column_options());
+        column_extractor(const column_extractor &) = delete;
+        column_extractor(column_extractor &&) throw ();
+        ~column_extractor() throw ();
+
+        column_extractor & operator=(const column_extractor &) = delete;
+        column_extractor & operator=(column_extractor &&) throw ();
+
+        std::size_t add_column(const std::string & name,
+                               const std::string & path,
+                               column_type type);
+        bool next_batch(reader & r, column_batch & batch);
+    };
+}
+
+# endif // XML_COLUMNS_H
@@ -0,0 +1,312 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+# include "digest.h"
+# include <algorithm>
+# include <cstring>
+
+/**
+ * @file xml/digest.h
+ *
+ * @brief Incremental message digests.
+ */
+
+/**
+ * @class xml::digest
+ *
+ * @brief Abstract base for an incremental message digest.
+ *
+ * Data is fed to the digest in any number of calls to @c #update; @c #value
+ * may be called at any point and does not disturb the digest's state.
+ *
+ * @sa xml::canonicalize
+ */
+
+/**
+ * @brief Destroy.
+ */
+xml::digest::~digest() throw ()
+{}
+
+/**
+ * @fn void xml::digest::update(const char * data, std::size_t size)
+ *
+ * @brief Add data to the digest.
+ *
+ * @param[in] data  the data.
+ * @param[in] size  the number of bytes at @p data.
+ */
+
+/**
+ * @fn const std::vector<std::uint8_t> xml::digest::value() const
+ *
+ * @brief The digest of the data added so far.
+ *
+ * @return the digest of the data added so far.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+
+/**
+ * @brief The digest of the data added so far, as lowercase hexadecimal.
+ *
+ * @return the digest of the data added so far, as lowercase hexadecimal.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+const std::string xml::digest::hex() const
+{
+    static const char digits[] = "0123456789abcdef";
+    const std::vector<std::uint8_t> bytes = this->value();
+    std::string result;
+    result.reserve(2 * bytes.size());
+    for (const std::uint8_t b: bytes) {
+        result += digits[b >> 4];
+        result += digits[b & 0xf];
+    }
+    return result;
+}
+
+namespace {
+
+    const std::uint32_t sha256_k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+        0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+        0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+        0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+        0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+        0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+    inline std::uint32_t rotr(const std::uint32_t x, const unsigned n)
+        throw ()
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+}
+
+/**
+ * @class xml::sha256_digest
+ *
+ * @brief SHA-256, as specified by FIPS 180-4.
+ */
+
+/**
+ * @brief Construct.
+ */
+xml::sha256_digest::sha256_digest() throw ():
+    state_{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+           0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19},
+    block_size_{0},
+    length_{0}
+{}
+
+/**
+ * @brief Destroy.
+ */
+xml::sha256_digest::~sha256_digest() throw ()
+{}
+
+/**
+ * @brief Add data to the digest.
+ *
+ * @param[in] data  the data.
+ * @param[in] size  the number of bytes at @p data.
+ */
+void xml::sha256_digest::update(const char * data, std::size_t size)
+{
+    const std::uint8_t * in = reinterpret_cast<const std::uint8_t *>(data);
+    this->length_ += size;
+
+    if (this->block_size_ > 0) {
+        const std::size_t n = (std::min)(size, 64 - this->block_size_);
+        std::memcpy(this->block_ + this->block_size_, in, n);
+        this->block_size_ += n;
+        in += n;
+        size -= n;
+        if (this->block_size_ < 64) { return; }
+        this->compress(this->block_);
+        this->block_size_ = 0;
+    }
+
+    for (; size >= 64; in += 64, size -= 64) { this->compress(in); }
+
+    std::memcpy(this->block_, in, size);
+    this->block_size_ = size;
+}
+
+/**
+ * @brief The digest of the data added so far.
+ *
+ * @return the 32-byte digest of the data added so far.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+const std::vector<std::uint8_t> xml::sha256_digest::value() const
+{
+    //
+    // Finish a copy, so that more data may still be added to this one.
+    //
+    sha256_digest final{*this};
+    const std::uint64_t bits = this->length_ * 8;
+
+    std::uint8_t padding[72] = { 0x80 };
+    const std::size_t pad_size = (this->block_size_ < 56)
+                               ? 56 - this->block_size_
+                               : 120 - this->block_size_;
+    for (std::size_t i = 0; i < 8; ++i) {
+        padding[pad_size + i] = std::uint8_t(bits >> (56 - 8 * i));
+    }
+    final.update(reinterpret_cast<const char *>(padding), pad_size + 8);
+
+    std::vector<std::uint8_t> result(32);
+    for (std::size_t i = 0; i < 8; ++i) {
+        result[4 * i]     = std::uint8_t(final.state_[i] >> 24);
+        result[4 * i + 1] = std::uint8_t(final.state_[i] >> 16);
+        result[4 * i + 2] = std::uint8_t(final.state_[i] >> 8);
+        result[4 * i + 3] = std::uint8_t(final.state_[i]);
+    }
+    return result;
+}
+
+/**
+ * @internal
+ *
+ * @brief Process one 64-byte block.
+ *
+ * @param[in] block a 64-byte block.
+ */
+void xml::sha256_digest::compress(const std::uint8_t * const block) throw ()
+{
+    std::uint32_t w[64];
+    for (std::size_t i = 0; i < 16; ++i) {
+        w[i] = (std::uint32_t(block[4 * i]) << 24)
+             | (std::uint32_t(block[4 * i + 1]) << 16)
+             | (std::uint32_t(block[4 * i + 2]) << 8)
+             | std::uint32_t(block[4 * i + 3]);
+    }
+    for (std::size_t i = 16; i < 64; ++i) {
+        const std::uint32_t s0 =
+            rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const std::uint32_t s1 =
+            rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    std::uint32_t a = this->state_[0], b = this->state_[1],
+                  c = this->state_[2], d = this->state_[3],
+                  e = this->state_[4], f = this->state_[5],
+                  g = this->state_[6], h = this->state_[7];
+    for (std::size_t i = 0; i < 64; ++i) {
+        const std::uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        const std::uint32_t ch = (e & f) ^ (~e & g);
+        const std::uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+        const std::uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        const std::uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        const std::uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    this->state_[0] += a;
+    this->state_[1] += b;
+    this->state_[2] += c;
+    this->state_[3] += d;
+    this->state_[4] += e;
+    this->state_[5] += f;
+    this->state_[6] += g;
+    this->state_[7] += h;
+}
+
+/**
+ * @class xml::fnv1a64_digest
+ *
+ * @brief 64-bit FNV-1a.
+ *
+ * FNV-1a is much cheaper than SHA-256 but is not collision resistant; use
+ * it to detect duplicates among trusted documents, not to verify them.
+ */
+
+/**
+ * @brief Construct.
+ */
+xml::fnv1a64_digest::fnv1a64_digest() throw ():
+    hash_{0xcbf29ce484222325ULL}
+{}
+
+/**
+ * @brief Destroy.
+ */
+xml::fnv1a64_digest::~fnv1a64_digest() throw ()
+{}
+
+/**
+ * @brief Add data to the digest.
+ *
+ * @param[in] data  the data.
+ * @param[in] size  the number of bytes at @p data.
+ */
+void xml::fnv1a64_digest::update(const char * const data,
+                                 const std::size_t size)
+{
+    std::uint64_t hash = this->hash_;
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= std::uint8_t(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    this->hash_ = hash;
+}
+
+/**
+ * @brief The digest of the data added so far.
+ *
+ * @return the 8-byte digest of the data added so far, most significant
+ *         byte first.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+const std::vector<std::uint8_t> xml::fnv1a64_digest::value() const
+{
+    std::vector<std::uint8_t> result(8);
+    for (std::size_t i = 0; i < 8; ++i) {
+        result[i] = std::uint8_t(this->hash_ >> (56 - 8 * i));
+    }
+    return result;
+}
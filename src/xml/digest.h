@@ -0,0 +1,75 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+# ifndef XML_DIGEST_H
+#   define XML_DIGEST_H
+
+#   include <cstddef>
+#   include <cstdint>
+#   include <string>
+#   include <vector>
+
+namespace xml
+{
+    class digest {
+    public:
+        virtual ~digest() throw () = 0;
+
+        virtual void update(const char * data, std::size_t size) = 0;
+        virtual const std::vector<std::uint8_t> value() const = 0;
+
+        const std::string hex() const;
+    };
+
+    class sha256_digest : public digest {
+        std::uint32_t state_[8];
+        std::uint8_t block_[64];
+        std::size_t block_size_;
+        std::uint64_t length_;
+
+    public:
+        sha256_digest() throw ();
+        virtual ~sha256_digest() throw ();
+
+        virtual void update(const char * data, std::size_t size);
+        virtual const std::vector<std::uint8_t> value() const;
+
+    private:
+        void compress(const std::uint8_t * block) throw ();
+    };
+
+    class fnv1a64_digest : public digest {
+        std::uint64_t hash_;
+
+    public:
+        fnv1a64_digest() throw ();
+        virtual ~fnv1a64_digest() throw ();
+
+        virtual void update(const char * data, std::size_t size);
+        virtual const std::vector<std::uint8_t> value() const;
+    };
+}
+
+# endif // XML_DIGEST_H
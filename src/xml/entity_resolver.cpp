@@ -0,0 +1,207 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "entity_resolver.h"
+# include <fstream>
+# include <map>
+# include <mutex>
+# include <sstream>
+# include <vector>
+
+/**
+ * @file xml/entity_resolver.h
+ *
+ * @brief Resolution of external DTDs and entities from an in-memory cache.
+ */
+
+/**
+ * @class xml::entity_resolver
+ *
+ * @brief An in-memory catalog of external DTDs and entities.
+ *
+ * An @c xml::reader constructed with @c xml::reader_options::entities
+ * loads external DTDs and entities only through its resolver; anything the
+ * resolver cannot supply fails to load, and nothing is fetched from the
+ * network.
+ *
+ * Identifiers are resolved first by public identifier, then by system
+ * identifier, and finally by looking up the last path segment of the
+ * system identifier in each directory added with @c #add_directory, in the
+ * order they were added.  Files found in a directory are read once and
+ * cached for the lifetime of the resolver.
+ *
+ * Populate the resolver before sharing it; once populated, @c #resolve may
+ * be called concurrently from any number of threads.
+ */
+
+/**
+ * @internal
+ *
+ * @brief Using the pimpl idiom here keeps the catalog's implementation out
+ *        of the header.
+ */
+struct xml::entity_resolver::impl {
+    //
+    // std::map never moves its elements; so pointers to the content
+    // strings remain valid for the lifetime of the resolver.
+    //
+    std::map<std::string, std::string> public_ids;
+    std::map<std::string, std::string> system_ids;
+    std::vector<std::string> directories;
+
+    mutable std::mutex file_cache_mutex;
+    mutable std::map<std::string, std::unique_ptr<const std::string>>
+        file_cache;
+};
+
+/**
+ * @brief Construct an empty resolver.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+xml::entity_resolver::entity_resolver():
+    impl_{new impl}
+{}
+
+/**
+ * @fn xml::entity_resolver::entity_resolver(const entity_resolver &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Destroy.
+ */
+xml::entity_resolver::~entity_resolver() throw ()
+{}
+
+/**
+ * @fn xml::entity_resolver & xml::entity_resolver::operator=(const entity_resolver &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Map a public identifier to the content of a DTD or entity.
+ *
+ * @param[in] public_id a public identifier.
+ * @param[in] content   the content to use for @p public_id.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::entity_resolver::map_public_id(const std::string & public_id,
+                                         const std::string & content)
+{
+    this->impl_->public_ids[public_id] = content;
+}
+
+/**
+ * @brief Map a system identifier to the content of a DTD or entity.
+ *
+ * @p system_id is matched against the system identifier as resolved by the
+ * parser; for documents read from a file, relative identifiers are
+ * resolved against the document's location.
+ *
+ * @param[in] system_id a system identifier.
+ * @param[in] content   the content to use for @p system_id.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::entity_resolver::map_system_id(const std::string & system_id,
+                                         const std::string & content)
+{
+    this->impl_->system_ids[system_id] = content;
+}
+
+/**
+ * @brief Add a directory in which to look up system identifiers by file
+ *        name.
+ *
+ * @param[in] path  a directory.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::entity_resolver::add_directory(const std::string & path)
+{
+    this->impl_->directories.push_back(path);
+}
+
+/**
+ * @brief Resolve an external identifier.
+ *
+ * @param[in] public_id the public identifier, or @c nullptr.
+ * @param[in] system_id the system identifier, or @c nullptr.
+ *
+ * @return the cached content, or @c nullptr if the identifier cannot be
+ *         resolved.  The content remains valid for the lifetime of the
+ *         resolver.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+const std::string *
+xml::entity_resolver::resolve(const char * const public_id,
+                              const char * const system_id) const
+{
+    if (public_id) {
+        const auto pos = this->impl_->public_ids.find(public_id);
+        if (pos != this->impl_->public_ids.end()) { return &pos->second; }
+    }
+
+    if (!system_id) { return nullptr; }
+
+    const auto pos = this->impl_->system_ids.find(system_id);
+    if (pos != this->impl_->system_ids.end()) { return &pos->second; }
+
+    if (this->impl_->directories.empty()) { return nullptr; }
+
+    const std::string id{system_id};
+    const std::string::size_type slash = id.find_last_of("/\\");
+    const std::string name = (slash == std::string::npos)
+                           ? id
+                           : id.substr(slash + 1);
+    if (name.empty()) { return nullptr; }
+
+    std::lock_guard<std::mutex> lock{this->impl_->file_cache_mutex};
+    auto cached = this->impl_->file_cache.find(name);
+    if (cached == this->impl_->file_cache.end()) {
+        std::unique_ptr<const std::string> content;
+        for (const std::string & dir: this->impl_->directories) {
+            std::ifstream file{dir + '/' + name, std::ios::binary};
+            if (!file) { continue; }
+            std::ostringstream buf;
+            buf << file.rdbuf();
+            content.reset(new std::string{buf.str()});
+            break;
+        }
+        //
+        // Misses are cached too, so that a missing file is only looked for
+        // once.
+        //
+        cached = this->impl_->file_cache.emplace(name,
+                                                 std::move(content)).first;
+    }
+    return cached->second.get();
+}
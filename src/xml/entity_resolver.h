@@ -0,0 +1,57 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_ENTITY_RESOLVER_H
+#   define XML_ENTITY_RESOLVER_H
+
+#   include <memory>
+#   include <string>
+
+namespace xml
+{
+    class entity_resolver {
+        struct impl;
+        std::unique_ptr<impl> impl_;
+
+    public:
+        entity_resolver();
+        entity_resolver(const entity_resolver &) = delete;
+        ~entity_resolver() throw ();
+
+        entity_resolver & operator=(const entity_resolver &) = delete;
+
+        void map_public_id(const std::string & public_id,
+                           const std::string & content);
+        void map_system_id(const std::string & system_id,
+                           const std::string & content);
+        void add_directory(const std::string & path);
+
+        const std::string * resolve(const char * public_id,
+                                    const char * system_id) const;
+    };
+}
+
+# endif // XML_ENTITY_RESOLVER_H
@@ -0,0 +1,246 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "event_pipeline.h"
+
+namespace {
+
+    //
+    // Blocks are handed over once they reach this size; large enough that
+    // the handover is cheap relative to parsing, and small enough that the
+    // consumer starts soon.
+    //
+    const std::size_t block_size = 32 * 1024;
+
+    //
+    // The number of times to check for the other thread before blocking.
+    //
+    const int spin_count = 64;
+}
+
+const std::size_t xml::detail::event_pipeline::capacity;
+
+//
+// Start reading source on a new thread.  cancel is the flag with which
+// source was opened, if any.
+//
+xml::detail::event_pipeline::event_pipeline(
+    reader && source,
+    std::shared_ptr<const std::atomic<bool>> cancel):
+    source_{std::move(source)},
+    cancel_{std::move(cancel)},
+    head_{0},
+    tail_{0},
+    stop_{false},
+    consumer_waiting_{false},
+    producer_waiting_{false},
+    done_{false},
+    byte_offset_{0}
+{
+    this->thread_ = std::thread{[this] { this->produce(); }};
+}
+
+//
+// Stop the producing thread, waiting for it to finish any read of the input
+// in progress.
+//
+xml::detail::event_pipeline::~event_pipeline() throw ()
+{
+    this->stop_.store(true);
+    {
+        std::lock_guard<std::mutex> lock{this->mutex_};
+        this->ready_.notify_all();
+    }
+    this->thread_.join();
+}
+
+//
+// A replay positioned before the first node; it has no nodes of its own.
+//
+std::unique_ptr<xml::detail::event_replay>
+xml::detail::event_pipeline::start()
+{
+    event_writer writer;
+    writer.finish();
+    return this->replay(std::move(writer.data()));
+}
+
+//
+// Get the next block, waiting for it if necessary.  Returns nullptr after
+// the last block; if reading failed, the exception is thrown in place of
+// the block that would have followed.
+//
+std::unique_ptr<xml::detail::event_replay>
+xml::detail::event_pipeline::next()
+{
+    if (this->error_) {
+        const std::exception_ptr error = this->error_;
+        this->error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+    if (this->done_) { return nullptr; }
+
+    const std::size_t head = this->head_.load(std::memory_order_relaxed);
+    this->wait(this->consumer_waiting_, [this, head] {
+        return this->tail_.load() != head;
+    });
+    block & b = this->ring_[head % capacity];
+    std::string data = std::move(b.data);
+    std::vector<std::size_t> columns = std::move(b.columns);
+    this->error_ = b.error;
+    this->done_ = b.last;
+    this->byte_offset_ = b.byte_offset;
+    this->stats_ = b.stats;
+    b.error = nullptr;
+    this->head_.store(head + 1);
+    this->notify(this->producer_waiting_);
+    std::unique_ptr<event_replay> result = this->replay(std::move(data));
+    result->columns = std::move(columns);
+    return result;
+}
+
+void xml::detail::event_pipeline::produce() throw ()
+{
+    block b;
+    try {
+        event_writer writer;
+        try {
+            while (!this->stop_.load(std::memory_order_relaxed)
+                   && this->source_.read()) {
+                writer.node(this->source_);
+                b.columns.push_back(this->source_.col());
+                if (writer.data().size() >= block_size) {
+                    writer.finish();
+                    b.data.swap(writer.data());
+                    writer.clear();
+                    b.byte_offset = this->source_.byte_offset();
+                    b.stats = this->source_.stats();
+                    if (!this->push(b)) { return; }
+                }
+            }
+        } catch (...) {
+            b.error = std::current_exception();
+        }
+        writer.finish();
+        b.data.swap(writer.data());
+        b.byte_offset = this->source_.byte_offset();
+        b.stats = this->source_.stats();
+    } catch (...) {
+        //
+        // Encoding the nodes failed; that is, memory ran out.
+        //
+        b.data.clear();
+        b.columns.clear();
+        b.error = std::current_exception();
+    }
+    b.last = true;
+    this->push(b);
+}
+
+//
+// Hand a block to the consumer, waiting while the ring is full.  Returns
+// false if the pipeline is stopped first.
+//
+bool xml::detail::event_pipeline::push(block & b)
+{
+    const std::size_t tail = this->tail_.load(std::memory_order_relaxed);
+    this->wait(this->producer_waiting_, [this, tail] {
+        return tail - this->head_.load() < capacity || this->stop_.load();
+    });
+    if (this->stop_.load()) { return false; }
+    block & slot = this->ring_[tail % capacity];
+    slot.data.swap(b.data);
+    slot.columns.swap(b.columns);
+    slot.byte_offset = b.byte_offset;
+    slot.stats = b.stats;
+    slot.error = b.error;
+    slot.last = b.last;
+    b.data.clear();
+    b.columns.clear();
+    b.error = nullptr;
+    this->tail_.store(tail + 1);
+    this->notify(this->consumer_waiting_);
+    return true;
+}
+
+//
+// Wait until ready() is true: briefly by polling, and then by blocking
+// until notified.
+//
+// Setting the waiting flag, and then checking ready(), pairs with the other
+// thread's updating the ring, and then checking the flag; both are
+// sequentially consistent, so at least one thread sees the other's
+// change.  The mutex is held from the check until the wait begins; so a
+// notification cannot be missed.
+//
+template <typename Ready>
+void xml::detail::event_pipeline::wait(std::atomic<bool> & waiting,
+                                       Ready ready)
+{
+    for (int i = 0; i < spin_count; ++i) {
+        if (ready()) { return; }
+        std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock{this->mutex_};
+    waiting.store(true);
+    this->ready_.wait(lock, ready);
+    waiting.store(false);
+}
+
+void xml::detail::event_pipeline::notify(std::atomic<bool> & waiting)
+{
+    if (!waiting.load()) { return; }
+    std::lock_guard<std::mutex> lock{this->mutex_};
+    this->ready_.notify_all();
+}
+
+//
+// Namespace identifiers are assigned on the consuming thread, so that they
+// stay consistent from one block to the next.
+//
+std::size_t
+xml::detail::event_pipeline::intern_namespace(const string_ref & uri)
+{
+    if (uri.empty()) { return 0; }
+    const std::string key = uri.str();
+    const auto pos = this->namespace_ids_.find(key);
+    if (pos != this->namespace_ids_.end()) { return pos->second; }
+    this->namespace_uris_.push_back(key);
+    const std::size_t id = this->namespace_uris_.size();
+    this->namespace_ids_.emplace(key, id);
+    return id;
+}
+
+std::unique_ptr<xml::detail::event_replay>
+xml::detail::event_pipeline::replay(std::string && data)
+{
+    return std::unique_ptr<event_replay>{
+        new event_replay{
+            event_replay::recording(std::move(data)),
+            [this](const string_ref & uri) {
+                return this->intern_namespace(uri);
+            }}};
+}
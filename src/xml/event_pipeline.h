@@ -0,0 +1,127 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_EVENT_PIPELINE_H
+#   define XML_EVENT_PIPELINE_H
+
+#   include "event_replay.h"
+#   include <array>
+#   include <atomic>
+#   include <condition_variable>
+#   include <exception>
+#   include <memory>
+#   include <mutex>
+#   include <string>
+#   include <thread>
+#   include <unordered_map>
+#   include <vector>
+
+namespace xml
+{
+    namespace detail {
+
+        //
+        // Reads a reader on a thread of its own, passing its nodes to the
+        // consuming thread in blocks.  Each block is a self-contained
+        // recording in the event_recording format; the blocks pass through
+        // a single-producer, single-consumer ring.  With each block come
+        // its nodes' column numbers, and the reader's offset and statistics
+        // as of its last node.  The consumer checks the cancellation flag
+        // itself, so that it does not go on through the blocks already
+        // produced.
+        //
+        class event_pipeline {
+            struct block {
+                std::string data;
+                std::vector<std::size_t> columns;
+                std::uint64_t byte_offset = 0;
+                reader_stats stats;
+                std::exception_ptr error;
+                bool last = false;
+            };
+
+            static const std::size_t capacity = 8;
+
+            reader source_;
+            std::shared_ptr<const std::atomic<bool>> cancel_;
+            std::array<block, capacity> ring_;
+            std::atomic<std::size_t> head_;
+            std::atomic<std::size_t> tail_;
+            std::atomic<bool> stop_;
+            std::atomic<bool> consumer_waiting_;
+            std::atomic<bool> producer_waiting_;
+            std::mutex mutex_;
+            std::condition_variable ready_;
+
+            std::exception_ptr error_;
+            bool done_;
+            std::uint64_t byte_offset_;
+            reader_stats stats_;
+            std::vector<std::string> namespace_uris_;
+            std::unordered_map<std::string, std::size_t> namespace_ids_;
+
+            std::thread thread_;
+
+        public:
+            event_pipeline(reader && source,
+                           std::shared_ptr<const std::atomic<bool>> cancel);
+            event_pipeline(const event_pipeline &) = delete;
+            ~event_pipeline() throw ();
+
+            event_pipeline & operator=(const event_pipeline &) = delete;
+
+            std::unique_ptr<event_replay> start();
+            std::unique_ptr<event_replay> next();
+
+            bool cancelled() const throw ()
+            {
+                return this->cancel_
+                    && this->cancel_->load(std::memory_order_relaxed);
+            }
+
+            std::uint64_t byte_offset() const throw ()
+            {
+                return this->byte_offset_;
+            }
+
+            const reader_stats & stats() const throw ()
+            {
+                return this->stats_;
+            }
+
+        private:
+            void produce() throw ();
+            bool push(block & b);
+            template <typename Ready>
+            void wait(std::atomic<bool> & waiting, Ready ready);
+            void notify(std::atomic<bool> & waiting);
+            std::size_t intern_namespace(const string_ref & uri);
+            std::unique_ptr<event_replay> replay(std::string && data);
+        };
+    }
+}
+
+# endif // XML_EVENT_PIPELINE_H
@@ -0,0 +1,430 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+# include "event_recording.h"
+# include "event_replay.h"
+# include <cstring>
+# include <istream>
+# include <ostream>
+# include <stdexcept>
+# include <string>
+
+/**
+ * @file xml/event_recording.h
+ *
+ * @brief Recording and replay of a reader's events.
+ */
+
+/**
+ * @class xml::event_recording
+ *
+ * @brief A recording of a reader's events, loaded for replay.
+ *
+ * @c xml::record_events writes the events of an @c xml::reader in a
+ * compact binary form.  Loaded, the recording can be replayed by any number
+ * of readers constructed with
+ * @c xml::reader::reader(const event_recording &), without parsing the
+ * document again.
+ *
+ * A recording is immutable, and copies share the loaded data; replays may
+ * run concurrently.
+ *
+ * @par Format
+ * After the 8-byte magic number @c XMLRWEV1, each node is recorded as a
+ * type byte (with 0x20 set for an empty element), then varints for the
+ * depth, the zigzag-encoded change in line number, and the name.  A name is
+ * given by its index in the table of names recorded so far, counting from
+ * 1; 0 introduces a new name, followed by the lengths and bytes of the
+ * qualified name and the namespace URI.  An element's name is followed by
+ * the number of attributes and, for each, its name and value; any other
+ * node's name is followed by its value.  Values are recorded as a varint
+ * length and raw bytes.  A zero type byte ends the recording.
+ */
+
+/**
+ * @internal
+ *
+ * @brief The recording's bytes.
+ */
+struct xml::event_recording::impl {
+    std::string data;
+};
+
+namespace {
+
+    const char magic[] = "XMLRWEV1";
+    const std::size_t magic_size = sizeof magic - 1;
+    const unsigned char empty_flag = 0x20;
+    const unsigned char type_mask = 0x1f;
+
+    [[noreturn]] void corrupt()
+    {
+        throw std::runtime_error{"corrupt event recording"};
+    }
+
+    void write(std::ostream & out, std::string & buf)
+    {
+        out.write(buf.data(), buf.size());
+        if (!out) {
+            throw std::runtime_error{"failed to write event recording"};
+        }
+        buf.clear();
+    }
+}
+
+xml::detail::event_writer::event_writer():
+    line_{0}
+{
+    this->buf_.append(magic, magic_size);
+}
+
+//
+// Record the current node.  The reader is left on the node, not on one of
+// its attributes.
+//
+void xml::detail::event_writer::node(reader & in)
+{
+    const reader::node_type_id type = in.node_type();
+    const bool element = type == reader::element_id;
+    const bool empty = element && in.empty_element();
+    this->buf_ += char(type | (empty ? empty_flag : 0));
+    this->varint(in.depth());
+    const std::size_t line = in.line();
+    const std::int64_t delta = std::int64_t(line - this->line_);
+    this->varint((std::uint64_t(delta) << 1)
+                 ^ std::uint64_t(delta >> 63));
+    this->line_ = line;
+    this->name(in);
+
+    switch (type) {
+    case reader::element_id:
+    {
+        std::uint64_t count = 0;
+        const std::size_t count_pos = this->buf_.size();
+        this->buf_ += '\0';
+        for (bool more = in.move_to_first_attribute();
+             more;
+             more = in.move_to_next_attribute()) {
+            this->name(in);
+            this->bytes(in.value_ref());
+            ++count;
+        }
+        //
+        // Patch in the attribute count; rarely, it takes more than
+        // the one byte reserved.
+        //
+        if (count < 0x80) {
+            this->buf_[count_pos] = char(count);
+        } else {
+            std::string tail = this->buf_.substr(count_pos + 1);
+            this->buf_.resize(count_pos);
+            this->varint(count);
+            this->buf_ += tail;
+        }
+        in.move_to_element();
+        break;
+    }
+    case reader::end_element_id:
+        break;
+    case reader::text_id:
+    case reader::cdata_id:
+    case reader::processing_instruction_id:
+    case reader::comment_id:
+    case reader::whitespace_id:
+    case reader::significant_whitespace_id:
+        this->bytes(in.value_ref());
+        break;
+    default:
+        this->bytes(string_ref{});
+        break;
+    }
+}
+
+void xml::detail::event_writer::finish()
+{
+    this->buf_ += '\0';
+}
+
+//
+// Start a new recording.
+//
+void xml::detail::event_writer::clear()
+{
+    this->buf_.assign(magic, magic_size);
+    this->names_.clear();
+    this->line_ = 0;
+}
+
+void xml::detail::event_writer::varint(std::uint64_t value)
+{
+    do {
+        const unsigned char byte = value & 0x7f;
+        value >>= 7;
+        this->buf_ += char(value ? byte | 0x80 : byte);
+    } while (value);
+}
+
+void xml::detail::event_writer::bytes(const string_ref & str)
+{
+    this->varint(str.size());
+    this->buf_.append(str.data(), str.size());
+}
+
+void xml::detail::event_writer::name(reader & in)
+{
+    const string_ref qname = in.qualified_name_ref();
+    const string_ref uri = in.namespace_uri();
+    this->key_.assign(qname.data(), qname.size());
+    this->key_ += '\0';
+    this->key_.append(uri.data(), uri.size());
+    const auto pos = this->names_.find(this->key_);
+    if (pos != this->names_.end()) {
+        this->varint(pos->second);
+        return;
+    }
+    const std::uint64_t id = this->names_.size() + 1;
+    this->names_.emplace(this->key_, id);
+    this->varint(0);
+    this->bytes(qname);
+    this->bytes(uri);
+}
+
+/**
+ * @brief Record the events of a reader.
+ *
+ * Reads @p in to the end of the document, writing a recording of each
+ * node, with its attributes, to @p out.
+ *
+ * @param[in,out] in    a reader; typically, newly constructed.
+ * @param[in,out] out   an output stream.
+ *
+ * @exception xml::parse_error      if @p in encounters a parse error.
+ * @exception std::runtime_error    if writing to @p out fails.
+ * @exception std::bad_alloc        if memory allocation fails.
+ *
+ * @sa xml::event_recording
+ */
+void xml::record_events(reader & in, std::ostream & out)
+{
+    detail::event_writer writer;
+    while (in.read()) {
+        writer.node(in);
+        if (writer.data().size() >= 64 * 1024) { write(out, writer.data()); }
+    }
+    writer.finish();
+    write(out, writer.data());
+}
+
+/**
+ * @internal
+ *
+ * @brief Construct an empty recording.
+ */
+xml::event_recording::event_recording()
+{}
+
+/**
+ * @brief Load a recording.
+ *
+ * @param[in,out] in    an input stream positioned at the start of a
+ *                      recording written by @c xml::record_events.
+ *
+ * @return the recording.
+ *
+ * @exception std::runtime_error    if @p in does not hold a recording.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::event_recording xml::event_recording::load(std::istream & in)
+{
+    std::shared_ptr<impl> loaded{new impl};
+    char buf[64 * 1024];
+    while (in.read(buf, sizeof buf) || in.gcount() > 0) {
+        loaded->data.append(buf, std::size_t(in.gcount()));
+    }
+    if (in.bad()) {
+        throw std::runtime_error{"failed to read event recording"};
+    }
+    if (loaded->data.size() < magic_size + 1
+        || loaded->data.compare(0, magic_size, magic) != 0) {
+        throw std::runtime_error{"not an event recording"};
+    }
+    event_recording result;
+    result.impl_ = loaded;
+    return result;
+}
+
+/**
+ * @brief The size of the recording.
+ *
+ * @return the size of the recording, in bytes.
+ */
+std::size_t xml::event_recording::size() const throw ()
+{
+    return this->impl_->data.size();
+}
+
+xml::event_recording
+xml::detail::event_replay::recording(std::string && data)
+{
+    std::shared_ptr<event_recording::impl> recorded{
+        new event_recording::impl};
+    recorded->data = std::move(data);
+    event_recording result;
+    result.impl_ = recorded;
+    return result;
+}
+
+xml::detail::event_replay::event_replay(const event_recording & recording,
+                                        const namespace_interner & intern):
+    recording_(recording),
+    intern_(intern),
+    pos_{recording.impl_->data.data() + magic_size},
+    end_{recording.impl_->data.data() + recording.impl_->data.size()},
+    type_{reader::none_id},
+    empty_{false},
+    depth_{0},
+    line_{0},
+    node_{0},
+    name_{nullptr},
+    attribute_{0},
+    rewound{false}
+{}
+
+bool xml::detail::event_replay::read()
+{
+    this->attribute_ = 0;
+    this->attributes_.clear();
+    if (this->pos_ == this->end_) { corrupt(); }
+
+    const unsigned char type_byte = *this->pos_++;
+    if (type_byte == 0) {
+        //
+        // Stay at the end, so that reading again also returns false.
+        //
+        --this->pos_;
+        this->node_ = 0;
+        this->type_ = reader::none_id;
+        this->name_ = nullptr;
+        this->value_ = string_ref{};
+        return false;
+    }
+    ++this->node_;
+    this->type_ = static_cast<reader::node_type_id>(type_byte & type_mask);
+    this->empty_ = (type_byte & empty_flag) != 0;
+    this->depth_ = std::size_t(this->read_varint());
+    const std::uint64_t delta = this->read_varint();
+    this->line_ += std::size_t(std::int64_t(delta >> 1)
+                               ^ -std::int64_t(delta & 1));
+    this->name_ = this->read_name();
+
+    if (this->type_ == reader::element_id) {
+        this->value_ = string_ref{};
+        const std::uint64_t count = this->read_varint();
+        for (std::uint64_t i = 0; i < count; ++i) {
+            const name * const attr_name = this->read_name();
+            this->attributes_.push_back(attribute{attr_name,
+                                                  this->read_bytes()});
+        }
+    } else if (this->type_ != reader::end_element_id) {
+        this->value_ = this->read_bytes();
+    } else {
+        this->value_ = string_ref{};
+    }
+    return true;
+}
+
+bool xml::detail::event_replay::move_to_first_attribute() throw ()
+{
+    if (this->attributes_.empty()) { return false; }
+    this->attribute_ = 1;
+    return true;
+}
+
+bool xml::detail::event_replay::move_to_next_attribute() throw ()
+{
+    if (this->attribute_ == 0
+        || this->attribute_ == this->attributes_.size()) {
+        return false;
+    }
+    ++this->attribute_;
+    return true;
+}
+
+std::size_t
+xml::detail::event_replay::intern_namespace(const string_ref & uri)
+{
+    if (this->intern_) { return this->intern_(uri); }
+    if (uri.empty()) { return 0; }
+    const std::string key = uri.str();
+    const auto pos = this->namespace_ids_.find(key);
+    if (pos != this->namespace_ids_.end()) { return pos->second; }
+    this->namespace_uris_.push_back(key);
+    const std::size_t id = this->namespace_uris_.size();
+    this->namespace_ids_.emplace(key, id);
+    return id;
+}
+
+std::uint64_t xml::detail::event_replay::read_varint()
+{
+    std::uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64 && this->pos_ != this->end_;
+         shift += 7) {
+        const unsigned char c = *this->pos_++;
+        value |= std::uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) { return value; }
+    }
+    corrupt();
+}
+
+xml::string_ref xml::detail::event_replay::read_bytes()
+{
+    const std::uint64_t size = this->read_varint();
+    if (size > std::uint64_t(this->end_ - this->pos_)) { corrupt(); }
+    const string_ref result{this->pos_, std::size_t(size)};
+    this->pos_ += size;
+    return result;
+}
+
+const xml::detail::event_replay::name *
+xml::detail::event_replay::read_name()
+{
+    const std::uint64_t id = this->read_varint();
+    if (id != 0) {
+        if (id > this->names_.size()) { corrupt(); }
+        return &this->names_[std::size_t(id - 1)];
+    }
+    name n;
+    n.qualified = this->read_bytes();
+    n.uri = this->read_bytes();
+    const char * const colon = static_cast<const char *>(
+        std::memchr(n.qualified.data(), ':', n.qualified.size()));
+    n.local = colon
+            ? string_ref{colon + 1,
+                         std::size_t(n.qualified.end() - colon - 1)}
+            : n.qualified;
+    n.namespace_id = this->intern_namespace(n.uri);
+    this->names_.push_back(n);
+    return &this->names_.back();
+}
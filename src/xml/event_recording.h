@@ -0,0 +1,58 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+# ifndef XML_EVENT_RECORDING_H
+#   define XML_EVENT_RECORDING_H
+
+#   include <cstddef>
+#   include <iosfwd>
+#   include <memory>
+
+namespace xml
+{
+    class reader;
+
+    namespace detail {
+        class event_replay;
+    }
+
+    void record_events(reader & in, std::ostream & out);
+
+    class event_recording {
+        friend class detail::event_replay;
+
+        struct impl;
+        std::shared_ptr<const impl> impl_;
+
+        event_recording();
+
+    public:
+        static event_recording load(std::istream & in);
+
+        std::size_t size() const throw ();
+    };
+}
+
+# endif // XML_EVENT_RECORDING_H
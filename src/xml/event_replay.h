@@ -0,0 +1,192 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+# ifndef XML_EVENT_REPLAY_H
+#   define XML_EVENT_REPLAY_H
+
+#   include "event_recording.h"
+#   include "reader.h"
+#   include <deque>
+#   include <functional>
+#   include <string>
+#   include <unordered_map>
+#   include <vector>
+
+namespace xml
+{
+    namespace detail {
+
+        //
+        // Encodes a reader's nodes in the event_recording format.
+        //
+        class event_writer {
+            std::string buf_;
+            std::unordered_map<std::string, std::uint64_t> names_;
+            std::string key_;
+            std::size_t line_;
+
+        public:
+            event_writer();
+            event_writer(const event_writer &) = delete;
+            event_writer & operator=(const event_writer &) = delete;
+
+            void node(reader & in);
+            void finish();
+            std::string & data() throw () { return this->buf_; }
+            void clear();
+
+        private:
+            void varint(std::uint64_t value);
+            void bytes(const string_ref & str);
+            void name(reader & in);
+        };
+
+        //
+        // The nodes read since xml::reader::mark.
+        //
+        struct reader_mark {
+            event_writer events;
+            std::size_t lookahead;
+            bool on_node;
+            bool exceeded;
+        };
+
+        //
+        // A cursor over an event_recording, behind xml::reader.
+        //
+        class event_replay {
+        public:
+            typedef std::function<std::size_t (const string_ref &)>
+                namespace_interner;
+
+            struct name {
+                string_ref qualified;
+                string_ref local;
+                string_ref uri;
+                std::size_t namespace_id;
+            };
+
+        private:
+            struct attribute {
+                const name * attr_name;
+                string_ref value;
+            };
+
+            event_recording recording_;
+            namespace_interner intern_;
+            const char * pos_;
+            const char * end_;
+            std::deque<name> names_;
+            std::vector<std::string> namespace_uris_;
+            std::unordered_map<std::string, std::size_t> namespace_ids_;
+
+            reader::node_type_id type_;
+            bool empty_;
+            std::size_t depth_;
+            std::size_t line_;
+            std::size_t node_;
+            const name * name_;
+            string_ref value_;
+            std::vector<attribute> attributes_;
+            std::size_t attribute_;
+
+        public:
+            //
+            // A replay started by xml::reader::rewind continues with the
+            // source it was recorded from.
+            //
+            std::unique_ptr<event_replay> underlying;
+            bool rewound;
+
+            //
+            // The column number of each node, if known; a recording does
+            // not include them.
+            //
+            std::vector<std::size_t> columns;
+
+            static event_recording recording(std::string && data);
+
+            explicit event_replay(const event_recording & recording,
+                                  const namespace_interner & intern =
+                                      namespace_interner());
+            event_replay(const event_replay &) = delete;
+            event_replay & operator=(const event_replay &) = delete;
+
+            bool read();
+
+            std::size_t line() const throw () { return this->line_; }
+
+            std::size_t col() const throw ()
+            {
+                return (this->node_ != 0
+                        && this->node_ <= this->columns.size())
+                    ? this->columns[this->node_ - 1]
+                    : 0;
+            }
+
+            reader::node_type_id node_type() const throw ()
+            {
+                return (this->attribute_ == 0) ? this->type_
+                                               : reader::attribute_id;
+            }
+
+            std::size_t depth() const throw ()
+            {
+                return this->depth_ + (this->attribute_ == 0 ? 0 : 1);
+            }
+
+            bool empty_element() const throw ()
+            {
+                return this->attribute_ == 0 && this->empty_;
+            }
+
+            const name & node_name() const throw ()
+            {
+                return (this->attribute_ == 0)
+                    ? *this->name_
+                    : *this->attributes_[this->attribute_ - 1].attr_name;
+            }
+
+            string_ref value() const throw ()
+            {
+                return (this->attribute_ == 0)
+                    ? this->value_
+                    : this->attributes_[this->attribute_ - 1].value;
+            }
+
+            void move_to_element() throw () { this->attribute_ = 0; }
+            bool move_to_first_attribute() throw ();
+            bool move_to_next_attribute() throw ();
+            std::size_t intern_namespace(const string_ref & uri);
+
+        private:
+            std::uint64_t read_varint();
+            string_ref read_bytes();
+            const name * read_name();
+        };
+    }
+}
+
+# endif // XML_EVENT_REPLAY_H
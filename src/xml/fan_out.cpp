@@ -0,0 +1,677 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "fan_out.h"
+# include "markup_scanner.h"
+# include <algorithm>
+# include <atomic>
+# include <cctype>
+# include <condition_variable>
+# include <cstdlib>
+# include <cstring>
+# include <deque>
+# include <exception>
+# include <istream>
+# include <mutex>
+# include <thread>
+
+/**
+ * @file xml/fan_out.h
+ *
+ * @brief Splitting a document into records for processing on a pool of
+ *        threads.
+ */
+
+/**
+ * @class xml::record_buffer
+ *
+ * @brief One record cut from a document by @c xml::fan_out_records.
+ *
+ * A record is an element, copied verbatim from the input, together with
+ * what is needed to read it on its own: the namespace declarations in
+ * scope at its start, and its position in the input.
+ */
+
+/**
+ * @var std::size_t xml::record_buffer::index
+ *
+ * @brief The position of the record among the records of the document,
+ *        counting from 0.
+ */
+
+/**
+ * @var std::uint64_t xml::record_buffer::offset
+ *
+ * @brief The byte offset of the record in the input.
+ */
+
+/**
+ * @var std::size_t xml::record_buffer::line
+ *
+ * @brief The line of the start of the record in the input.
+ */
+
+/**
+ * @var std::size_t xml::record_buffer::column
+ *
+ * @brief The column of the start of the record in the input.
+ */
+
+/**
+ * @var std::string xml::record_buffer::data
+ *
+ * @brief The text of the record, from the start of its start tag to the end
+ *        of its end tag.
+ */
+
+/**
+ * @var std::vector<xml::namespace_binding> xml::record_buffer::namespaces
+ *
+ * @brief The namespace declarations of the record's ancestors that are in
+ *        scope at its start.
+ */
+
+/**
+ * @brief Options for reading the record.
+ *
+ * @code
+ * xml::reader r{record.data.data(), record.data.size(), record.options()};
+ * @endcode
+ *
+ * The record is read as a fragment, with its inherited namespace
+ * declarations, and with line numbers and offsets as in the whole input.
+ *
+ * @param[in] base  other reader options.
+ *
+ * @return @p base, with the options that describe the record set.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+const xml::reader_options
+xml::record_buffer::options(const reader_options & base) const
+{
+    reader_options result = base;
+    result.fragment = true;
+    result.namespaces = this->namespaces;
+    result.input_offset = this->offset;
+    result.input_line = this->line;
+    result.input_column = this->column;
+    result.input_length = 0;
+    result.open_elements.clear();
+    result.multiple_documents = false;
+    result.pipelined = false;
+    return result;
+}
+
+/**
+ * @class xml::fan_out_options
+ *
+ * @brief Options for @c xml::fan_out_records.
+ */
+
+/**
+ * @var std::size_t xml::fan_out_options::threads
+ *
+ * @brief The number of workers; 0 for one per hardware thread.
+ */
+
+/**
+ * @var std::size_t xml::fan_out_options::record_depth
+ *
+ * @brief The depth of the elements that are records.
+ *
+ * The default, 1, makes each child of the document element a record.
+ */
+
+/**
+ * @var std::size_t xml::fan_out_options::queue_capacity
+ *
+ * @brief The number of records that may wait for a worker.
+ *
+ * Once this many are waiting, reading the input pauses until a worker
+ * takes one.
+ */
+
+/**
+ * @var std::function<void (std::size_t)> xml::fan_out_options::worker_started
+ *
+ * @brief Called on each worker's thread before it handles any record.
+ */
+
+/**
+ * @var std::function<void (std::size_t)> xml::fan_out_options::worker_finished
+ *
+ * @brief Called for each worker, in order, on the calling thread once all
+ *        the records have been handled.
+ */
+
+namespace {
+
+    //
+    // A bounded queue of records, shared by the reading thread and the
+    // workers.
+    //
+    class record_queue {
+        std::mutex mutex_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+        std::deque<xml::record_buffer> records_;
+        const std::size_t capacity_;
+        bool closed_;
+        bool stopped_;
+
+    public:
+        explicit record_queue(std::size_t capacity);
+        record_queue(const record_queue &) = delete;
+        record_queue & operator=(const record_queue &) = delete;
+
+        bool push(xml::record_buffer && record);
+        bool pop(xml::record_buffer & record);
+        void close();
+        void stop();
+    };
+
+    record_queue::record_queue(const std::size_t capacity):
+        capacity_{(std::max)(capacity, std::size_t(1))},
+        closed_{false},
+        stopped_{false}
+    {}
+
+    //
+    // Returns false if the queue has been stopped.
+    //
+    bool record_queue::push(xml::record_buffer && record)
+    {
+        std::unique_lock<std::mutex> lock{this->mutex_};
+        this->not_full_.wait(lock, [this] {
+            return this->stopped_ || this->records_.size() < this->capacity_;
+        });
+        if (this->stopped_) { return false; }
+        this->records_.push_back(std::move(record));
+        lock.unlock();
+        this->not_empty_.notify_one();
+        return true;
+    }
+
+    //
+    // Returns false once the queue is closed and empty, or stopped.
+    //
+    bool record_queue::pop(xml::record_buffer & record)
+    {
+        std::unique_lock<std::mutex> lock{this->mutex_};
+        this->not_empty_.wait(lock, [this] {
+            return this->stopped_ || this->closed_
+                || !this->records_.empty();
+        });
+        if (this->stopped_ || this->records_.empty()) { return false; }
+        record = std::move(this->records_.front());
+        this->records_.pop_front();
+        lock.unlock();
+        this->not_full_.notify_one();
+        return true;
+    }
+
+    //
+    // No more records will be pushed.
+    //
+    void record_queue::close()
+    {
+        {
+            std::lock_guard<std::mutex> lock{this->mutex_};
+            this->closed_ = true;
+        }
+        this->not_empty_.notify_all();
+    }
+
+    //
+    // Abandon the records waiting, and release any waiting thread.
+    //
+    void record_queue::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock{this->mutex_};
+            this->stopped_ = true;
+            this->records_.clear();
+        }
+        this->not_empty_.notify_all();
+        this->not_full_.notify_all();
+    }
+
+    bool is_space(const char c) throw ()
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    void append_utf8(std::string & out, unsigned long c)
+    {
+        if (c < 0x80) {
+            out += char(c);
+        } else if (c < 0x800) {
+            out += char(0xc0 | (c >> 6));
+            out += char(0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            out += char(0xe0 | (c >> 12));
+            out += char(0x80 | ((c >> 6) & 0x3f));
+            out += char(0x80 | (c & 0x3f));
+        } else {
+            out += char(0xf0 | (c >> 18));
+            out += char(0x80 | ((c >> 12) & 0x3f));
+            out += char(0x80 | ((c >> 6) & 0x3f));
+            out += char(0x80 | (c & 0x3f));
+        }
+    }
+
+    //
+    // Replace the predefined entity and character references in an
+    // attribute value.
+    //
+    const std::string unescape(const char * begin, const char * const end)
+    {
+        std::string result;
+        while (begin != end) {
+            const char * const amp =
+                static_cast<const char *>(std::memchr(begin, '&',
+                                                      end - begin));
+            if (!amp) { break; }
+            result.append(begin, amp);
+            const char * const semi =
+                static_cast<const char *>(std::memchr(amp, ';', end - amp));
+            if (!semi) { begin = amp; break; }
+            const std::string ref{amp + 1, semi};
+            if (ref == "amp") {
+                result += '&';
+            } else if (ref == "lt") {
+                result += '<';
+            } else if (ref == "gt") {
+                result += '>';
+            } else if (ref == "quot") {
+                result += '"';
+            } else if (ref == "apos") {
+                result += '\'';
+            } else if (ref.size() > 1 && ref[0] == '#') {
+                const bool hex = ref[1] == 'x';
+                append_utf8(result,
+                            std::strtoul(ref.c_str() + (hex ? 2 : 1),
+                                         nullptr,
+                                         hex ? 16 : 10));
+            } else {
+                result.append(amp, semi + 1);
+            }
+            begin = semi + 1;
+        }
+        result.append(begin, end);
+        return result;
+    }
+
+    //
+    // Add the namespace declarations among the attributes of a start tag.
+    //
+    void add_namespaces(const char * p, const char * const end,
+                        std::vector<xml::namespace_binding> & bindings)
+    {
+        ++p;
+        while (p != end && !is_space(*p) && *p != '/' && *p != '>') { ++p; }
+        for (;;) {
+            while (p != end && is_space(*p)) { ++p; }
+            if (p == end || *p == '/' || *p == '>') { return; }
+            const char * const name = p;
+            while (p != end && *p != '=' && !is_space(*p)) { ++p; }
+            const std::string attribute{name, p};
+            while (p != end && is_space(*p)) { ++p; }
+            if (p == end || *p != '=') { return; }
+            ++p;
+            while (p != end && is_space(*p)) { ++p; }
+            if (p == end) { return; }
+            const char quote = *p++;
+            const char * const value = p;
+            while (p != end && *p != quote) { ++p; }
+            if (attribute == "xmlns") {
+                bindings.push_back(
+                    xml::namespace_binding{std::string{},
+                                           unescape(value, p)});
+            } else if (attribute.compare(0, 6, "xmlns:") == 0) {
+                bindings.push_back(
+                    xml::namespace_binding{attribute.substr(6),
+                                           unescape(value, p)});
+            }
+            if (p != end) { ++p; }
+        }
+    }
+
+    //
+    // Cuts records from the input.  Only tags are recognized, with the
+    // markup scanner; the records themselves are parsed by the workers.
+    //
+    class record_cutter {
+        std::istream & in_;
+        const std::size_t record_depth_;
+        xml::detail::markup_scanner scanner_;
+        std::string buffer_;
+        std::uint64_t base_;
+        std::uint64_t base_line_start_;
+        std::size_t depth_;
+        std::vector<xml::namespace_binding> bindings_;
+        std::vector<std::size_t> scopes_;
+        bool in_record_;
+        xml::detail::markup_scanner::tag record_start_;
+        std::size_t count_;
+
+    public:
+        record_cutter(std::istream & in, std::size_t record_depth);
+        record_cutter(const record_cutter &) = delete;
+        record_cutter & operator=(const record_cutter &) = delete;
+
+        template <typename Emit>
+        void run(Emit emit);
+
+    private:
+        const char * at(std::uint64_t offset) const throw ();
+        xml::record_buffer
+        cut(const xml::detail::markup_scanner::tag & start,
+            std::uint64_t end);
+        void discard();
+    };
+
+    record_cutter::record_cutter(std::istream & in,
+                                 const std::size_t record_depth):
+        in_(in),
+        record_depth_{record_depth},
+        base_{0},
+        base_line_start_{0},
+        depth_{0},
+        in_record_{false},
+        record_start_{},
+        count_{0}
+    {}
+
+    //
+    // Emit is called with each record; it returns false to stop.
+    //
+    template <typename Emit>
+    void record_cutter::run(Emit emit)
+    {
+        using xml::detail::markup_scanner;
+        char chunk[64 * 1024];
+        for (;;) {
+            this->in_.read(chunk, sizeof chunk);
+            if (this->in_.bad()) {
+                throw std::runtime_error{"failed to read input"};
+            }
+            const std::size_t count = std::size_t(this->in_.gcount());
+            if (count == 0) { break; }
+            this->buffer_.append(chunk, count);
+            this->scanner_.scan(chunk, count);
+
+            markup_scanner::tag t;
+            while (this->scanner_.pop(t)) {
+                switch (t.kind) {
+                case markup_scanner::tag_kind::start:
+                    if (this->in_record_) {
+                        // Within a record.
+                    } else if (this->depth_ < this->record_depth_) {
+                        this->scopes_.push_back(this->bindings_.size());
+                        add_namespaces(this->at(t.offset),
+                                       this->at(t.end),
+                                       this->bindings_);
+                    } else if (this->depth_ == this->record_depth_) {
+                        this->in_record_ = true;
+                        this->record_start_ = t;
+                    }
+                    ++this->depth_;
+                    break;
+                case markup_scanner::tag_kind::empty:
+                    if (!this->in_record_
+                        && this->depth_ == this->record_depth_
+                        && !emit(this->cut(t, t.end))) {
+                        return;
+                    }
+                    break;
+                case markup_scanner::tag_kind::end:
+                    if (this->depth_ > 0) { --this->depth_; }
+                    if (this->in_record_) {
+                        if (this->depth_ == this->record_depth_) {
+                            this->in_record_ = false;
+                            if (!emit(this->cut(this->record_start_,
+                                                t.end))) {
+                                return;
+                            }
+                        }
+                    } else if (!this->scopes_.empty()) {
+                        this->bindings_.resize(this->scopes_.back());
+                        this->scopes_.pop_back();
+                    }
+                    break;
+                }
+            }
+            this->discard();
+        }
+        if (this->in_record_ || this->depth_ != 0) {
+            throw xml::parse_error{this->scanner_.line(),
+                                   "unexpected end of input"};
+        }
+    }
+
+    const char * record_cutter::at(const std::uint64_t offset) const throw ()
+    {
+        return this->buffer_.data() + (offset - this->base_);
+    }
+
+    xml::record_buffer
+    record_cutter::cut(const xml::detail::markup_scanner::tag & start,
+                       const std::uint64_t end)
+    {
+        xml::record_buffer record;
+        record.index = this->count_++;
+        record.offset = start.offset;
+        record.line = start.line;
+        const std::size_t pos = std::size_t(start.offset - this->base_);
+        const std::string::size_type newline =
+            pos > 0 ? this->buffer_.rfind('\n', pos - 1) : std::string::npos;
+        const std::uint64_t line_start =
+            (newline == std::string::npos) ? this->base_line_start_
+                                           : this->base_ + newline + 1;
+        record.column = std::size_t(start.offset - line_start) + 1;
+        record.data.assign(this->at(start.offset),
+                           std::size_t(end - start.offset));
+
+        //
+        // The innermost declaration of each prefix.
+        //
+        for (auto b = this->bindings_.rbegin(); b != this->bindings_.rend();
+             ++b) {
+            const auto & ns = record.namespaces;
+            const bool shadowed =
+                std::find_if(ns.begin(), ns.end(),
+                             [&b](const xml::namespace_binding & n) {
+                                 return n.prefix == b->prefix;
+                             }) != ns.end();
+            if (!shadowed) { record.namespaces.push_back(*b); }
+        }
+        return record;
+    }
+
+    //
+    // Drop the input that is no longer needed: everything before the open
+    // record, if any, and otherwise before the last '<' (which may begin a
+    // tag that is not yet complete; attribute values cannot contain '<').
+    //
+    void record_cutter::discard()
+    {
+        std::string::size_type keep = this->buffer_.rfind('<');
+        if (keep == std::string::npos) { keep = this->buffer_.size(); }
+        if (this->in_record_) {
+            keep = (std::min)(keep, std::string::size_type(
+                                        this->record_start_.offset
+                                        - this->base_));
+        }
+        if (keep == 0) { return; }
+        const std::string::size_type newline =
+            this->buffer_.rfind('\n', keep - 1);
+        if (newline != std::string::npos) {
+            this->base_line_start_ = this->base_ + newline + 1;
+        }
+        this->buffer_.erase(0, keep);
+        this->base_ += keep;
+    }
+
+    class fan_out {
+        typedef std::function<void (const xml::record_buffer &,
+                                    std::size_t)> handler;
+
+        const handler & handler_;
+        const xml::fan_out_options & options_;
+        const std::size_t workers_;
+        record_queue queue_;
+
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+
+    public:
+        fan_out(const handler & h, const xml::fan_out_options & options);
+        fan_out(const fan_out &) = delete;
+        fan_out & operator=(const fan_out &) = delete;
+
+        void run(std::istream & in);
+
+    private:
+        void work(std::size_t worker) throw ();
+        void fail(std::exception_ptr error) throw ();
+    };
+
+    fan_out::fan_out(const handler & h, const xml::fan_out_options & options):
+        handler_(h),
+        options_(options),
+        workers_{xml::fan_out_worker_count(options)},
+        queue_{options.queue_capacity}
+    {}
+
+    //
+    // The calling thread cuts the records; the workers handle them.
+    //
+    void fan_out::run(std::istream & in)
+    {
+        std::vector<std::thread> threads;
+        try {
+            for (std::size_t w = 0; w < this->workers_; ++w) {
+                threads.emplace_back([this, w] { this->work(w); });
+            }
+            record_cutter cutter{in, this->options_.record_depth};
+            cutter.run([this](xml::record_buffer && record) {
+                return this->queue_.push(std::move(record));
+            });
+        } catch (...) {
+            this->fail(std::current_exception());
+        }
+        this->queue_.close();
+        for (auto & thread : threads) { thread.join(); }
+
+        if (this->error_) { std::rethrow_exception(this->error_); }
+        if (this->options_.worker_finished) {
+            for (std::size_t w = 0; w < this->workers_; ++w) {
+                this->options_.worker_finished(w);
+            }
+        }
+    }
+
+    void fan_out::work(const std::size_t worker) throw ()
+    {
+        try {
+            if (this->options_.worker_started) {
+                this->options_.worker_started(worker);
+            }
+            xml::record_buffer record;
+            while (this->queue_.pop(record)) {
+                this->handler_(record, worker);
+            }
+        } catch (...) {
+            this->fail(std::current_exception());
+        }
+    }
+
+    //
+    // Record the first error, and stop both the reading and the workers.
+    //
+    void fan_out::fail(const std::exception_ptr error) throw ()
+    {
+        {
+            std::lock_guard<std::mutex> lock{this->error_mutex_};
+            if (!this->error_) { this->error_ = error; }
+        }
+        this->queue_.stop();
+    }
+}
+
+/**
+ * @brief The number of workers @c xml::fan_out_records uses.
+ *
+ * @param[in] options   the options for the run.
+ *
+ * @return the number of workers.
+ */
+std::size_t xml::fan_out_worker_count(const fan_out_options & options)
+{
+    std::size_t threads = options.threads;
+    if (threads == 0) { threads = std::thread::hardware_concurrency(); }
+    return (std::max)(threads, std::size_t(1));
+}
+
+/**
+ * @brief Cut a document into records, and handle them on a pool of
+ *        threads.
+ *
+ * The calling thread reads @p in, finding the elements at
+ * @c xml::fan_out_options::record_depth by their tags alone, and copies
+ * each into an @c xml::record_buffer; workers call @p handler with the
+ * records, typically to read them with an @c xml::reader constructed with
+ * @c xml::record_buffer::options.  Only finding the records is serial; so
+ * the work of parsing them and handling their content is spread over the
+ * workers.  Records are handled in any order.
+ *
+ * The input must use an ASCII-compatible encoding; and entities declared in
+ * a document type declaration are not available to the records.
+ * Well-formedness is only checked as the records are read.
+ *
+ * @param[in,out] in        the input.
+ * @param[in]     handler   called for each record.
+ * @param[in]     options   options for the run.
+ *
+ * @exception xml::parse_error      if the input ends within an element.
+ * @exception std::runtime_error    if reading @p in fails.
+ * @exception std::system_error     if a thread cannot be started.
+ * @exception std::bad_alloc        if memory allocation fails.
+ * @exception ...                   the first exception thrown by
+ *                                  @p handler or another callback; the
+ *                                  run stops.
+ */
+void xml::fan_out_records(
+    std::istream & in,
+    const std::function<void (const record_buffer &, std::size_t)> &
+        handler,
+    const fan_out_options & options)
+{
+    fan_out f{handler, options};
+    f.run(in);
+}
@@ -0,0 +1,69 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_FAN_OUT_H
+#   define XML_FAN_OUT_H
+
+#   include "reader.h"
+#   include <cstdint>
+#   include <functional>
+#   include <iosfwd>
+#   include <string>
+#   include <vector>
+
+namespace xml
+{
+    struct record_buffer {
+        std::size_t index = 0;
+        std::uint64_t offset = 0;
+        std::size_t line = 1;
+        std::size_t column = 1;
+        std::string data;
+        std::vector<namespace_binding> namespaces;
+
+        const reader_options
+        options(const reader_options & base = reader_options()) const;
+    };
+
+    struct fan_out_options {
+        std::size_t threads = 0;
+        std::size_t record_depth = 1;
+        std::size_t queue_capacity = 256;
+        std::function<void (std::size_t worker)> worker_started;
+        std::function<void (std::size_t worker)> worker_finished;
+    };
+
+    std::size_t fan_out_worker_count(const fan_out_options & options =
+                                         fan_out_options());
+
+    void fan_out_records(
+        std::istream & in,
+        const std::function<void (const record_buffer & record,
+                                  std::size_t worker)> & handler,
+        const fan_out_options & options = fan_out_options());
+}
+
+# endif // XML_FAN_OUT_H
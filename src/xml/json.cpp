@@ -0,0 +1,568 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+# include "json.h"
+# include "reader.h"
+# include <cstdint>
+# include <cstring>
+# include <ostream>
+# include <stdexcept>
+# include <vector>
+
+/**
+ * @file xml/json.h
+ *
+ * @brief Streaming conversion of XML to JSON.
+ */
+
+/**
+ * @class xml::json_options
+ *
+ * @brief Options for @c xml::to_json.
+ *
+ * Attributes become members named with @c attribute_prefix followed by the
+ * attribute's qualified name.  Text in an element that also has attributes
+ * or child elements becomes a member named @c text_key.  Namespace
+ * declarations are treated as attributes only if @c namespace_declarations
+ * is @c true.
+ *
+ * @c array_lookahead bounds, in bytes of output, how long a decision about
+ * whether a value is an array may be deferred; see @c xml::to_json.
+ */
+
+namespace {
+
+    const char xmlns_uri[] = "http://www.w3.org/2000/xmlns/";
+
+    enum class value_shape : std::uint8_t {
+        undecided,
+        text,
+        object
+    };
+
+    enum class child_state : std::uint8_t {
+        none,
+        pending,
+        array
+    };
+
+    //
+    // An open element.  Positions are offsets in the complete output, so
+    // they survive flushing.
+    //
+    struct frame {
+        value_shape shape;
+        child_state last_child_state;
+        bool members;
+        bool text_open;
+        bool last_child_text;
+        std::uint64_t value_pos;
+        std::uint64_t child_value_pos;
+        std::string last_child;
+    };
+
+    class transcoder {
+        std::ostream * const out_;
+        std::string & buf_;
+        const xml::json_options & options_;
+        std::uint64_t flushed_;
+        std::size_t checked_size_;
+        //
+        // Frames are reused, to keep their strings' storage.
+        //
+        std::vector<frame> frames_;
+        std::size_t depth_;
+
+    public:
+        transcoder(std::ostream * out, std::string & buf,
+                   const xml::json_options & options);
+        transcoder(const transcoder &) = delete;
+        transcoder & operator=(const transcoder &) = delete;
+
+        void run(xml::reader & in);
+
+    private:
+        std::uint64_t pos() const throw ()
+        {
+            return this->flushed_ + this->buf_.size();
+        }
+
+        void start_element(xml::reader & in);
+        void end_element();
+        void text(const xml::string_ref & text);
+        void attribute(const xml::string_ref & name,
+                       const xml::string_ref & value);
+
+        frame & push();
+        void ensure_object(std::size_t i);
+        void close_text(frame & f);
+        void begin_member();
+        void text_to_object(std::size_t i);
+        void open_array(std::size_t i);
+        bool holds_text(std::size_t i) const throw ();
+        void insert(std::size_t i, std::uint64_t pos, const std::string & str);
+        void write_escaped(const char * data, std::size_t size);
+        void maybe_flush();
+        void flush(std::uint64_t pos);
+    };
+
+    transcoder::transcoder(std::ostream * const out, std::string & buf,
+                           const xml::json_options & options):
+        out_{out},
+        buf_(buf),
+        options_(options),
+        flushed_{0},
+        checked_size_{0},
+        depth_{0}
+    {}
+
+    void transcoder::run(xml::reader & in)
+    {
+        //
+        // The document is an object with a single member, named for the
+        // document element.
+        //
+        frame & document = this->push();
+        document.shape = value_shape::object;
+        this->buf_ += '{';
+
+        while (in.read()) {
+            switch (int(in.node_type())) {
+            case xml::reader::element_id:
+                this->start_element(in);
+                break;
+            case xml::reader::end_element_id:
+                this->end_element();
+                break;
+            case xml::reader::text_id:
+            case xml::reader::cdata_id:
+                this->text(in.value_ref());
+                break;
+            case 5: // entity reference
+                throw std::runtime_error{"cannot convert an unexpanded "
+                                         "entity reference"};
+            default:
+                //
+                // Whitespace-only text, comments, and processing
+                // instructions have no JSON representation.
+                //
+                break;
+            }
+        }
+
+        if (this->depth_ != 1) {
+            throw std::logic_error{"unbalanced element events"};
+        }
+        this->end_element();
+        this->flush(this->pos());
+    }
+
+    frame & transcoder::push()
+    {
+        if (this->depth_ == this->frames_.size()) {
+            this->frames_.emplace_back();
+        }
+        frame & f = this->frames_[this->depth_++];
+        f.shape = value_shape::undecided;
+        f.last_child_state = child_state::none;
+        f.members = false;
+        f.text_open = false;
+        f.last_child_text = false;
+        f.value_pos = this->pos();
+        f.child_value_pos = 0;
+        f.last_child.clear();
+        return f;
+    }
+
+    void transcoder::start_element(xml::reader & in)
+    {
+        const std::size_t parent_index = this->depth_ - 1;
+        this->ensure_object(parent_index);
+
+        const xml::string_ref name = in.qualified_name_ref();
+        {
+            frame & parent = this->frames_[parent_index];
+            if (parent.last_child_state != child_state::none
+                && parent.last_child.size() == name.size()
+                && std::memcmp(parent.last_child.data(), name.data(),
+                               name.size()) == 0) {
+                //
+                // A repeated sibling: its predecessor's value becomes the
+                // first in an array, if it isn't already.
+                //
+                if (parent.last_child_state == child_state::pending) {
+                    this->open_array(parent_index);
+                }
+                this->buf_ += ',';
+            } else {
+                this->begin_member();
+                this->buf_ += '"';
+                this->write_escaped(name.data(), name.size());
+                this->buf_ += "\":";
+                //
+                // The document element cannot repeat; so there is nothing
+                // to decide.
+                //
+                parent.child_value_pos = this->pos();
+                parent.last_child_state = (parent_index == 0)
+                                        ? child_state::none
+                                        : child_state::pending;
+                parent.last_child.assign(name.data(), name.size());
+            }
+            parent.last_child_text = false;
+        }
+
+        const bool empty = in.empty_element();
+        this->push();
+        for (bool more = in.move_to_first_attribute();
+             more;
+             more = in.move_to_next_attribute()) {
+            if (!this->options_.namespace_declarations) {
+                const xml::string_ref uri = in.namespace_uri();
+                if (uri.size() == sizeof xmlns_uri - 1
+                    && std::memcmp(uri.data(), xmlns_uri, uri.size()) == 0) {
+                    continue;
+                }
+            }
+            this->attribute(in.qualified_name_ref(), in.value_ref());
+        }
+        if (empty) { this->end_element(); }
+        this->maybe_flush();
+    }
+
+    void transcoder::end_element()
+    {
+        frame & f = this->frames_[this->depth_ - 1];
+        this->close_text(f);
+        switch (f.shape) {
+        case value_shape::undecided:
+            this->buf_ += "null";
+            break;
+        case value_shape::text:
+            break;
+        case value_shape::object:
+            if (f.last_child_state == child_state::array) {
+                this->buf_ += ']';
+            }
+            this->buf_ += '}';
+            break;
+        }
+        --this->depth_;
+        if (this->depth_ != 0) {
+            this->frames_[this->depth_ - 1].last_child_text =
+                f.shape == value_shape::text;
+        }
+        this->maybe_flush();
+    }
+
+    void transcoder::text(const xml::string_ref & text)
+    {
+        frame & f = this->frames_[this->depth_ - 1];
+        switch (f.shape) {
+        case value_shape::undecided:
+            this->buf_ += '"';
+            f.shape = value_shape::text;
+            f.text_open = true;
+            break;
+        case value_shape::text:
+            break;
+        case value_shape::object:
+            if (!f.text_open) {
+                this->begin_member();
+                f.last_child_state = child_state::none;
+                f.last_child.clear();
+                this->buf_ += '"';
+                this->write_escaped(this->options_.text_key.data(),
+                                    this->options_.text_key.size());
+                this->buf_ += "\":\"";
+                f.text_open = true;
+            }
+            break;
+        }
+        this->write_escaped(text.data(), text.size());
+        this->maybe_flush();
+    }
+
+    void transcoder::attribute(const xml::string_ref & name,
+                               const xml::string_ref & value)
+    {
+        frame & f = this->frames_[this->depth_ - 1];
+        if (f.shape == value_shape::undecided) {
+            this->buf_ += '{';
+            f.shape = value_shape::object;
+        }
+        this->begin_member();
+        this->buf_ += '"';
+        this->write_escaped(this->options_.attribute_prefix.data(),
+                            this->options_.attribute_prefix.size());
+        this->write_escaped(name.data(), name.size());
+        this->buf_ += "\":\"";
+        this->write_escaped(value.data(), value.size());
+        this->buf_ += '"';
+    }
+
+    //
+    // Make the value of the element at frame i an object, if it isn't
+    // already, and end any text member in progress.
+    //
+    void transcoder::ensure_object(const std::size_t i)
+    {
+        frame & f = this->frames_[i];
+        switch (f.shape) {
+        case value_shape::undecided:
+            this->buf_ += '{';
+            f.shape = value_shape::object;
+            break;
+        case value_shape::text:
+            this->close_text(f);
+            this->text_to_object(i);
+            break;
+        case value_shape::object:
+            this->close_text(f);
+            break;
+        }
+    }
+
+    void transcoder::close_text(frame & f)
+    {
+        if (f.text_open) {
+            this->buf_ += '"';
+            f.text_open = false;
+        }
+    }
+
+    //
+    // Start a new member of the innermost object: end any array of
+    // repeated siblings, and separate it from the previous member.
+    //
+    void transcoder::begin_member()
+    {
+        frame & f = this->frames_[this->depth_ - 1];
+        if (f.last_child_state == child_state::array) {
+            this->buf_ += ']';
+        }
+        if (f.members) { this->buf_ += ','; }
+        f.members = true;
+    }
+
+    //
+    // Text already written as the value of the element at frame i becomes
+    // the text member of an object.
+    //
+    void transcoder::text_to_object(const std::size_t i)
+    {
+        frame & f = this->frames_[i];
+        this->insert(i, f.value_pos,
+                     "{\"" + this->options_.text_key + "\":");
+        f.shape = value_shape::object;
+        f.members = true;
+    }
+
+    //
+    // The value of the last child of the element at frame i becomes the
+    // first in an array.
+    //
+    void transcoder::open_array(const std::size_t i)
+    {
+        frame & f = this->frames_[i];
+        this->insert(i, f.child_value_pos, "[");
+        f.last_child_state = child_state::array;
+    }
+
+    //
+    // Insert str at pos, which must not have been flushed, adjusting the
+    // positions recorded in the frames inside frame i.
+    //
+    void transcoder::insert(const std::size_t i,
+                            const std::uint64_t pos,
+                            const std::string & str)
+    {
+        this->buf_.insert(std::size_t(pos - this->flushed_), str);
+        for (std::size_t j = i + 1; j < this->depth_; ++j) {
+            frame & f = this->frames_[j];
+            if (f.value_pos >= pos) { f.value_pos += str.size(); }
+            if (f.child_value_pos >= pos) {
+                f.child_value_pos += str.size();
+            }
+        }
+    }
+
+    void transcoder::write_escaped(const char * const data,
+                                   const std::size_t size)
+    {
+        static const char digits[] = "0123456789abcdef";
+        const char * run = data;
+        const char * const end = data + size;
+        for (const char * p = data; p != end; ++p) {
+            const unsigned char c = static_cast<unsigned char>(*p);
+            if (c >= 0x20 && c != '"' && c != '\\') { continue; }
+            this->buf_.append(run, p - run);
+            run = p + 1;
+            switch (c) {
+            case '"':  this->buf_ += "\\\""; break;
+            case '\\': this->buf_ += "\\\\"; break;
+            case '\n': this->buf_ += "\\n";  break;
+            case '\r': this->buf_ += "\\r";  break;
+            case '\t': this->buf_ += "\\t";  break;
+            default:
+                this->buf_ += "\\u00";
+                this->buf_ += digits[c >> 4];
+                this->buf_ += digits[c & 0xf];
+            }
+        }
+        this->buf_.append(run, end - run);
+    }
+
+    //
+    // Whether the decision outstanding at frame i is about text: either the
+    // element's own text, or the text value of its last child.  Such a
+    // decision is made by the next element event, so it is never forced;
+    // holding it back holds at most one run of text.
+    //
+    bool transcoder::holds_text(const std::size_t i) const throw ()
+    {
+        const frame & f = this->frames_[i];
+        if (f.shape == value_shape::text) { return true; }
+        if (i + 1 == this->depth_) { return f.last_child_text; }
+        return i + 2 == this->depth_
+            && this->frames_[i + 1].shape == value_shape::text;
+    }
+
+    //
+    // Output before the earliest deferred decision is final, and can be
+    // flushed.  A decision deferred for more than the lookahead is made
+    // in favor of the more general shape, an array; unless it is about
+    // text, which is only restructured if a child element follows it.
+    //
+    void transcoder::maybe_flush()
+    {
+        if (this->buf_.size() < this->checked_size_ + 4096) { return; }
+
+        for (;;) {
+            std::size_t pending = this->depth_;
+            std::uint64_t pending_pos = this->pos();
+            for (std::size_t i = 0; i < this->depth_; ++i) {
+                const frame & f = this->frames_[i];
+                if (f.shape == value_shape::text) {
+                    pending = i;
+                    pending_pos = f.value_pos;
+                    break;
+                }
+                if (f.last_child_state == child_state::pending) {
+                    pending = i;
+                    pending_pos = f.child_value_pos;
+                    break;
+                }
+            }
+            if (pending != this->depth_
+                && !this->holds_text(pending)
+                && this->pos() - pending_pos
+                    > this->options_.array_lookahead) {
+                this->open_array(pending);
+                continue;
+            }
+            this->flush(pending_pos);
+            break;
+        }
+        this->checked_size_ = this->buf_.size();
+    }
+
+    void transcoder::flush(const std::uint64_t pos)
+    {
+        if (!this->out_) { return; }
+        const std::size_t size = std::size_t(pos - this->flushed_);
+        if (size == 0) { return; }
+        this->out_->write(this->buf_.data(), size);
+        if (!*this->out_) {
+            throw std::runtime_error{"failed to write JSON output"};
+        }
+        this->buf_.erase(0, size);
+        this->flushed_ += size;
+    }
+}
+
+/**
+ * @brief Convert a document to JSON.
+ *
+ * Reads @p in to the end of the document and writes a JSON object with a
+ * single member, named for the document element.  An element's value is
+ * - @c null, if it has no attributes, child elements, or text;
+ * - a string, if it has only text; and otherwise
+ * - an object, with members for its attributes, then for its child
+ *   elements and text in document order.
+ *
+ * Consecutive sibling elements with the same name become one member whose
+ * value is an array.  Output is held back only while such a decision is
+ * outstanding; if that exceeds @c xml::json_options::array_lookahead bytes,
+ * the element's value is written as an array without waiting to see whether
+ * it is needed.  Text is held back until it is known whether a child
+ * element follows it; so an element's value is an object with a text
+ * member only if it has attributes or child elements.
+ * Siblings with the same name that are separated by other content are
+ * written as separate members with the same name, as are separate runs of
+ * text in mixed content.
+ *
+ * Whitespace-only text, comments, and processing instructions are omitted.
+ *
+ * @param[in,out] in        a reader, positioned before the document
+ *                          element; typically, newly constructed.
+ * @param[in,out] out       an output stream.
+ * @param[in]     options   conversion options.
+ *
+ * @exception xml::parse_error      if @p in encounters a parse error.
+ * @exception std::runtime_error    if @p in reports an unexpanded entity
+ *                                  reference, or if writing to @p out
+ *                                  fails.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+void xml::to_json(reader & in, std::ostream & out,
+                  const json_options & options)
+{
+    std::string buf;
+    transcoder{&out, buf, options}.run(in);
+}
+
+/**
+ * @brief Convert a document to a JSON string.
+ *
+ * @param[in,out] in        a reader, positioned before the document
+ *                          element; typically, newly constructed.
+ * @param[in]     options   conversion options.
+ *
+ * @return the JSON text.
+ *
+ * @exception xml::parse_error      if @p in encounters a parse error.
+ * @exception std::runtime_error    if @p in reports an unexpanded entity
+ *                                  reference.
+ * @exception std::bad_alloc        if memory allocation fails.
+ *
+ * @sa xml::to_json(reader &, std::ostream &, const json_options &)
+ */
+const std::string xml::to_json(reader & in, const json_options & options)
+{
+    std::string result;
+    transcoder{nullptr, result, options}.run(in);
+    return result;
+}
@@ -0,0 +1,350 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "markup_scanner.h"
+# include <cstring>
+
+/**
+ * @internal
+ *
+ * @class xml::detail::markup_scanner
+ *
+ * @brief Locates tags in raw XML input.
+ *
+ * The scanner is fed the input bytes as they are passed to the underlying
+ * parser, and queues the byte range and line of each start, empty-element
+ * and end tag.  Tags are queued in document order; so they correspond,
+ * one for one, to the element and end element nodes the reader reports,
+ * allowing the reader to locate the current node in the input.
+ *
+ * This is not a parser: it only distinguishes tags from character data,
+ * comments, CDATA sections, processing instructions and declarations, and
+ * it assumes an ASCII-compatible encoding.  Elements produced by entity
+ * expansion have no tags in the input.
+ */
+
+/**
+ * @internal
+ *
+ * @enum xml::detail::markup_scanner::tag_kind
+ *
+ * @brief The kind of a tag.
+ */
+
+/**
+ * @internal
+ *
+ * @struct xml::detail::markup_scanner::tag
+ *
+ * @brief The location of a tag.
+ *
+ * @c offset is the offset of the tag's `<`; @c end is the offset just past
+ * its `>`; @c line is the line of its `<`; and @c end_line and
+ * @c end_column are the line and column of the byte at @c end.
+ */
+
+/**
+ * @internal
+ *
+ * @brief Construct.
+ *
+ * @param[in] offset    the offset of the first byte that will be scanned.
+ * @param[in] line      the line of the first byte that will be scanned.
+ * @param[in] column    the column of the first byte that will be scanned.
+ */
+xml::detail::markup_scanner::markup_scanner(const std::uint64_t offset,
+                                            const std::size_t line,
+                                            const std::size_t column)
+    throw ():
+    offset_{offset},
+    line_{line},
+    line_start_{offset - (column > 0 ? column - 1 : 0)},
+    tag_offset_{0},
+    tag_line_{0},
+    state_{state::text},
+    quote_{0},
+    matched_{0},
+    slash_{false},
+    brackets_{0}
+{}
+
+/**
+ * @internal
+ *
+ * @brief Scan the next block of input.
+ *
+ * @param[in] data  the input.
+ * @param[in] size  the number of bytes at @p data.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::detail::markup_scanner::scan(const char * const data,
+                                       const std::size_t size)
+{
+    const char * p = data;
+    const char * const last = data + size;
+    while (p != last) {
+        if (this->state_ == state::text) {
+            //
+            // Character data is most of the input; skip it in bulk.
+            //
+            const char * const lt =
+                static_cast<const char *>(std::memchr(p, '<', last - p));
+            const char * const stop = lt ? lt : last;
+            for (const char * nl = p;
+                 (nl = static_cast<const char *>(
+                      std::memchr(nl, '\n', stop - nl)));
+                 ++nl) {
+                ++this->line_;
+                this->line_start_ = this->offset_ + (nl - p) + 1;
+            }
+            this->offset_ += stop - p;
+            p = stop;
+            if (!lt) { break; }
+            this->tag_offset_ = this->offset_;
+            this->tag_line_ = this->line_;
+            this->state_ = state::markup;
+            ++p;
+            ++this->offset_;
+            continue;
+        }
+
+        const char c = *p++;
+        ++this->offset_;
+        if (c == '\n') {
+            ++this->line_;
+            this->line_start_ = this->offset_;
+        }
+
+        switch (this->state_) {
+        case state::markup:
+            if (c == '/') {
+                this->state_ = state::end_tag;
+            } else if (c == '?') {
+                this->state_ = state::processing_instruction;
+                this->matched_ = 0;
+            } else if (c == '!') {
+                this->state_ = state::bang;
+            } else {
+                this->state_ = state::start_tag;
+                this->slash_ = false;
+            }
+            break;
+        case state::start_tag:
+            if (c == '"' || c == '\'') {
+                this->quote_ = c;
+                this->state_ = state::attribute_value;
+                this->slash_ = false;
+            } else if (c == '>') {
+                this->emit(this->slash_ ? tag_kind::empty : tag_kind::start);
+                this->state_ = state::text;
+            } else {
+                this->slash_ = (c == '/');
+            }
+            break;
+        case state::attribute_value:
+            if (c == this->quote_) { this->state_ = state::start_tag; }
+            break;
+        case state::end_tag:
+            if (c == '>') {
+                this->emit(tag_kind::end);
+                this->state_ = state::text;
+            }
+            break;
+        case state::processing_instruction:
+            if (c == '>' && this->matched_) {
+                this->state_ = state::text;
+            } else {
+                this->matched_ = (c == '?');
+            }
+            break;
+        case state::bang:
+            if (c == '-') {
+                this->state_ = state::bang_dash;
+            } else if (c == '[') {
+                this->state_ = state::bang_cdata;
+                this->matched_ = 1;
+            } else {
+                this->state_ = state::declaration;
+                this->brackets_ = 0;
+                this->matched_ = 0;
+                if (c == '"' || c == '\'') {
+                    this->quote_ = c;
+                    this->state_ = state::declaration_literal;
+                } else if (c == '>') {
+                    this->state_ = state::text;
+                }
+            }
+            break;
+        case state::bang_dash:
+            this->state_ = (c == '-') ? state::comment : state::declaration;
+            this->matched_ = 0;
+            this->brackets_ = 0;
+            break;
+        case state::bang_cdata:
+        {
+            static const char cdata_open[] = "[CDATA[";
+            if (c != cdata_open[this->matched_]) {
+                //
+                // A conditional section; these only occur in the external
+                // subset, so this is not expected.
+                //
+                this->state_ = state::declaration;
+                this->brackets_ = 1;
+                this->matched_ = 0;
+            } else if (++this->matched_ == sizeof cdata_open - 1) {
+                this->state_ = state::cdata;
+                this->matched_ = 0;
+            }
+            break;
+        }
+        case state::comment:
+        case state::cdata:
+        case state::declaration_comment:
+        {
+            const char close = (this->state_ == state::cdata) ? ']' : '-';
+            if (c == close) {
+                if (this->matched_ < 2) { ++this->matched_; }
+            } else if (c == '>' && this->matched_ == 2) {
+                this->state_ = (this->state_ == state::declaration_comment)
+                             ? state::declaration
+                             : state::text;
+                this->matched_ = 0;
+            } else {
+                this->matched_ = 0;
+            }
+            break;
+        }
+        case state::declaration:
+            //
+            // Comments in the internal subset may contain quotes; so they
+            // must be recognized in order to track literals.
+            //
+            if (c == '<') {
+                this->matched_ = 1;
+                break;
+            } else if (this->matched_ == 1 && c == '!') {
+                this->matched_ = 2;
+                break;
+            } else if ((this->matched_ == 2 || this->matched_ == 3)
+                       && c == '-') {
+                if (++this->matched_ == 4) {
+                    this->state_ = state::declaration_comment;
+                    this->matched_ = 0;
+                }
+                break;
+            }
+            this->matched_ = 0;
+            if (c == '"' || c == '\'') {
+                this->quote_ = c;
+                this->state_ = state::declaration_literal;
+            } else if (c == '[') {
+                ++this->brackets_;
+            } else if (c == ']') {
+                if (this->brackets_ > 0) { --this->brackets_; }
+            } else if (c == '>' && this->brackets_ == 0) {
+                this->state_ = state::text;
+            }
+            break;
+        case state::declaration_literal:
+            if (c == this->quote_) { this->state_ = state::declaration; }
+            break;
+        case state::text:
+            break;
+        }
+    }
+}
+
+/**
+ * @internal
+ *
+ * @brief Remove the earliest queued tag.
+ *
+ * @param[out] t    the tag.
+ *
+ * @return @c true if a tag was removed; @c false if the queue is empty.
+ */
+bool xml::detail::markup_scanner::pop(tag & t) throw ()
+{
+    if (this->tags_.empty()) { return false; }
+    t = this->tags_.front();
+    this->tags_.pop_front();
+    return true;
+}
+
+/**
+ * @internal
+ *
+ * @brief The offset just past the last byte scanned.
+ *
+ * @return the offset just past the last byte scanned.
+ */
+std::uint64_t xml::detail::markup_scanner::offset() const throw ()
+{
+    return this->offset_;
+}
+
+/**
+ * @internal
+ *
+ * @brief The line of the next byte to be scanned.
+ *
+ * @return the line of the next byte to be scanned.
+ */
+std::size_t xml::detail::markup_scanner::line() const throw ()
+{
+    return this->line_;
+}
+
+/**
+ * @internal
+ *
+ * @brief The column of the next byte to be scanned.
+ *
+ * Columns count bytes, starting from 1.
+ *
+ * @return the column of the next byte to be scanned.
+ */
+std::size_t xml::detail::markup_scanner::column() const throw ()
+{
+    return std::size_t(this->offset_ - this->line_start_) + 1;
+}
+
+/**
+ * @internal
+ *
+ * @brief Queue a tag that ends with the last byte scanned.
+ *
+ * @param[in] kind  the kind of tag.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::detail::markup_scanner::emit(const tag_kind kind)
+{
+    this->tags_.push_back(
+        tag{kind, this->tag_offset_, this->offset_, this->tag_line_,
+            this->line_, this->column()});
+}
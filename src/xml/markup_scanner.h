@@ -0,0 +1,96 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_MARKUP_SCANNER_H
+#   define XML_MARKUP_SCANNER_H
+
+#   include <cstddef>
+#   include <cstdint>
+#   include <deque>
+
+namespace xml {
+
+    namespace detail {
+
+        class markup_scanner {
+        public:
+            enum class tag_kind : std::uint8_t { start, empty, end };
+
+            struct tag {
+                tag_kind kind;
+                std::uint64_t offset;
+                std::uint64_t end;
+                std::size_t line;
+                std::size_t end_line;
+                std::size_t end_column;
+            };
+
+            explicit markup_scanner(std::uint64_t offset = 0,
+                                    std::size_t line = 1,
+                                    std::size_t column = 1) throw ();
+
+            void scan(const char * data, std::size_t size);
+            bool pop(tag & t) throw ();
+            std::uint64_t offset() const throw ();
+            std::size_t line() const throw ();
+            std::size_t column() const throw ();
+
+        private:
+            enum class state : std::uint8_t {
+                text,
+                markup,
+                start_tag,
+                attribute_value,
+                end_tag,
+                bang,
+                bang_dash,
+                bang_cdata,
+                comment,
+                cdata,
+                declaration,
+                declaration_literal,
+                declaration_comment,
+                processing_instruction
+            };
+
+            std::deque<tag> tags_;
+            std::uint64_t offset_;
+            std::size_t line_;
+            std::uint64_t line_start_;
+            std::uint64_t tag_offset_;
+            std::size_t tag_line_;
+            state state_;
+            char quote_;
+            std::uint8_t matched_;
+            bool slash_;
+            std::size_t brackets_;
+
+            void emit(tag_kind kind);
+        };
+    }
+}
+
+# endif // ifndef XML_MARKUP_SCANNER_H
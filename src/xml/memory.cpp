@@ -0,0 +1,389 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "memory.h"
+# include "memory_account.h"
+# include <algorithm>
+# include <cstdlib>
+# include <cstring>
+# include <mutex>
+# include <stdexcept>
+# ifndef HAVE_XMLLITE
+#   include <libxml/parser.h>
+#   include <libxml/xmlmemory.h>
+# endif
+
+/**
+ * @file xml/memory.h
+ *
+ * @brief Memory management hooks.
+ */
+
+/**
+ * @class xml::memory_resource
+ *
+ * @brief Abstract interface for a memory resource used by an
+ *        @c xml::reader.
+ *
+ * Implementations may be as simple as a bump allocator that is reset after
+ * each document; blocks are returned to the resource that allocated them,
+ * along with their size.
+ *
+ * @sa xml::reader_options::memory
+ */
+
+/**
+ * @brief Destroy.
+ */
+xml::memory_resource::~memory_resource() throw ()
+{}
+
+/**
+ * @fn void * xml::memory_resource::allocate(std::size_t size)
+ *
+ * @brief Allocate memory.
+ *
+ * The returned block must be suitably aligned for any fundamental type.
+ *
+ * @param[in] size  the size of the block to allocate.
+ *
+ * @return a pointer to the allocated block, or @c nullptr if allocation
+ *         fails.
+ */
+
+/**
+ * @fn void xml::memory_resource::deallocate(void * p, std::size_t size)
+ *
+ * @brief Deallocate memory.
+ *
+ * @param[in] p     a block returned from @c #allocate.
+ * @param[in] size  the size that was passed to @c #allocate.
+ */
+
+namespace {
+
+    std::atomic<bool> hooks_installed{false};
+
+    //
+    // The account used for allocations made by the current thread.  This
+    // is set by xml::detail::memory_scope.
+    //
+    thread_local xml::detail::memory_account * current_account = nullptr;
+
+    //
+    // Each block is prefixed with a header identifying the account it was
+    // charged to; so it can be released to the right account (and memory
+    // resource) regardless of which thread frees it.
+    //
+    struct block_header {
+        xml::detail::memory_account * account;
+        std::size_t size;
+    };
+
+    const std::size_t alignment = alignof(std::max_align_t);
+    const std::size_t header_size =
+        (sizeof (block_header) + alignment - 1) / alignment * alignment;
+
+    block_header * header(void * const p) throw ()
+    {
+        return reinterpret_cast<block_header *>(
+            static_cast<char *>(p) - header_size);
+    }
+
+    void * allocate(xml::detail::memory_account * const account,
+                    const std::size_t size) throw ()
+    {
+        const std::size_t total = header_size + size;
+        void * block = nullptr;
+        if (account) {
+            const std::size_t in_use =
+                account->in_use.load(std::memory_order_relaxed);
+            if (account->limit != 0
+                && size > account->limit - (std::min)(in_use,
+                                                      account->limit)) {
+                account->limit_exceeded.store(true, std::memory_order_relaxed);
+                return nullptr;
+            }
+            block = account->resource
+                  ? account->resource->allocate(total)
+                  : std::malloc(total);
+            if (!block) { return nullptr; }
+            account->acquire();
+            const std::size_t now =
+                account->in_use.fetch_add(size, std::memory_order_relaxed)
+                + size;
+            std::size_t high =
+                account->high_water.load(std::memory_order_relaxed);
+            while (now > high
+                   && !account->high_water.compare_exchange_weak(
+                       high, now, std::memory_order_relaxed)) {}
+        } else {
+            block = std::malloc(total);
+            if (!block) { return nullptr; }
+        }
+        block_header * const h = static_cast<block_header *>(block);
+        h->account = account;
+        h->size = size;
+        return static_cast<char *>(block) + header_size;
+    }
+
+    void deallocate(void * const p) throw ()
+    {
+        if (!p) { return; }
+        block_header * const h = header(p);
+        xml::detail::memory_account * const account = h->account;
+        if (account) {
+            account->in_use.fetch_sub(h->size, std::memory_order_relaxed);
+            if (account->resource) {
+                account->resource->deallocate(h, header_size + h->size);
+            } else {
+                std::free(h);
+            }
+            account->release();
+        } else {
+            std::free(h);
+        }
+    }
+}
+
+# ifndef HAVE_XMLLITE
+extern "C" {
+    void * xml_memory_malloc(size_t size);
+    void * xml_memory_realloc(void * p, size_t size);
+    void xml_memory_free(void * p);
+    char * xml_memory_strdup(const char * str);
+}
+# endif
+
+/**
+ * @brief Install the hooks that route libxml2's allocations through
+ *        xmlrw's memory accounting.
+ *
+ * This must be called before any other use of libxml2 in the process
+ * (including construction of any @c xml::reader or @c xml::writer); blocks
+ * allocated before the hooks are installed cannot be freed safely
+ * afterward.  Calling this function more than once has no further effect.
+ *
+ * Installing the hooks is a prerequisite for
+ * @c xml::reader_options::memory_limit and
+ * @c xml::reader_options::memory.  Allocations made outside of any reader
+ * with such options go to @c std::malloc, with a small per-block overhead.
+ *
+ * When using the XmlLite backend, this function does nothing.
+ *
+ * @exception std::runtime_error    if installing the hooks fails.
+ */
+void xml::install_memory_hooks()
+{
+# ifndef HAVE_XMLLITE
+    static std::once_flag once;
+    std::call_once(once, []{
+        if (xmlGcMemSetup(xml_memory_free,
+                          xml_memory_malloc,
+                          xml_memory_malloc,
+                          xml_memory_realloc,
+                          xml_memory_strdup) != 0) {
+            throw std::runtime_error{"failed to install memory hooks"};
+        }
+        //
+        // Initialize libxml2's global state now, so that it is not charged
+        // to the first reader that happens to trigger it.
+        //
+        xmlInitParser();
+        hooks_installed.store(true);
+    });
+# endif
+}
+
+/**
+ * @internal
+ *
+ * @brief Whether @c xml::install_memory_hooks has been called successfully.
+ *
+ * @return @c true if the memory hooks have been installed; @c false
+ *         otherwise.
+ */
+bool xml::detail::memory_hooks_installed() throw ()
+{
+    return hooks_installed.load();
+}
+
+/**
+ * @internal
+ *
+ * @class xml::detail::memory_account
+ *
+ * @brief Memory accounting for allocations charged to a single owner.
+ *
+ * An account is reference-counted: the owner holds one reference and each
+ * outstanding block holds another; so the account outlives any blocks that
+ * outlive its owner.
+ */
+
+/**
+ * @internal
+ *
+ * @brief Construct.
+ *
+ * The new account has a single reference, held by the caller.
+ *
+ * @param[in] resource  the memory resource, or @c nullptr to use
+ *                      @c std::malloc.
+ * @param[in] limit     the maximum number of bytes that may be in use, or 0
+ *                      for no limit.
+ */
+xml::detail::memory_account::memory_account(memory_resource * const resource,
+                                            const std::size_t limit):
+    refs_{1},
+    resource{resource},
+    limit{limit},
+    in_use{0},
+    high_water{0},
+    limit_exceeded{false}
+{}
+
+/**
+ * @internal
+ *
+ * @brief Add a reference.
+ */
+void xml::detail::memory_account::acquire() throw ()
+{
+    this->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @internal
+ *
+ * @brief Drop a reference; the account is deleted when the last reference
+ *        is dropped.
+ */
+void xml::detail::memory_account::release() throw ()
+{
+    if (this->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+/**
+ * @internal
+ *
+ * @class xml::detail::memory_scope
+ *
+ * @brief Charge allocations made by the current thread to an account for
+ *        the lifetime of the scope.
+ */
+
+/**
+ * @internal
+ *
+ * @brief Construct.
+ *
+ * @param[in] account   the account to charge; may be @c nullptr.
+ */
+xml::detail::memory_scope::memory_scope(memory_account * const account)
+    throw ():
+    prev_{current_account}
+{
+    current_account = account;
+}
+
+/**
+ * @internal
+ *
+ * @brief Destroy, restoring the previous account.
+ */
+xml::detail::memory_scope::~memory_scope() throw ()
+{
+    current_account = this->prev_;
+}
+
+# ifndef HAVE_XMLLITE
+void * xml_memory_malloc(const size_t size)
+{
+    return allocate(current_account, size);
+}
+
+void * xml_memory_realloc(void * const p, const size_t size)
+{
+    if (!p) { return allocate(current_account, size); }
+
+    //
+    // A block stays with the account it was first charged to.
+    //
+    block_header * const h = header(p);
+    xml::detail::memory_account * const account = h->account;
+    if (!account || !account->resource) {
+        const std::size_t old_size = h->size;
+        if (account && size > old_size) {
+            const std::size_t in_use =
+                account->in_use.load(std::memory_order_relaxed);
+            const std::size_t growth = size - old_size;
+            if (account->limit != 0
+                && growth > account->limit - (std::min)(in_use,
+                                                        account->limit)) {
+                account->limit_exceeded.store(true, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+        void * const block = std::realloc(h, header_size + size);
+        if (!block) { return nullptr; }
+        block_header * const new_h = static_cast<block_header *>(block);
+        new_h->size = size;
+        if (account) {
+            account->in_use.fetch_add(size, std::memory_order_relaxed);
+            const std::size_t now =
+                account->in_use.fetch_sub(old_size, std::memory_order_relaxed)
+                - old_size;
+            std::size_t high =
+                account->high_water.load(std::memory_order_relaxed);
+            while (now > high
+                   && !account->high_water.compare_exchange_weak(
+                       high, now, std::memory_order_relaxed)) {}
+        }
+        return static_cast<char *>(block) + header_size;
+    }
+
+    void * const result = allocate(account, size);
+    if (!result) { return nullptr; }
+    std::memcpy(result, p, (std::min)(h->size, size));
+    deallocate(p);
+    return result;
+}
+
+void xml_memory_free(void * const p)
+{
+    deallocate(p);
+}
+
+char * xml_memory_strdup(const char * const str)
+{
+    const std::size_t len = std::strlen(str) + 1;
+    char * const result = static_cast<char *>(xml_memory_malloc(len));
+    if (result) { std::memcpy(result, str, len); }
+    return result;
+}
+# endif // HAVE_XMLLITE
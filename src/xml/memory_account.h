@@ -0,0 +1,73 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_MEMORY_ACCOUNT_H
+#   define XML_MEMORY_ACCOUNT_H
+
+#   include <atomic>
+#   include <cstddef>
+
+namespace xml {
+
+    class memory_resource;
+
+    namespace detail {
+
+        bool memory_hooks_installed() throw ();
+
+        class memory_account {
+            std::atomic<std::size_t> refs_;
+
+        public:
+            memory_resource * const resource;
+            const std::size_t limit;
+            std::atomic<std::size_t> in_use;
+            std::atomic<std::size_t> high_water;
+            std::atomic<bool> limit_exceeded;
+
+            memory_account(memory_resource * resource, std::size_t limit);
+            memory_account(const memory_account &) = delete;
+
+            memory_account & operator=(const memory_account &) = delete;
+
+            void acquire() throw ();
+            void release() throw ();
+        };
+
+        class memory_scope {
+            memory_account * const prev_;
+
+        public:
+            explicit memory_scope(memory_account * account) throw ();
+            memory_scope(const memory_scope &) = delete;
+            ~memory_scope() throw ();
+
+            memory_scope & operator=(const memory_scope &) = delete;
+        };
+    }
+}
+
+# endif // ifndef XML_MEMORY_ACCOUNT_H
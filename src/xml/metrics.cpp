@@ -0,0 +1,324 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "metrics.h"
+# include "metrics_recorder.h"
+# include <atomic>
+# include <ostream>
+# include <string>
+
+/**
+ * @file xml/metrics.h
+ *
+ * @brief Process-wide metrics for readers and writers.
+ */
+
+/**
+ * @class xml::metrics_snapshot
+ *
+ * @brief A point-in-time copy of the process-wide reader and writer
+ *        metrics.
+ *
+ * Every @c xml::reader and @c xml::writer reports into a process-wide
+ * registry when it finishes a document.  A reader finishes a document when
+ * @c xml::reader::read returns @c false; a writer finishes a document in
+ * @c xml::writer::end_document.
+ *
+ * @sa xml::snapshot_metrics
+ * @sa xml::write_prometheus_metrics
+ */
+
+/**
+ * @var const std::size_t xml::metrics_snapshot::latency_bucket_count
+ *
+ * @brief The number of buckets in the latency histograms.
+ */
+const std::size_t xml::metrics_snapshot::latency_bucket_count;
+
+/**
+ * @var const std::array<double, xml::metrics_snapshot::latency_bucket_count - 1> xml::metrics_snapshot::latency_bucket_bounds
+ *
+ * @brief The inclusive upper bounds, in seconds, of the latency histogram
+ *        buckets.
+ *
+ * The final bucket, which has no entry here, is unbounded.
+ */
+const std::array<double, xml::metrics_snapshot::latency_bucket_count - 1>
+xml::metrics_snapshot::latency_bucket_bounds = {{
+    1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 1e-1, 5e-1, 1, 5, 10
+}};
+
+/**
+ * @class xml::metrics_snapshot::counters
+ *
+ * @brief Counters for either readers or writers.
+ */
+
+/**
+ * @var std::uint64_t xml::metrics_snapshot::counters::documents
+ *
+ * @brief The number of documents completed.
+ */
+
+/**
+ * @var std::uint64_t xml::metrics_snapshot::counters::bytes
+ *
+ * @brief The number of bytes consumed (readers) or produced (writers) by
+ *        completed documents.
+ */
+
+/**
+ * @var std::uint64_t xml::metrics_snapshot::counters::nodes
+ *
+ * @brief The number of nodes read or written in completed documents.
+ */
+
+/**
+ * @var std::uint64_t xml::metrics_snapshot::counters::errors
+ *
+ * @brief The number of parse or write errors.
+ */
+
+/**
+ * @var std::uint64_t xml::metrics_snapshot::counters::latency_sum_ns
+ *
+ * @brief The sum of the latencies of completed documents, in nanoseconds.
+ */
+
+/**
+ * @var std::array<std::uint64_t, xml::metrics_snapshot::latency_bucket_count> xml::metrics_snapshot::counters::latency_buckets
+ *
+ * @brief Histogram of document latencies.
+ *
+ * Buckets are not cumulative: each document is counted in exactly one
+ * bucket.
+ *
+ * @sa xml::metrics_snapshot::latency_bucket_bounds
+ */
+
+/**
+ * @var xml::metrics_snapshot::counters xml::metrics_snapshot::reader
+ *
+ * @brief Counters for @c xml::reader.
+ */
+
+/**
+ * @var xml::metrics_snapshot::counters xml::metrics_snapshot::writer
+ *
+ * @brief Counters for @c xml::writer.
+ */
+
+namespace {
+
+    using std::uint64_t;
+    using xml::metrics_snapshot;
+
+    const uint64_t latency_bucket_bounds_ns[] = {
+        10000, 50000, 100000, 500000,
+        1000000, 5000000, 10000000, 50000000,
+        100000000, 500000000, 1000000000, 5000000000,
+        10000000000
+    };
+
+    static_assert(sizeof latency_bucket_bounds_ns
+                  / sizeof latency_bucket_bounds_ns[0]
+                  == metrics_snapshot::latency_bucket_count - 1,
+                  "bucket bounds must match the bucket count");
+
+    struct source_counters {
+        std::atomic<uint64_t> documents;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> nodes;
+        std::atomic<uint64_t> errors;
+        std::atomic<uint64_t> latency_sum_ns;
+        std::atomic<uint64_t>
+            latency_buckets[metrics_snapshot::latency_bucket_count];
+    };
+
+    //
+    // Each thread records into its own shard (modulo the shard count); and
+    // each shard occupies its own cache lines, so that threads recording
+    // concurrently do not contend.
+    //
+    const std::size_t cache_line_size = 64;
+    const std::size_t shard_count = 128;
+
+    struct alignas(cache_line_size) shard {
+        source_counters sources[2];
+    };
+
+    //
+    // Zero-initialized, since it has static storage duration.
+    //
+    shard shards[shard_count];
+
+    std::atomic<std::size_t> next_shard{0};
+
+    shard & this_thread_shard() throw ()
+    {
+        thread_local shard & s =
+            shards[next_shard.fetch_add(1, std::memory_order_relaxed)
+                   % shard_count];
+        return s;
+    }
+
+    void add(std::atomic<uint64_t> & counter, const uint64_t n) throw ()
+    {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    const metrics_snapshot::counters
+    snapshot(const xml::detail::metrics_source source)
+    {
+        metrics_snapshot::counters result;
+        for (const shard & s: shards) {
+            const source_counters & c = s.sources[std::size_t(source)];
+            const std::memory_order relaxed = std::memory_order_relaxed;
+            result.documents += c.documents.load(relaxed);
+            result.bytes += c.bytes.load(relaxed);
+            result.nodes += c.nodes.load(relaxed);
+            result.errors += c.errors.load(relaxed);
+            result.latency_sum_ns += c.latency_sum_ns.load(relaxed);
+            for (std::size_t i = 0; i < result.latency_buckets.size(); ++i) {
+                result.latency_buckets[i] += c.latency_buckets[i].load(relaxed);
+            }
+        }
+        return result;
+    }
+
+    void write_prometheus(std::ostream & out,
+                          const char * const source,
+                          const metrics_snapshot::counters & c)
+    {
+        const struct {
+            const char * name;
+            const char * help;
+            uint64_t value;
+        } totals[] = {
+            { "documents", "Documents completed.", c.documents },
+            { "bytes", "Bytes in completed documents.", c.bytes },
+            { "nodes", "Nodes in completed documents.", c.nodes },
+            { "errors", "Errors.", c.errors }
+        };
+        for (const auto & t: totals) {
+            out << "# HELP xmlrw_" << source << '_' << t.name << "_total "
+                << t.help << '\n'
+                << "# TYPE xmlrw_" << source << '_' << t.name
+                << "_total counter\n"
+                << "xmlrw_" << source << '_' << t.name << "_total "
+                << t.value << '\n';
+        }
+
+        const std::string histogram =
+            std::string{"xmlrw_"} + source + "_document_seconds";
+        out << "# HELP " << histogram << " Document latency.\n"
+            << "# TYPE " << histogram << " histogram\n";
+        uint64_t cumulative = 0;
+        for (std::size_t i = 0;
+             i < metrics_snapshot::latency_bucket_bounds.size();
+             ++i) {
+            cumulative += c.latency_buckets[i];
+            out << histogram << "_bucket{le=\""
+                << metrics_snapshot::latency_bucket_bounds[i] << "\"} "
+                << cumulative << '\n';
+        }
+        cumulative += c.latency_buckets.back();
+        out << histogram << "_bucket{le=\"+Inf\"} " << cumulative << '\n'
+            << histogram << "_sum " << double(c.latency_sum_ns) / 1e9 << '\n'
+            << histogram << "_count " << cumulative << '\n';
+    }
+}
+
+/**
+ * @brief Take a snapshot of the process-wide reader and writer metrics.
+ *
+ * Counters are read individually; so a snapshot taken while documents are
+ * being completed may include part of a document's contribution.
+ *
+ * @return a snapshot of the process-wide metrics.
+ */
+const xml::metrics_snapshot xml::snapshot_metrics()
+{
+    metrics_snapshot result;
+    result.reader = snapshot(detail::metrics_source::reader);
+    result.writer = snapshot(detail::metrics_source::writer);
+    return result;
+}
+
+/**
+ * @brief Write the process-wide reader and writer metrics in the
+ *        Prometheus text exposition format.
+ *
+ * @param[in,out] out   an output stream.
+ */
+void xml::write_prometheus_metrics(std::ostream & out)
+{
+    const metrics_snapshot s = snapshot_metrics();
+    write_prometheus(out, "reader", s.reader);
+    write_prometheus(out, "writer", s.writer);
+}
+
+/**
+ * @internal
+ *
+ * @brief Record a completed document.
+ *
+ * @param[in] source    the kind of object that completed the document.
+ * @param[in] bytes     the number of bytes consumed or produced.
+ * @param[in] nodes     the number of nodes read or written.
+ * @param[in] latency   the time taken to process the document.
+ */
+void xml::detail::record_document(const metrics_source source,
+                                  const std::uint64_t bytes,
+                                  const std::uint64_t nodes,
+                                  const std::chrono::nanoseconds latency)
+    throw ()
+{
+    source_counters & c = this_thread_shard().sources[std::size_t(source)];
+    const uint64_t ns = latency.count() > 0 ? uint64_t(latency.count()) : 0;
+    std::size_t bucket = 0;
+    while (bucket < metrics_snapshot::latency_bucket_count - 1
+           && ns > latency_bucket_bounds_ns[bucket]) {
+        ++bucket;
+    }
+    add(c.documents, 1);
+    add(c.bytes, bytes);
+    add(c.nodes, nodes);
+    add(c.latency_sum_ns, ns);
+    add(c.latency_buckets[bucket], 1);
+}
+
+/**
+ * @internal
+ *
+ * @brief Record an error.
+ *
+ * @param[in] source    the kind of object that encountered the error.
+ */
+void xml::detail::record_error(const metrics_source source) throw ()
+{
+    add(this_thread_shard().sources[std::size_t(source)].errors, 1);
+}
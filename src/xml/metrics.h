@@ -0,0 +1,63 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_METRICS_H
+#   define XML_METRICS_H
+
+#   include <array>
+#   include <cstdint>
+#   include <iosfwd>
+
+namespace xml
+{
+    struct metrics_snapshot {
+        //
+        // Upper bounds, in seconds, of the latency histogram buckets; the
+        // last bucket is unbounded.
+        //
+        static const std::size_t latency_bucket_count = 14;
+        static const std::array<double, latency_bucket_count - 1>
+            latency_bucket_bounds;
+
+        struct counters {
+            std::uint64_t documents = 0;
+            std::uint64_t bytes = 0;
+            std::uint64_t nodes = 0;
+            std::uint64_t errors = 0;
+            std::uint64_t latency_sum_ns = 0;
+            std::array<std::uint64_t, latency_bucket_count> latency_buckets =
+                {{}};
+        };
+
+        counters reader;
+        counters writer;
+    };
+
+    const metrics_snapshot snapshot_metrics();
+    void write_prometheus_metrics(std::ostream & out);
+}
+
+# endif // XML_METRICS_H
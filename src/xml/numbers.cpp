@@ -0,0 +1,299 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "numbers.h"
+# include "binding.h"
+# include <cfloat>
+# include <cstdint>
+# if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define XMLRW_SSE2 1
+#   include <emmintrin.h>
+#   ifdef _MSC_VER
+#     include <intrin.h>
+#   endif
+# endif
+
+namespace {
+
+    inline bool is_number_delimiter(const char c) throw ()
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',';
+    }
+
+# ifdef XMLRW_SSE2
+    //
+    // A bit per byte of the 16 at p, set for a delimiter.
+    //
+    inline unsigned delimiter_mask(const char * const p) throw ()
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const __m128i m =
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+                _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))),
+                    _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        return unsigned(_mm_movemask_epi8(m));
+    }
+
+    inline unsigned lowest_bit(const unsigned mask) throw ()
+    {
+#   ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return unsigned(index);
+#   else
+        return unsigned(__builtin_ctz(mask));
+#   endif
+    }
+# endif
+
+    const double exact_powers_of_ten[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    //
+    // Decimal floating point without a locale or a copy.  When the
+    // significand and the power of ten are both exactly representable, a
+    // single multiplication or division is correctly rounded (Clinger's
+    // fast path); anything else goes to value_traits, and so to strtod.
+    //
+    template <typename T>
+    bool parse_float(const char * const begin, const char * const end,
+                     T & value)
+    {
+        //
+        // For float, the fast path needs float arithmetic: rounding to
+        // double and then to float can differ from rounding once.
+        //
+        static const std::uint64_t max_significand =
+            std::uint64_t(1) << std::numeric_limits<T>::digits;
+        static const int max_exponent =
+            std::numeric_limits<T>::digits == 24 ? 10 : 22;
+
+        const char * p = begin;
+        const bool negative = (p != end && *p == '-');
+        if (p != end && (*p == '-' || *p == '+')) { ++p; }
+
+        std::uint64_t significand = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+        bool truncated = false;
+        for (; p != end && unsigned(*p - '0') <= 9; ++p) {
+            any = true;
+            if (digits < 19) {
+                significand = significand * 10 + unsigned(*p - '0');
+                if (significand != 0) { ++digits; }
+            } else {
+                ++exponent;
+                truncated = truncated || *p != '0';
+            }
+        }
+        if (p != end && *p == '.') {
+            for (++p; p != end && unsigned(*p - '0') <= 9; ++p) {
+                any = true;
+                if (digits < 19) {
+                    significand = significand * 10 + unsigned(*p - '0');
+                    if (significand != 0) { ++digits; }
+                    --exponent;
+                } else {
+                    truncated = truncated || *p != '0';
+                }
+            }
+        }
+        if (any && p != end && (*p == 'e' || *p == 'E')) {
+            const char * q = p + 1;
+            const bool negative_exponent = (q != end && *q == '-');
+            if (q != end && (*q == '-' || *q == '+')) { ++q; }
+            if (q != end && unsigned(*q - '0') <= 9) {
+                int e = 0;
+                for (; q != end && unsigned(*q - '0') <= 9; ++q) {
+                    if (e < 100000) { e = e * 10 + (*q - '0'); }
+                }
+                exponent += negative_exponent ? -e : e;
+                p = q;
+            }
+        }
+
+        if (any && p == end && !truncated) {
+            if (significand == 0) {
+                value = negative ? -T(0) : T(0);
+                return true;
+            }
+# if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+            if (significand <= max_significand
+                && exponent >= -max_exponent && exponent <= max_exponent) {
+                T result = T(significand);
+                const T scale = T(exact_powers_of_ten[exponent < 0
+                                                      ? -exponent
+                                                      : exponent]);
+                result = exponent < 0 ? result / scale : result * scale;
+                value = negative ? -result : result;
+                return true;
+            }
+# else
+            (void) max_significand;
+            (void) max_exponent;
+# endif
+        }
+        return xml::value_traits<T>::parse(
+            xml::string_ref{begin, std::size_t(end - begin)}, value);
+    }
+
+    template <typename T>
+    inline bool parse_number(const char * const begin,
+                             const char * const end,
+                             T & value,
+                             std::true_type)
+    {
+        return parse_float(begin, end, value);
+    }
+
+    template <typename T>
+    inline bool parse_number(const char * const begin,
+                             const char * const end,
+                             T & value,
+                             std::false_type)
+    {
+        return xml::value_traits<T>::parse(
+            xml::string_ref{begin, std::size_t(end - begin)}, value);
+    }
+}
+
+/**
+ * @internal
+ *
+ * @brief Skip whitespace and commas.
+ *
+ * @param[in] p     the start of the text.
+ * @param[in] end   the end of the text.
+ *
+ * @return the first character from @p p that is not a delimiter, or
+ *         @p end.
+ */
+const char * xml::detail::skip_number_delimiters(const char * p,
+                                                 const char * const end)
+    throw ()
+{
+# ifdef XMLRW_SSE2
+    while (end - p >= 16) {
+        const unsigned other = ~delimiter_mask(p) & 0xffffu;
+        if (other != 0) { return p + lowest_bit(other); }
+        p += 16;
+    }
+# endif
+    while (p != end && is_number_delimiter(*p)) { ++p; }
+    return p;
+}
+
+/**
+ * @internal
+ *
+ * @brief Find the end of a number.
+ *
+ * @param[in] p     the start of the text.
+ * @param[in] end   the end of the text.
+ *
+ * @return the first whitespace character or comma from @p p, or @p end.
+ */
+const char * xml::detail::find_number_delimiter(const char * p,
+                                                const char * const end)
+    throw ()
+{
+# ifdef XMLRW_SSE2
+    while (end - p >= 16) {
+        const unsigned mask = delimiter_mask(p);
+        if (mask != 0) { return p + lowest_bit(mask); }
+        p += 16;
+    }
+# endif
+    while (p != end && !is_number_delimiter(*p)) { ++p; }
+    return p;
+}
+
+/**
+ * @internal
+ *
+ * @brief Convert a list of numbers separated by whitespace or commas.
+ *
+ * @param[in,out] p     the start of the text; on success, the start of an
+ *                      incomplete number at the end of the text (if
+ *                      @p final is @c false), or @p end; on failure, the
+ *                      start of the invalid number.
+ * @param[in]     end   the end of the text.
+ * @param[in]     final whether the text is complete; otherwise, a number
+ *                      that runs to @p end is left for the caller to join
+ *                      with the text that follows.
+ * @param[in,out] out   the numbers are appended to this.
+ *
+ * @return @c true on success, or @c false if a number is not valid.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+template <typename T>
+bool xml::detail::parse_numbers(const char * & p, const char * const end,
+                                const bool final, std::vector<T> & out)
+{
+    for (;;) {
+        const char * const first = skip_number_delimiters(p, end);
+        if (first == end) {
+            p = end;
+            return true;
+        }
+        const char * const last = find_number_delimiter(first, end);
+        if (last == end && !final) {
+            p = first;
+            return true;
+        }
+        T value;
+        if (!parse_number(first, last, value,
+                          std::is_floating_point<T>())) {
+            p = first;
+            return false;
+        }
+        out.push_back(value);
+        p = last;
+    }
+}
+
+template bool xml::detail::parse_numbers(const char * &, const char *, bool,
+                                         std::vector<std::int32_t> &);
+template bool xml::detail::parse_numbers(const char * &, const char *, bool,
+                                         std::vector<std::uint32_t> &);
+template bool xml::detail::parse_numbers(const char * &, const char *, bool,
+                                         std::vector<std::int64_t> &);
+template bool xml::detail::parse_numbers(const char * &, const char *, bool,
+                                         std::vector<std::uint64_t> &);
+template bool xml::detail::parse_numbers(const char * &, const char *, bool,
+                                         std::vector<float> &);
+template bool xml::detail::parse_numbers(const char * &, const char *, bool,
+                                         std::vector<double> &);
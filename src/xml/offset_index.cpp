@@ -0,0 +1,571 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "offset_index.h"
+# include <algorithm>
+# include <istream>
+# include <ostream>
+# include <stdexcept>
+# include <unordered_map>
+
+/**
+ * @file xml/offset_index.h
+ *
+ * @brief Sidecar index of element offsets, for random access into large
+ *        documents.
+ */
+
+/**
+ * @class xml::index_entry
+ *
+ * @brief An indexed element.
+ *
+ * @c offset and @c length give the element's byte range in the document,
+ * from the `<` of its start tag to the `>` of its end tag; @c line is the
+ * line on which it starts; @c key is the value of the key attribute (empty
+ * if the element has none); and @c scope identifies the namespace
+ * declarations in scope at the element.
+ *
+ * @sa xml::offset_index::namespaces
+ */
+
+/**
+ * @class xml::offset_index
+ *
+ * @brief An index of the elements at one depth of a document.
+ *
+ * An index is built in a single pass over a document with
+ * @c xml::reader, and may be saved to a compact sidecar file.  Thereafter,
+ * @c #open reads an indexed element directly, by seeking to its offset,
+ * without reading anything before or after it.
+ *
+ * Namespace declarations on the indexed elements' ancestors are recorded;
+ * so the reader returned by @c #open resolves prefixes as it would in the
+ * whole document.  Distinct sets of declarations are stored once.
+ *
+ * Offsets are only meaningful for documents in an ASCII-compatible
+ * encoding; UTF-8 is assumed.
+ */
+
+/**
+ * @internal
+ *
+ * @brief Using the pimpl idiom here keeps the index's implementation out of
+ *        the header.
+ */
+struct xml::offset_index::impl {
+    std::vector<index_entry> entries;
+    std::vector<std::vector<namespace_binding>> scopes;
+    std::vector<std::size_t> by_key;
+
+    void sort_keys();
+};
+
+/**
+ * @var std::vector<xml::index_entry> xml::offset_index::impl::entries
+ *
+ * @internal
+ *
+ * @brief The entries, in document order.
+ */
+
+/**
+ * @var std::vector<std::vector<xml::namespace_binding>> xml::offset_index::impl::scopes
+ *
+ * @internal
+ *
+ * @brief The distinct sets of in-scope namespace declarations, indexed by
+ *        @c xml::index_entry::scope.
+ */
+
+/**
+ * @var std::vector<std::size_t> xml::offset_index::impl::by_key
+ *
+ * @internal
+ *
+ * @brief Indices into @c #entries, sorted by key; entries with equal keys
+ *        are in document order.
+ */
+
+/**
+ * @internal
+ *
+ * @brief Build @c #by_key.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::offset_index::impl::sort_keys()
+{
+    this->by_key.resize(this->entries.size());
+    for (std::size_t i = 0; i < this->by_key.size(); ++i) {
+        this->by_key[i] = i;
+    }
+    std::stable_sort(this->by_key.begin(), this->by_key.end(),
+                     [this](const std::size_t a, const std::size_t b) {
+                         return this->entries[a].key < this->entries[b].key;
+                     });
+}
+
+namespace {
+
+    const char magic[] = { 'X', 'M', 'L', 'R', 'W', 'I', 'X', '1' };
+
+    //
+    // Interns sets of namespace declarations while the index is built.
+    //
+    class scope_table {
+        std::vector<std::vector<xml::namespace_binding>> & scopes_;
+        std::unordered_map<std::string, std::size_t> ids_;
+
+    public:
+        explicit scope_table(
+            std::vector<std::vector<xml::namespace_binding>> & scopes):
+            scopes_(scopes)
+        {}
+
+        std::size_t intern(const std::vector<xml::namespace_binding> & scope)
+        {
+            std::string key;
+            for (const auto & binding : scope) {
+                key += binding.prefix;
+                key += '\0';
+                key += binding.uri;
+                key += '\0';
+            }
+            const auto result = this->ids_.emplace(key, this->scopes_.size());
+            if (result.second) { this->scopes_.push_back(scope); }
+            return result.first->second;
+        }
+    };
+
+    //
+    // Add the declarations on the reader's current element to scope.
+    //
+    // Returns whether there were any; on return, key holds the value of the
+    // attribute named key_attribute, if any.
+    //
+    bool read_attributes(xml::reader & r,
+                         const std::string & key_attribute,
+                         std::vector<xml::namespace_binding> & scope,
+                         std::string * const key)
+    {
+        static const xml::string_ref xmlns = "xmlns";
+        bool declared = false;
+        if (!r.move_to_first_attribute()) { return false; }
+        do {
+            const xml::string_ref name = r.qualified_name_ref();
+            std::string prefix;
+            if (name == xmlns) {
+                // default namespace
+            } else if (name.size() > xmlns.size()
+                       && name[xmlns.size()] == ':'
+                       && std::equal(xmlns.begin(), xmlns.end(),
+                                     name.begin())) {
+                prefix.assign(name.begin() + xmlns.size() + 1, name.end());
+            } else {
+                if (key && name == key_attribute) { *key = r.value(); }
+                continue;
+            }
+            declared = true;
+            const std::string uri = r.value();
+            const auto pos =
+                std::find_if(scope.begin(), scope.end(),
+                             [&prefix](const xml::namespace_binding & b) {
+                                 return b.prefix == prefix;
+                             });
+            if (pos != scope.end()) {
+                pos->uri = uri;
+            } else {
+                scope.push_back(xml::namespace_binding{prefix, uri});
+            }
+        } while (r.move_to_next_attribute());
+        return declared;
+    }
+
+    void write_varint(std::ostream & out, std::uint64_t value)
+    {
+        char buf[10];
+        std::size_t n = 0;
+        do {
+            const unsigned char byte = value & 0x7f;
+            value >>= 7;
+            buf[n++] = char(value ? byte | 0x80 : byte);
+        } while (value);
+        out.write(buf, n);
+    }
+
+    void write_string(std::ostream & out, const std::string & str)
+    {
+        write_varint(out, str.size());
+        out.write(str.data(), str.size());
+    }
+
+    std::uint64_t read_varint(std::istream & in)
+    {
+        std::uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            const int c = in.get();
+            if (c == std::char_traits<char>::eof()) {
+                throw std::runtime_error{"truncated index"};
+            }
+            value |= std::uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80)) { return value; }
+        }
+        throw std::runtime_error{"invalid index"};
+    }
+
+    std::string read_string(std::istream & in)
+    {
+        const std::uint64_t size = read_varint(in);
+        std::string result;
+        //
+        // Read in bounded pieces so that a corrupt length cannot cause a
+        // huge allocation up front.
+        //
+        char buf[4096];
+        for (std::uint64_t remaining = size; remaining > 0; ) {
+            const std::size_t n =
+                std::size_t((std::min)(remaining, std::uint64_t(sizeof buf)));
+            if (!in.read(buf, n)) {
+                throw std::runtime_error{"truncated index"};
+            }
+            result.append(buf, n);
+            remaining -= n;
+        }
+        return result;
+    }
+}
+
+/**
+ * @internal
+ *
+ * @brief Construct an empty index.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+xml::offset_index::offset_index():
+    impl_{new impl}
+{}
+
+/**
+ * @brief Index a document.
+ *
+ * @param[in,out] in            the document.
+ * @param[in]     depth         the depth of the elements to index; the
+ *                              document element is at depth 0.
+ * @param[in]     key_attribute the qualified name of the attribute whose
+ *                              value is each entry's key.
+ * @param[in]     options       options for the reader used to read @p in;
+ *                              @c reader_options::track_offsets is set
+ *                              implicitly.
+ *
+ * @return the index.
+ *
+ * @exception xml::parse_error  if there is an error in the input.
+ * @exception std::logic_error  if @p options sets
+ *                              @c reader_options::entities.
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+xml::offset_index xml::offset_index::build(std::istream & in,
+                                           const std::size_t depth,
+                                           const std::string & key_attribute,
+                                           const reader_options & options)
+{
+    offset_index result;
+    impl & index = *result.impl_;
+    scope_table scopes{index.scopes};
+
+    reader_options reader_opts = options;
+    reader_opts.track_offsets = true;
+    reader r{in, reader_opts};
+
+    //
+    // The in-scope declarations and their scope identifier, for each open
+    // element above the indexed depth.
+    //
+    std::vector<std::vector<namespace_binding>> scope_stack{
+        std::vector<namespace_binding>{}};
+    std::vector<std::size_t> scope_ids{scopes.intern(scope_stack.back())};
+    bool in_entry = false;
+
+    while (r.read()) {
+        const reader::node_type_id type = r.node_type();
+        const std::size_t d = r.depth();
+        if (type == reader::element_id && d <= depth) {
+            const source_location location = r.tag_location();
+            const bool empty = r.empty_element();
+            scope_stack.resize(d + 1);
+            scope_ids.resize(d + 1);
+            if (d == depth) {
+                index.entries.push_back(
+                    index_entry{location.offset, 0, location.line,
+                                scope_ids[d], std::string{}});
+                std::vector<namespace_binding> ignored;
+                read_attributes(r, key_attribute, ignored,
+                                &index.entries.back().key);
+                if (empty) {
+                    index.entries.back().length =
+                        location.end - location.offset;
+                } else {
+                    in_entry = true;
+                }
+            } else {
+                std::vector<namespace_binding> scope = scope_stack[d];
+                if (read_attributes(r, key_attribute, scope, nullptr)) {
+                    scope_ids.push_back(scopes.intern(scope));
+                } else {
+                    scope_ids.push_back(scope_ids[d]);
+                }
+                scope_stack.push_back(std::move(scope));
+            }
+        } else if (type == reader::end_element_id && d == depth
+                   && in_entry) {
+            index_entry & entry = index.entries.back();
+            entry.length = r.tag_location().end - entry.offset;
+            in_entry = false;
+        }
+    }
+
+    index.sort_keys();
+    return result;
+}
+
+/**
+ * @brief Load an index saved with @c #save.
+ *
+ * @param[in,out] in    the saved index.
+ *
+ * @return the index.
+ *
+ * @exception std::runtime_error    if @p in does not contain a valid index.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::offset_index xml::offset_index::load(std::istream & in)
+{
+    char header[sizeof magic];
+    if (!in.read(header, sizeof header)
+        || !std::equal(header, header + sizeof header, magic)) {
+        throw std::runtime_error{"not an xmlrw index"};
+    }
+
+    offset_index result;
+    impl & index = *result.impl_;
+
+    const std::uint64_t scope_count = read_varint(in);
+    for (std::uint64_t i = 0; i < scope_count; ++i) {
+        index.scopes.emplace_back();
+        const std::uint64_t binding_count = read_varint(in);
+        for (std::uint64_t j = 0; j < binding_count; ++j) {
+            std::string prefix = read_string(in);
+            std::string uri = read_string(in);
+            index.scopes.back().push_back(
+                namespace_binding{std::move(prefix), std::move(uri)});
+        }
+    }
+
+    const std::uint64_t entry_count = read_varint(in);
+    std::uint64_t offset = 0;
+    std::uint64_t line = 0;
+    for (std::uint64_t i = 0; i < entry_count; ++i) {
+        offset += read_varint(in);
+        line += read_varint(in);
+        const std::uint64_t length = read_varint(in);
+        const std::uint64_t scope = read_varint(in);
+        if (scope >= index.scopes.size()) {
+            throw std::runtime_error{"invalid index"};
+        }
+        std::string key = read_string(in);
+        index.entries.push_back(index_entry{offset, length, std::size_t(line),
+                                            std::size_t(scope),
+                                            std::move(key)});
+    }
+
+    index.sort_keys();
+    return result;
+}
+
+/**
+ * @fn xml::offset_index::offset_index(const offset_index &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Move construct.
+ */
+xml::offset_index::offset_index(offset_index && index) throw ():
+    impl_{std::move(index.impl_)}
+{}
+
+/**
+ * @brief Destroy.
+ */
+xml::offset_index::~offset_index() throw ()
+{}
+
+/**
+ * @fn xml::offset_index & xml::offset_index::operator=(const offset_index &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Move assign.
+ */
+xml::offset_index & xml::offset_index::operator=(offset_index && index)
+    throw ()
+{
+    this->impl_ = std::move(index.impl_);
+    return *this;
+}
+
+/**
+ * @brief Save the index.
+ *
+ * The saved form is compact: offsets and lines are delta-encoded varints,
+ * and each distinct set of namespace declarations is stored once.
+ *
+ * @param[in,out] out   the output stream.
+ *
+ * @exception std::runtime_error    if writing to @p out fails.
+ */
+void xml::offset_index::save(std::ostream & out) const
+{
+    const impl & index = *this->impl_;
+    out.write(magic, sizeof magic);
+
+    write_varint(out, index.scopes.size());
+    for (const auto & scope : index.scopes) {
+        write_varint(out, scope.size());
+        for (const auto & binding : scope) {
+            write_string(out, binding.prefix);
+            write_string(out, binding.uri);
+        }
+    }
+
+    write_varint(out, index.entries.size());
+    std::uint64_t offset = 0;
+    std::uint64_t line = 0;
+    for (const auto & entry : index.entries) {
+        write_varint(out, entry.offset - offset);
+        write_varint(out, entry.line - line);
+        write_varint(out, entry.length);
+        write_varint(out, entry.scope);
+        write_string(out, entry.key);
+        offset = entry.offset;
+        line = entry.line;
+    }
+
+    if (!out) { throw std::runtime_error{"failed to write index"}; }
+}
+
+/**
+ * @brief The entries, in document order.
+ *
+ * @return the entries.
+ */
+const std::vector<xml::index_entry> & xml::offset_index::entries() const
+    throw ()
+{
+    return this->impl_->entries;
+}
+
+/**
+ * @brief The namespace declarations in scope at an entry.
+ *
+ * These are the declarations on the entry's ancestors; the entry's own
+ * declarations are part of its content.
+ *
+ * @param[in] entry an entry in this index.
+ *
+ * @return the namespace declarations in scope at @p entry.
+ *
+ * @exception std::out_of_range if @p entry is not from this index.
+ */
+const std::vector<xml::namespace_binding> &
+xml::offset_index::namespaces(const index_entry & entry) const
+{
+    return this->impl_->scopes.at(entry.scope);
+}
+
+/**
+ * @brief Find the first entry with a key.
+ *
+ * @param[in] key   a key.
+ *
+ * @return the first entry, in document order, whose key is @p key; or
+ *         @c nullptr if there is none.
+ */
+const xml::index_entry *
+xml::offset_index::find(const std::string & key) const
+{
+    const impl & index = *this->impl_;
+    const auto pos =
+        std::lower_bound(index.by_key.begin(), index.by_key.end(), key,
+                         [&index](const std::size_t i, const std::string & k) {
+                             return index.entries[i].key < k;
+                         });
+    return (pos != index.by_key.end() && index.entries[*pos].key == key)
+        ? &index.entries[*pos]
+        : nullptr;
+}
+
+/**
+ * @brief Read an indexed element.
+ *
+ * @p in is positioned at the element, and a reader is constructed to read
+ * only the element.  Depths reported by the reader are relative to the
+ * element (i.e., it is at depth 0); offsets and line numbers are those in
+ * the whole document.
+ *
+ * @param[in,out] in        the indexed document.
+ * @param[in]     entry     an entry in this index.
+ * @param[in]     options   reader options; the @c input_ options and
+ *                          @c namespaces are set from @p entry.
+ *
+ * @return a reader for the element.
+ *
+ * @exception std::runtime_error    if @p in cannot be positioned, or
+ *                                  reader setup fails.
+ * @exception std::out_of_range     if @p entry is not from this index.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::reader xml::offset_index::open(std::istream & in,
+                                    const index_entry & entry,
+                                    const reader_options & options) const
+{
+    reader_options reader_opts = options;
+    reader_opts.input_offset = entry.offset;
+    reader_opts.input_line = entry.line;
+    reader_opts.input_length = entry.length;
+    reader_opts.namespaces = this->namespaces(entry);
+
+    in.clear();
+    if (!in.seekg(std::streamoff(entry.offset))) {
+        throw std::runtime_error{"failed to seek to indexed element"};
+    }
+    return reader{in, reader_opts};
+}
@@ -0,0 +1,80 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_OFFSET_INDEX_H
+#   define XML_OFFSET_INDEX_H
+
+#   include "reader.h"
+#   include <cstdint>
+#   include <iosfwd>
+#   include <memory>
+#   include <string>
+#   include <vector>
+
+namespace xml
+{
+    struct index_entry {
+        std::uint64_t offset;
+        std::uint64_t length;
+        std::size_t line;
+        std::size_t scope;
+        std::string key;
+    };
+
+    class offset_index {
+        struct impl;
+        std::unique_ptr<impl> impl_;
+
+        offset_index();
+
+    public:
+        static offset_index build(std::istream & in,
+                                  std::size_t depth,
+                                  const std::string & key_attribute,
+                                  const reader_options & options =
+                                      reader_options());
+        static offset_index load(std::istream & in);
+
+        offset_index(const offset_index &) = delete;
+        offset_index(offset_index &&) throw ();
+        ~offset_index() throw ();
+
+        offset_index & operator=(const offset_index &) = delete;
+        offset_index & operator=(offset_index &&) throw ();
+
+        void save(std::ostream & out) const;
+
+        const std::vector<index_entry> & entries() const throw ();
+        const std::vector<namespace_binding> &
+        namespaces(const index_entry & entry) const;
+        const index_entry * find(const std::string & key) const;
+        reader open(std::istream & in,
+                    const index_entry & entry,
+                    const reader_options & options = reader_options()) const;
+    };
+}
+
+# endif // XML_OFFSET_INDEX_H
@@ -0,0 +1,448 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "parallel.h"
+# include <algorithm>
+# include <atomic>
+# include <memory>
+# include <mutex>
+# include <thread>
+
+/**
+ * @file xml/parallel.h
+ *
+ * @brief Reading many documents in parallel.
+ */
+
+/**
+ * @enum xml::document_order
+ *
+ * @brief The order in which @c xml::parallel_for_each_document handles
+ *        documents.
+ */
+
+/**
+ * @var xml::document_order xml::document_order::any
+ *
+ * @brief Documents are handled in any order.
+ *
+ * Each worker starts with a contiguous share of the documents, and workers
+ * that run out take over half of what remains of another's share.
+ */
+
+/**
+ * @var xml::document_order xml::document_order::input
+ *
+ * @brief Documents are started in the order they are given, and
+ *        @c xml::parallel_options::document_done is called for them in that
+ *        order.
+ */
+
+/**
+ * @class xml::document_context
+ *
+ * @brief The document being handled by @c xml::parallel_for_each_document.
+ */
+
+/**
+ * @var std::size_t xml::document_context::index
+ *
+ * @brief The index of the document in the list of paths.
+ */
+
+/**
+ * @var std::size_t xml::document_context::worker
+ *
+ * @brief The worker handling the document, from 0 to one less than
+ *        @c xml::parallel_worker_count.
+ *
+ * A worker handles one document at a time; so per-worker state indexed by
+ * this value needs no synchronization.
+ */
+
+/**
+ * @var const std::string & xml::document_context::path
+ *
+ * @brief The path of the document.
+ */
+
+/**
+ * @class xml::parallel_options
+ *
+ * @brief Options for @c xml::parallel_for_each_document.
+ */
+
+/**
+ * @var std::size_t xml::parallel_options::threads
+ *
+ * @brief The maximum number of workers; 0 for one per hardware thread.
+ */
+
+/**
+ * @var xml::document_order xml::parallel_options::order
+ *
+ * @brief The order in which documents are handled.
+ */
+
+/**
+ * @var xml::reader_options xml::parallel_options::reader
+ *
+ * @brief The options for the readers; @c reader_options::pipelined is
+ *        ignored.
+ */
+
+/**
+ * @var std::function<void (std::size_t)> xml::parallel_options::worker_started
+ *
+ * @brief Called on each worker's thread before it handles any document.
+ */
+
+/**
+ * @var std::function<void (std::size_t)> xml::parallel_options::worker_finished
+ *
+ * @brief Called for each worker, in order, on the calling thread once all
+ *        the documents have been handled.
+ *
+ * This is the place to merge per-worker results; no other worker is
+ * running.
+ */
+
+/**
+ * @var std::function<void (const xml::document_context &, std::exception_ptr)> xml::parallel_options::document_done
+ *
+ * @brief Called after each document is handled.
+ *
+ * @p error is the exception thrown in opening or handling the document, or
+ * @c nullptr if there was none.  With @c document_order::input, calls are
+ * made one at a time, in the order of the documents, by whichever worker
+ * completes the sequence; otherwise, each is made by the document's worker
+ * as soon as it is done.
+ *
+ * If this is not set, the first error ends the run.  Rethrowing @p error
+ * (or throwing anything else) does the same.
+ */
+
+namespace {
+
+    //
+    // A worker's share of the documents: the indices [begin, end).  The
+    // worker takes documents from the front; others steal from the back.
+    // Both ends are changed only with the mutex locked; they are atomic so
+    // that thieves can size up the ranges without locking.  The padding
+    // keeps each range in cache lines of its own.
+    //
+    struct work_range {
+        std::mutex mutex;
+        std::atomic<std::size_t> begin{0};
+        std::atomic<std::size_t> end{0};
+        char padding[64];
+    };
+
+    class batch {
+        typedef std::function<void (xml::reader &,
+                                    const xml::document_context &)> handler;
+
+        const std::vector<std::string> & paths_;
+        const handler & handler_;
+        const xml::parallel_options & options_;
+        xml::reader_options reader_options_;
+        const std::size_t workers_;
+
+        std::atomic<std::size_t> cursor_;
+        std::unique_ptr<work_range[]> ranges_;
+
+        std::atomic<bool> stopped_;
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+
+        std::mutex order_mutex_;
+        std::size_t next_done_;
+        std::vector<char> done_;
+        std::vector<std::size_t> done_workers_;
+        std::vector<std::exception_ptr> done_errors_;
+
+    public:
+        batch(const std::vector<std::string> & paths,
+              const handler & h,
+              const xml::parallel_options & options,
+              std::size_t workers);
+        batch(const batch &) = delete;
+        batch & operator=(const batch &) = delete;
+
+        void run();
+
+    private:
+        void work(std::size_t worker) throw ();
+        bool next(std::size_t worker, std::size_t & index);
+        bool steal(std::size_t worker, std::size_t & index);
+        void complete(const xml::document_context & document,
+                      std::exception_ptr error);
+        void fail(std::exception_ptr error) throw ();
+    };
+
+    batch::batch(const std::vector<std::string> & paths,
+                 const handler & h,
+                 const xml::parallel_options & options,
+                 const std::size_t workers):
+        paths_(paths),
+        handler_(h),
+        options_(options),
+        reader_options_(options.reader),
+        workers_{workers},
+        cursor_{0},
+        ranges_{new work_range[workers]},
+        stopped_{false},
+        next_done_{0}
+    {
+        this->reader_options_.pipelined = false;
+        const std::size_t n = paths.size();
+        for (std::size_t w = 0; w < workers; ++w) {
+            this->ranges_[w].begin = n * w / workers;
+            this->ranges_[w].end = n * (w + 1) / workers;
+        }
+        if (options.order == xml::document_order::input
+            && options.document_done) {
+            this->done_.resize(n);
+            this->done_workers_.resize(n);
+            this->done_errors_.resize(n);
+        }
+    }
+
+    //
+    // The calling thread is worker 0.
+    //
+    void batch::run()
+    {
+        std::vector<std::thread> threads;
+        try {
+            for (std::size_t w = 1; w < this->workers_; ++w) {
+                threads.emplace_back([this, w] { this->work(w); });
+            }
+        } catch (...) {
+            this->fail(std::current_exception());
+        }
+        this->work(0);
+        for (auto & thread : threads) { thread.join(); }
+
+        if (this->error_) { std::rethrow_exception(this->error_); }
+        if (this->options_.worker_finished) {
+            for (std::size_t w = 0; w < this->workers_; ++w) {
+                this->options_.worker_finished(w);
+            }
+        }
+    }
+
+    //
+    // Each worker keeps one reader, and resets it for each document.
+    //
+    void batch::work(const std::size_t worker) throw ()
+    {
+        try {
+            if (this->options_.worker_started) {
+                this->options_.worker_started(worker);
+            }
+            std::unique_ptr<xml::reader> in;
+            std::size_t index;
+            while (!this->stopped_.load(std::memory_order_relaxed)
+                   && this->next(worker, index)) {
+                const xml::document_context document{index,
+                                                     worker,
+                                                     this->paths_[index]};
+                std::exception_ptr error;
+                try {
+                    if (in) {
+                        in->reset(document.path);
+                    } else {
+                        in.reset(new xml::reader{document.path,
+                                                 this->reader_options_});
+                    }
+                    this->handler_(*in, document);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                this->complete(document, error);
+            }
+        } catch (...) {
+            this->fail(std::current_exception());
+        }
+    }
+
+    bool batch::next(const std::size_t worker, std::size_t & index)
+    {
+        if (this->options_.order == xml::document_order::input) {
+            index = this->cursor_.fetch_add(1, std::memory_order_relaxed);
+            return index < this->paths_.size();
+        }
+        work_range & own = this->ranges_[worker];
+        {
+            std::lock_guard<std::mutex> lock{own.mutex};
+            const std::size_t begin = own.begin.load();
+            if (begin < own.end.load()) {
+                index = begin;
+                own.begin = begin + 1;
+                return true;
+            }
+        }
+        return this->steal(worker, index);
+    }
+
+    //
+    // Take the back half of the largest remaining range.  Returns false
+    // once every range is empty.
+    //
+    bool batch::steal(const std::size_t worker, std::size_t & index)
+    {
+        for (;;) {
+            std::size_t victim = this->workers_;
+            std::size_t most = 0;
+            for (std::size_t w = 0; w < this->workers_; ++w) {
+                if (w == worker) { continue; }
+                const std::size_t begin =
+                    this->ranges_[w].begin.load(std::memory_order_relaxed);
+                const std::size_t end =
+                    this->ranges_[w].end.load(std::memory_order_relaxed);
+                if (end > begin && end - begin > most) {
+                    most = end - begin;
+                    victim = w;
+                }
+            }
+            if (victim == this->workers_) { return false; }
+
+            std::size_t first, last;
+            {
+                work_range & r = this->ranges_[victim];
+                std::lock_guard<std::mutex> lock{r.mutex};
+                const std::size_t begin = r.begin.load();
+                last = r.end.load();
+                if (begin >= last) { continue; }
+                first = begin + (last - begin) / 2;
+                r.end = first;
+            }
+            index = first;
+            if (first + 1 < last) {
+                work_range & own = this->ranges_[worker];
+                std::lock_guard<std::mutex> lock{own.mutex};
+                own.begin = first + 1;
+                own.end = last;
+            }
+            return true;
+        }
+    }
+
+    void batch::complete(const xml::document_context & document,
+                         std::exception_ptr error)
+    {
+        const auto & done = this->options_.document_done;
+        if (!done) {
+            if (error) { std::rethrow_exception(error); }
+            return;
+        }
+        if (this->options_.order != xml::document_order::input) {
+            done(document, error);
+            return;
+        }
+        std::lock_guard<std::mutex> lock{this->order_mutex_};
+        this->done_[document.index] = true;
+        this->done_workers_[document.index] = document.worker;
+        this->done_errors_[document.index] = error;
+        while (this->next_done_ < this->paths_.size()
+               && this->done_[this->next_done_]) {
+            const std::size_t index = this->next_done_++;
+            std::exception_ptr e = this->done_errors_[index];
+            this->done_errors_[index] = nullptr;
+            done(xml::document_context{index,
+                                       this->done_workers_[index],
+                                       this->paths_[index]},
+                 e);
+        }
+    }
+
+    //
+    // Record the first error, and stop the workers.
+    //
+    void batch::fail(const std::exception_ptr error) throw ()
+    {
+        std::lock_guard<std::mutex> lock{this->error_mutex_};
+        if (!this->error_) { this->error_ = error; }
+        this->stopped_.store(true);
+    }
+}
+
+/**
+ * @brief The number of workers @c xml::parallel_for_each_document uses.
+ *
+ * Use this to size per-worker state before the run.
+ *
+ * @param[in] documents the number of documents.
+ * @param[in] options   the options for the run.
+ *
+ * @return the number of workers.
+ */
+std::size_t xml::parallel_worker_count(const std::size_t documents,
+                                       const parallel_options & options)
+{
+    std::size_t threads = options.threads;
+    if (threads == 0) { threads = std::thread::hardware_concurrency(); }
+    if (threads == 0) { threads = 1; }
+    return (std::min)(threads, documents);
+}
+
+/**
+ * @brief Read each of a list of documents, in parallel.
+ *
+ * The documents are shared among a pool of workers, one of which is the
+ * calling thread; each worker reads its documents one at a time, calling
+ * @p handler with a reader positioned before the first node.  A worker
+ * reuses one reader for all of its documents (see
+ * @c xml::reader::reset), and a worker that runs out of documents takes
+ * over some of another's.
+ *
+ * Per-worker state can be kept in a container sized with
+ * @c xml::parallel_worker_count and indexed by
+ * @c xml::document_context::worker, and combined in
+ * @c xml::parallel_options::worker_finished.
+ *
+ * @param[in] paths     the paths of the documents.
+ * @param[in] handler   called to read each document; it need not read the
+ *                      whole document.
+ * @param[in] options   options for the run.
+ *
+ * @exception std::system_error     if a thread cannot be started.
+ * @exception std::bad_alloc        if memory allocation fails.
+ * @exception ...                   the first error in reading the
+ *                                  documents, or thrown by a callback;
+ *                                  see @c xml::parallel_options::document_done.
+ */
+void xml::parallel_for_each_document(
+    const std::vector<std::string> & paths,
+    const std::function<void (reader &, const document_context &)> & handler,
+    const parallel_options & options)
+{
+    const std::size_t workers = parallel_worker_count(paths.size(), options);
+    if (workers == 0) { return; }
+    batch b{paths, handler, options, workers};
+    b.run();
+}
@@ -0,0 +1,72 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_PARALLEL_H
+#   define XML_PARALLEL_H
+
+#   include "reader.h"
+#   include <cstdint>
+#   include <exception>
+#   include <functional>
+#   include <string>
+#   include <vector>
+
+namespace xml
+{
+    enum class document_order : std::uint8_t {
+        any,
+        input
+    };
+
+    struct document_context {
+        std::size_t index;
+        std::size_t worker;
+        const std::string & path;
+    };
+
+    struct parallel_options {
+        std::size_t threads = 0;
+        document_order order = document_order::any;
+        reader_options reader;
+        std::function<void (std::size_t worker)> worker_started;
+        std::function<void (std::size_t worker)> worker_finished;
+        std::function<void (const document_context & document,
+                            std::exception_ptr error)> document_done;
+    };
+
+    std::size_t parallel_worker_count(std::size_t documents,
+                                      const parallel_options & options =
+                                          parallel_options());
+
+    void parallel_for_each_document(
+        const std::vector<std::string> & paths,
+        const std::function<void (reader & in,
+                                  const document_context & document)> &
+            handler,
+        const parallel_options & options = parallel_options());
+}
+
+# endif // XML_PARALLEL_H
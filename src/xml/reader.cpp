@@ -25,7 +25,23 @@
 //
 
 # include "reader.h"
+# include "entity_resolver.h"
+# include "event_pipeline.h"
+# include "event_replay.h"
+# include "markup_scanner.h"
+# include "memory_account.h"
+# include "metrics_recorder.h"
+# include "numbers.h"
+# include "schema.h"
+# include <algorithm>
+# include <cctype>
+# include <cstring>
+# include <fstream>
 # include <istream>
+# include <mutex>
+# include <sstream>
+# include <unordered_map>
+# include <vector>
 # ifdef HAVE_XMLLITE
 #   include "xmllite_errmsg.h"
 #   include "finally.h"
@@ -41,6 +57,22 @@
  * @brief XML reader.
  */
 
+/**
+ * @file xml/string_ref.h
+ *
+ * @brief Non-owning string reference.
+ */
+
+/**
+ * @class xml::string_ref
+ *
+ * @brief A non-owning reference to a UTF-8 string.
+ *
+ * Accessors of @c xml::reader that return a @c string_ref do not allocate;
+ * the referenced string remains valid until the reader moves to another
+ * node or attribute.
+ */
+
 /**
  * @internal
  *
@@ -109,668 +141,4154 @@ size_t xml::parse_error::line() const throw ()
 }
 
 /**
- * @class xml::reader
- *
- * @brief A wrapper that abstracts commonality between libxml's XmlTextReader
- *        interface and Microsoft's XmlLite.
+ * @class xml::validation_error
  *
- * There is a lot in common here between the two underlying APIs; and that's
- * no coincidence, apparently: both APIs are based on the C# XmlReader API.
+ * @brief Exception thrown when the document read by @c xml::reader is not
+ *        valid according to @c xml::reader_options::schema.
  */
 
 /**
- * @internal
+ * @brief Construct.
  *
- * @brief Using the pimpl idiom here avoids exposing libxml2/XmlLite types in
- *        the header.
+ * @param[in] line the line number where the error occurred
+ * @param[in] msg  a message describing the validity error
  */
-struct xml::reader::impl {
-# ifdef HAVE_XMLLITE
-    IStream * input;
-    IXmlReader * reader;
-# else
-    parse_error error;
-    xmlTextReaderPtr reader;
-# endif
+xml::validation_error::validation_error(size_t line,
+                                        const std::string & msg):
+    parse_error{line, msg}
+{}
 
-    explicit impl(const std::string & filename);
-    explicit impl(std::istream & in);
-    impl(const impl &) = delete;
-    ~impl() throw ();
+/**
+ * @class xml::memory_limit_error
+ *
+ * @brief Exception thrown when @c xml::reader exceeds
+ *        @c xml::reader_options::memory_limit.
+ */
 
-    impl & operator=(const impl &) = delete;
-};
+/**
+ * @brief Construct.
+ *
+ * @param[in] line the line number where the limit was exceeded
+ * @param[in] msg  a message describing the error
+ */
+xml::memory_limit_error::memory_limit_error(size_t line,
+                                            const std::string & msg):
+    parse_error{line, msg}
+{}
 
 /**
- * @var xml::parse_error xml::reader::impl::error
+ * @enum xml::resource_limit
  *
- * @internal
+ * @brief Identifies a resource limit set in @c xml::reader_options.
+ */
+
+/**
+ * @var xml::resource_limit xml::resource_limit::depth
  *
- * @brief In the event of an error, the value of this exception is set.
+ * @brief @c xml::reader_options::max_depth.
+ */
+
+/**
+ * @var xml::resource_limit xml::resource_limit::name_length
  *
- * This value is set by the
- * <a href="http://www.xmlsoft.org/html/libxml-xmlreader.html#xmlTextReaderErrorFunc">`xmlTextReaderErrorFunc`</a>.
- * When <a href="http://www.xmlsoft.org/html/libxml-xmlreader.html#xmlTextReaderRead">`xmlTextReaderRead`</a>
- * indicates a parsing error, the value is thrown.
+ * @brief @c xml::reader_options::max_name_length.
+ */
+
+/**
+ * @var xml::resource_limit xml::resource_limit::attribute_count
  *
- * @sa xml::reader::read
+ * @brief @c xml::reader_options::max_attributes.
  */
 
 /**
- * @var xmlTextReaderPtr xml::reader::impl::reader
+ * @var xml::resource_limit xml::resource_limit::text_length
  *
- * @internal
+ * @brief @c xml::reader_options::max_text_length.
+ */
+
+/**
+ * @var xml::resource_limit xml::resource_limit::entity_expansions
  *
- * @brief The <a href="http://www.xmlsoft.org/html/libxml-xmlreader.html#xmlTextReader">`xmlTextReader`</a>.
+ * @brief @c xml::reader_options::max_entity_expansions.
  */
 
-# ifndef HAVE_XMLLITE
-extern "C" {
-    void xml_reader_errorFunc(void * arg, const char * msg,
-                              xmlParserSeverities severity,
-                              xmlTextReaderLocatorPtr locator);
-}
-# endif
+/**
+ * @var xml::resource_limit xml::resource_limit::bytes
+ *
+ * @brief @c xml::reader_options::max_bytes.
+ */
 
 /**
- * @internal
+ * @class xml::resource_limit_error
  *
- * @brief Construct using a UTF-8 file name.
+ * @brief Exception thrown when @c xml::reader exceeds one of the resource
+ *        limits set in @c xml::reader_options.
+ */
+
+/**
+ * @brief Construct.
  *
- * @param[in] filename a UTF-8-encoded file name.
+ * @param[in] line  the line number where the limit was exceeded
+ * @param[in] limit the limit that was exceeded
+ * @param[in] msg   a message describing the error
+ */
+xml::resource_limit_error::resource_limit_error(size_t line,
+                                                resource_limit limit,
+                                                const std::string & msg):
+    parse_error{line, msg},
+    limit_{limit}
+{}
+
+/**
+ * @brief The limit that was exceeded.
  *
- * @exception std::runtime_error   if:
- *                                  * @p filename cannot be opened; or
- *                                  * XmlLite/libxml2 setup fails
- * @exception std::bad_alloc       if memory allocation fails
+ * @return the limit that was exceeded.
  */
-xml::reader::impl::impl(const std::string & filename):
-# ifdef HAVE_XMLLITE
-    input{0},
-# else
-    error{0, ""},
-# endif
-    reader{0}
+xml::resource_limit xml::resource_limit_error::limit() const throw ()
 {
-# ifdef HAVE_XMLLITE
-    HRESULT hr;
-    bool succeeded = false;
-
-    hr = SHCreateStreamOnFile(
-            reinterpret_cast<LPCWSTR>(detail::utf8_to_utf16(filename).c_str()),
-            STGM_READ,
-            &this->input);
-    detail::finally f1([&]{
-        if (!succeeded && input != nullptr) { input->Release(); }
-    });
-    if (FAILED(hr)) {
-        if (hr == E_OUTOFMEMORY) {
-            throw std::bad_alloc{};
-        }
-        throw std::runtime_error{"failed to open file \"" + filename
-                                 + '\"'};
-    }
+    return this->limit_;
+}
 
-    hr = CreateXmlReader(__uuidof(IXmlReader),
-                         reinterpret_cast<void **>(&this->reader),
-                         0);
-    detail::finally f2([&]{
-        if (!succeeded && this->reader != nullptr) { this->reader->Release(); }
-    });
-    if (FAILED(hr)) {
-        if (hr == E_OUTOFMEMORY) {
-            throw std::bad_alloc{};
-        }
-        throw std::runtime_error{"failed to create XML reader"};
-    }
+/**
+ * @class xml::cancelled_error
+ *
+ * @brief Exception thrown when @c xml::reader::read finds that reading has
+ *        been cancelled.
+ *
+ * @sa xml::reader_options::cancel
+ */
 
-    hr = this->reader->SetInput(this->input);
-    if (FAILED(hr)) {
-        throw std::runtime_error{"failed to set input for XML reader"};
-    }
+/**
+ * @brief Construct.
+ */
+xml::cancelled_error::cancelled_error():
+    std::runtime_error{"reading was cancelled"}
+{}
 
-    succeeded = true;
-# else
-    static const char * const encoding = 0;
-    static const int options = 0;
-    this->reader = xmlReaderForFile(filename.c_str(), encoding, options);
-    if (!this->reader) {
-        throw std::runtime_error{"failed to create XML reader"};
-    }
-    xmlTextReaderSetErrorHandler(this->reader, xml_reader_errorFunc, this);
-# endif
-}
+/**
+ * @class xml::reader_options
+ *
+ * @brief Options that control the behavior of an @c xml::reader.
+ *
+ * The @c max_ options limit the resources a reader will spend on a
+ * document; they are intended for untrusted input.  A limit of 0 means no
+ * limit.  Exceeding a limit causes @c xml::reader::read to throw
+ * @c xml::resource_limit_error.
+ */
 
-# ifdef HAVE_XMLLITE
-namespace
-{
-    class com_istream : public ::IStream {
-        std::istream & in_;
-        LONG count_;
+/**
+ * @var bool xml::reader_options::collect_stats
+ *
+ * @brief Whether the reader maintains the counters reported by
+ *        @c xml::reader::stats.
+ *
+ * Collecting statistics adds clock reads to each call to
+ * @c xml::reader::read; so it is off by default.
+ */
 
-    public:
-        explicit com_istream(std::istream & in);
-        com_istream(const com_istream &) = delete;
+/**
+ * @var std::size_t xml::reader_options::memory_limit
+ *
+ * @brief The maximum number of bytes the underlying parser may have
+ *        allocated at any one time; 0 means no limit.
+ *
+ * An allocation that would exceed the limit fails, and
+ * @c xml::reader::read throws @c xml::memory_limit_error.
+ *
+ * Using this option requires that @c xml::install_memory_hooks has been
+ * called.  It is not supported with the XmlLite backend.
+ */
 
-        com_istream & operator=(const com_istream &) = delete;
+/**
+ * @var xml::memory_resource * xml::reader_options::memory
+ *
+ * @brief The memory resource used for the underlying parser's allocations;
+ *        @c nullptr to use @c std::malloc.
+ *
+ * The resource must remain valid until every block allocated from it has
+ * been deallocated; in practice, until the reader is destroyed.
+ *
+ * Using this option requires that @c xml::install_memory_hooks has been
+ * called.  It is not supported with the XmlLite backend.
+ */
 
-        //
-        // IUnknown implementation
-        //
-        virtual HRESULT __stdcall QueryInterface(const IID & iid, void ** ppv);
-        virtual ULONG __stdcall AddRef();
-        virtual ULONG __stdcall Release();
+/**
+ * @var std::size_t xml::reader_options::max_depth
+ *
+ * @brief The maximum node depth.
+ */
 
-        //
-        // ISequentialStream implementation
-        //
-        virtual HRESULT __stdcall Read(void * pv, ULONG cb, ULONG * pcbRead);
-        virtual HRESULT __stdcall Write(const void * pv, ULONG cb, ULONG * pcbWritten);
+/**
+ * @var std::size_t xml::reader_options::max_name_length
+ *
+ * @brief The maximum length, in bytes, of an element or attribute's
+ *        qualified name.
+ */
 
-        //
-        // IStream implementation
-        //
-        virtual HRESULT __stdcall Seek(LARGE_INTEGER dlibMove, DWORD dwOrigin,
-                                       ULARGE_INTEGER * plibNewPosition);
-        virtual HRESULT __stdcall SetSize(ULARGE_INTEGER libNewSize);
-        virtual HRESULT __stdcall CopyTo(IStream * pstm, ULARGE_INTEGER cb,
-                                         ULARGE_INTEGER * pcbRead,
-                                         ULARGE_INTEGER * pcbWritten);
-        virtual HRESULT __stdcall Commit(DWORD grfCommitFlags);
-        virtual HRESULT __stdcall Revert();
-        virtual HRESULT __stdcall LockRegion(ULARGE_INTEGER libOffset,
-                                             ULARGE_INTEGER cb,
-                                             DWORD dwLockType);
-        virtual HRESULT __stdcall UnlockRegion(ULARGE_INTEGER libOffset,
-                                               ULARGE_INTEGER cb,
-                                               DWORD dwLockType);
-        virtual HRESULT __stdcall Stat(STATSTG * pstatstg, DWORD grfStatFlag);
-        virtual HRESULT __stdcall Clone(IStream ** ppstm);
-    };
+/**
+ * @var std::size_t xml::reader_options::max_attributes
+ *
+ * @brief The maximum number of attributes (including namespace
+ *        declarations) on an element.
+ */
 
-}
-# else
-extern "C" {
-    int xml_reader_inputReadCallback(void * context, char * buffer, int len);
-    int xml_reader_inputCloseCallback(void * context);
-}
-# endif
+/**
+ * @var std::size_t xml::reader_options::max_text_length
+ *
+ * @brief The maximum length, in bytes, of a text, CDATA, whitespace or
+ *        comment node.
+ */
 
 /**
- * @internal
+ * @var std::size_t xml::reader_options::max_entity_expansions
  *
- * @brief Construct using an input stream.
+ * @brief The maximum number of entity references in the document.
  *
- * @param[in,out] in   an input stream.
+ * With libxml2, this bounds the entity reference nodes the reader reports;
+ * libxml2's own amplification checks remain in effect as well.  With
+ * XmlLite, this sets the reader's @c MaxEntityExpansion property.
  *
- * @exception std::runtime_error   if XmlLite/libxml2 setup fails
- * @exception std::bad_alloc       if memory allocation fails
+ * With libxml2, this cannot be combined with @c entities: resolving
+ * entities makes the parser substitute them as it goes, so no references
+ * would be counted.  A reader constructed with both throws
+ * @c std::logic_error.
  */
-xml::reader::impl::impl(std::istream & in):
-# ifdef HAVE_XMLLITE
-    input{new com_istream{in}},
-# else
-    error{0, ""},
-# endif
-    reader{0}
-{
-# ifdef HAVE_XMLLITE
-    bool succeeded = false;
-    detail::finally f1([&]{
-        if (!succeeded && input != nullptr) { input->Release(); }
-    });
 
-    HRESULT hr;
+/**
+ * @var std::uint64_t xml::reader_options::max_bytes
+ *
+ * @brief The maximum number of input bytes the parser may consume.
+ *
+ * The limit is enforced as the input is passed to the parser; so it is
+ * detected before the parser buffers more than this.  With
+ * @c multiple_documents, it applies to each document.
+ */
 
-    static IMalloc * const malloc = 0;
-    IXmlReaderInput * xml_input = 0;
-    static const WCHAR * const base_uri = 0;
-    hr = CreateXmlReaderInputWithEncodingName(this->input,
-                                              malloc,
-                                              L"utf-8",
-                                              FALSE, // Require UTF-8.
-                                              base_uri,
-                                              &xml_input);
-    if (FAILED(hr)) {
-        throw std::runtime_error{"failed to create XML input"};
-    }
+/**
+ * @var std::shared_ptr<const xml::entity_resolver> xml::reader_options::entities
+ *
+ * @brief The resolver for external DTDs and entities.
+ *
+ * By default, external DTDs are not loaded.  When a resolver is set, the
+ * reader loads the external DTD subset, applies its default attributes and
+ * substitutes entities.  The external subset and any other external
+ * entities are loaded only through the resolver; network access is
+ * disabled.
+ *
+ * Since the elements of an entity's replacement text have no tags in the
+ * input, a resolver cannot be combined with @c #track_offsets.
+ *
+ * This option is not supported with the XmlLite backend.
+ */
 
-    hr = CreateXmlReader(__uuidof(IXmlReader),
-                         reinterpret_cast<void **>(&this->reader),
-                         malloc);
-    detail::finally f2([&]{
-        if (!succeeded && this->reader != nullptr) { this->reader->Release(); }
-    });
-    if (FAILED(hr)) {
-        throw std::runtime_error{"failed to create XML reader"};
-    }
+/**
+ * @var std::shared_ptr<const xml::schema> xml::reader_options::schema
+ *
+ * @brief A schema against which to validate the document as it is read.
+ *
+ * The first validity error causes @c xml::reader::read to throw
+ * @c xml::validation_error.
+ *
+ * This option is not supported with the XmlLite backend.
+ */
 
-    hr = this->reader->SetInput(xml_input);
-    if (FAILED(hr)) {
-        throw std::runtime_error{"failed to set input for XML reader"};
-    }
+/**
+ * @var bool xml::reader_options::track_offsets
+ *
+ * @brief Whether the reader locates tags in the input, for
+ *        @c xml::reader::tag_location.
+ *
+ * Locating tags requires a scan of the raw input in addition to parsing;
+ * so it is off by default.  Offsets are only meaningful for input in an
+ * ASCII-compatible encoding.  This option cannot be combined with
+ * @c #entities.
+ */
 
-    succeeded = true;
-# else
-    static const char * const base_uri = 0;
-    static const char * const encoding = 0;
-    static const int options = 0;
-    this->reader = xmlReaderForIO(xml_reader_inputReadCallback,
-                                  xml_reader_inputCloseCallback,
-                                  &in,
-                                  base_uri,
-                                  encoding,
-                                  options);
-    if (!this->reader) {
-        throw std::runtime_error{"failed to create XML reader"};
-    }
-    xmlTextReaderSetErrorHandler(this->reader,
-                                 xml_reader_errorFunc,
-                                 &this->error);
-# endif
-}
+/**
+ * @var std::uint64_t xml::reader_options::input_offset
+ *
+ * @brief The byte offset of the input within the document it was taken
+ *        from.
+ *
+ * When reading from part of a larger document (for instance, at an offset
+ * recorded by @c xml::index), set this to the part's offset so that
+ * @c xml::reader::tag_location reports offsets within the whole document.
+ *
+ * If this is nonzero, @c #fragment is set, or @c #namespaces or
+ * @c #open_elements is not empty, the input is read as element content: it may contain any number of
+ * elements and character data, but no XML declaration or document type
+ * declaration.  Whitespace outside any element is not reported.
+ */
 
 /**
- * @fn xml::reader::impl::impl(const impl &)
+ * @var std::size_t xml::reader_options::input_line
  *
- * @internal
+ * @brief The line number of the start of the input within the document it
+ *        was taken from.
+ */
+
+/**
+ * @var std::size_t xml::reader_options::input_column
  *
- * @brief Not copyable.
+ * @brief The column of the start of the input within the document it was
+ *        taken from.
  */
 
 /**
- * @internal
+ * @var std::uint64_t xml::reader_options::input_length
  *
- * @brief Destroy.
+ * @brief The number of bytes to read from the input; 0 to read the whole
+ *        input.
+ *
+ * This is only supported for readers constructed from a @c std::istream.
  */
-xml::reader::impl::~impl() throw ()
-{
-# ifdef HAVE_XMLLITE
-    this->reader->Release();
-    this->input->Release();
-# else
-    xmlFreeTextReader(this->reader);
-# endif
-}
 
 /**
- * @fn xml::reader::impl & xml::reader::impl::operator=(const impl &)
+ * @var std::vector<xml::namespace_binding> xml::reader_options::namespaces
  *
- * @internal
+ * @brief Namespace declarations in scope at the start of the input.
  *
- * @brief Not copyable.
+ * @sa #input_offset
  */
 
 /**
- * @enum xml::reader::node_type_id
+ * @var std::vector<std::string> xml::reader_options::open_elements
  *
- * @brief The node type identifier.
+ * @brief The qualified names of the elements open at the start of the
+ *        input, outermost first.
  *
- * Due to the common heritage of XmlTextReader and XmlLite, the underlying
- * APIs report consistent values that can be passed through directly to
- * the @c xml::reader interface.
+ * The input is expected to close these elements.  Depths reported by the
+ * reader include them, although the reader does not report their start.
  *
- * @sa http://xmlsoft.org/html/libxml-xmlreader.html#xmlReaderTypes
- * @sa http://msdn.microsoft.com/en-us/library/ms753141.aspx
+ * @sa xml::reader_checkpoint
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::none_id
+ * @var bool xml::reader_options::fragment
  *
- * @brief The &ldquo;null&rdquo; type identifier.
+ * @brief Whether the input is a fragment: a sequence of elements and
+ *        character data with no single document element.
+ *
+ * The top-level nodes of the fragment are reported at depth 0.  Prefixes
+ * declared in @c #namespaces may be used throughout the fragment.
+ *
+ * @sa #input_offset
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::element_id
+ * @var bool xml::reader_options::multiple_documents
  *
- * @brief Element identifier.
+ * @brief Whether the input is a sequence of documents.
+ *
+ * Each document ends with the end of its document element; anything after
+ * that (other than whitespace) begins the next document.  The reader
+ * reports the nodes of one document at a time; @c xml::reader::next_document
+ * moves on to the next, reusing the parser.
+ *
+ * This is ignored if the input is read as element content.
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::attribute_id
+ * @var std::shared_ptr<const std::atomic<bool>> xml::reader_options::cancel
  *
- * @brief Attribute identifier.
+ * @brief A flag that cancels reading when set.
+ *
+ * The flag is checked each time @c xml::reader::read is called; once it is
+ * set, @c xml::reader::read throws @c xml::cancelled_error.  It may be set
+ * from any thread.  A pipelined reader checks it on both threads; so nodes
+ * already parsed are not returned once it is set.
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::text_id
+ * @var bool xml::reader_options::pipelined
  *
- * @brief Text identifier.
+ * @brief Whether the input is parsed on a separate thread.
+ *
+ * The parser runs ahead of the reader on a thread of its own, passing the
+ * nodes it reads to the reading thread in blocks; so the work of handling
+ * one node overlaps with parsing those that follow.  This pays off when
+ * there is a core to spare and the handling of each node is substantial.
+ *
+ * Column numbers are passed along with the nodes.  The values of
+ * @c xml::reader::byte_offset and @c xml::reader::stats are updated with
+ * each block, and so run ahead of the current node by up to a block.
+ * Offsets are not tracked: @c xml::reader::tag_location,
+ * @c xml::reader::outer_span, @c xml::reader::inner_span, and
+ * @c xml::reader::checkpoint throw @c std::logic_error.  Only the first
+ * document in the input is read.  Errors are reported by
+ * @c xml::reader::read after the nodes that precede them.
+ *
+ * @sa xml::reader::reader(const event_recording &)
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::cdata_id
+ * @class xml::read_budget
  *
- * @brief CDATA identifier.
+ * @brief The amount of work done by one call to @c xml::reader::read_for.
+ *
+ * A limit of 0 means no limit.
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::processing_instruction_id
+ * @var std::size_t xml::read_budget::nodes
  *
- * @brief Processing instruction identifier.
+ * @brief The maximum number of nodes to read.
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::comment_id
+ * @var std::chrono::nanoseconds xml::read_budget::time
  *
- * @brief Comment identifier.
+ * @brief The time after which to stop reading.
+ *
+ * The time is checked after each node; so reading continues past it until
+ * the node being read is complete.
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::document_type_id
+ * @class xml::reader_checkpoint
  *
- * @brief Document type identifier.
+ * @brief A position in a document from which reading can be resumed.
+ *
+ * A checkpoint holds the byte offset, line and column of a position just
+ * after a tag, along with the elements open and the namespace declarations
+ * in scope there.  It is taken with @c xml::reader::checkpoint, and a
+ * reader for the same document can be constructed from it that continues
+ * from that position.
+ *
+ * Declarations in the document type declaration are not part of a
+ * checkpoint; so a document that relies on them (e.g., for entities or
+ * default attributes) cannot be resumed faithfully.
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::whitespace_id
+ * @var std::uint64_t xml::reader_checkpoint::offset
  *
- * @brief Whitespace identifier.
+ * @brief The byte offset of the position.
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::end_element_id
+ * @var std::size_t xml::reader_checkpoint::line
  *
- * @brief Element end tag identifier.
+ * @brief The line of the position.
+ */
+
+/**
+ * @var std::size_t xml::reader_checkpoint::column
  *
- * Unlike SAX, where you get an &ldquo;end of element&rdquo; callback at
- * the logical element boundary, @c #node_type only returns this value
- * when the current node is a literal end tag.
+ * @brief The column of the position, in bytes from 1.
  */
 
 /**
- * @var xml::reader::node_type_id xml::reader::xml_declaration_id
+ * @var std::vector<std::string> xml::reader_checkpoint::open_elements
  *
- * @brief XML declaration identifier.
+ * @brief The qualified names of the elements open at the position,
+ *        outermost first.
  */
 
 /**
- * @brief Construct from a file name.
+ * @var std::vector<xml::namespace_binding> xml::reader_checkpoint::namespaces
  *
- * @param[in] filename  the full path to a file.
+ * @brief The namespace declarations in scope at the position.
+ */
+
+namespace
+{
+    const char checkpoint_header[] = "xmlrw-checkpoint 1";
+
+    void write_field(std::ostream & out, const std::string & value)
+    {
+        out << value.size() << ':' << value;
+    }
+
+    bool read_field(std::istream & in, std::string & value)
+    {
+        std::size_t size = 0;
+        if (!(in >> size) || in.get() != ':') { return false; }
+        value.resize(size);
+        return size == 0 || in.read(&value[0], size);
+    }
+}
+
+/**
+ * @brief Serialize the checkpoint.
  *
- * @exception std::runtime_error    if opening @p filename or creating the
- *                                  underlying XML reader fails.
- * @exception std::bad_alloc        if memory allocation fails.
+ * The result is line-oriented text; @c #parse reads it back.
+ *
+ * @return the serialized checkpoint.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
  */
-xml::reader::reader(const std::string & filename):
-    impl_{new impl{filename}}
-{}
+const std::string xml::reader_checkpoint::str() const
+{
+    std::ostringstream out;
+    out << checkpoint_header << '\n'
+        << "offset " << this->offset << '\n'
+        << "line " << this->line << '\n'
+        << "column " << this->column << '\n';
+    for (const auto & name : this->open_elements) {
+        out << "element ";
+        write_field(out, name);
+        out << '\n';
+    }
+    for (const auto & ns : this->namespaces) {
+        out << "namespace ";
+        write_field(out, ns.prefix);
+        out << ' ';
+        write_field(out, ns.uri);
+        out << '\n';
+    }
+    return out.str();
+}
 
 /**
- * @brief Construct from an input stream.
+ * @brief Deserialize a checkpoint.
  *
- * @param[in,out] in   an input stream.
+ * @param[in] str   a checkpoint serialized with @c #str.
  *
- * @exception std::runtime_error    if creating the underlying XML reader
- *                                  fails.
+ * @return the checkpoint.
+ *
+ * @exception std::invalid_argument if @p str is not a serialized
+ *                                  checkpoint.
  * @exception std::bad_alloc        if memory allocation fails.
  */
-xml::reader::reader(std::istream & in):
-    impl_{new impl{in}}
-{}
+xml::reader_checkpoint xml::reader_checkpoint::parse(const std::string & str)
+{
+    std::istringstream in{str};
+    std::string header;
+    if (!std::getline(in, header) || header != checkpoint_header) {
+        throw std::invalid_argument{"not a reader checkpoint"};
+    }
+    reader_checkpoint result;
+    std::string key;
+    while (in >> key) {
+        bool ok = true;
+        if (key == "offset") {
+            ok = !!(in >> result.offset);
+        } else if (key == "line") {
+            ok = !!(in >> result.line);
+        } else if (key == "column") {
+            ok = !!(in >> result.column);
+        } else if (key == "element") {
+            std::string name;
+            ok = in.get() == ' ' && read_field(in, name);
+            result.open_elements.push_back(std::move(name));
+        } else if (key == "namespace") {
+            namespace_binding ns;
+            ok = in.get() == ' ' && read_field(in, ns.prefix)
+                && in.get() == ' ' && read_field(in, ns.uri);
+            result.namespaces.push_back(std::move(ns));
+        } else {
+            ok = false;
+        }
+        if (!ok) { throw std::invalid_argument{"invalid reader checkpoint"}; }
+    }
+    return result;
+}
 
 /**
- * @fn xml::reader::reader(const reader &)
+ * @class xml::namespace_binding
  *
- * @brief Not copyable.
+ * @brief A namespace declaration.
+ *
+ * An empty @c prefix denotes the default namespace.
  */
 
 /**
- * @brief Move constuct.
+ * @class xml::source_location
+ *
+ * @brief The location of a tag in the input.
+ *
+ * @c offset is the byte offset of the tag's `<`; @c end is the offset just
+ * past its `>`; and @c line is the line on which the tag starts.
+ *
+ * @sa xml::reader::tag_location
  */
-xml::reader::reader(reader && r) throw ():
-    impl_{std::move(r.impl_)}
-{}
 
 /**
- * @fn xml::reader & xml::reader::operator=(const reader &)
+ * @class xml::reader_stats
  *
- * @brief Not copyable.
+ * @brief Performance counters for an @c xml::reader.
+ *
+ * @sa xml::reader::stats
+ */
+
+/**
+ * @var const std::size_t xml::reader_stats::node_type_count
+ *
+ * @brief The number of elements in @c #node_counts.
+ */
+
+/**
+ * @var std::uint64_t xml::reader_stats::bytes_consumed
+ *
+ * @brief The number of input bytes consumed by the parser.
+ */
+
+/**
+ * @var std::array<std::uint64_t, xml::reader_stats::node_type_count> xml::reader_stats::node_counts
+ *
+ * @brief The number of nodes read, indexed by @c xml::reader::node_type_id.
+ */
+
+/**
+ * @var std::size_t xml::reader_stats::max_depth
+ *
+ * @brief The maximum node depth seen.
+ */
+
+/**
+ * @var std::chrono::nanoseconds xml::reader_stats::read_time
+ *
+ * @brief The cumulative time spent in @c xml::reader::read.
+ *
+ * This includes @c #input_wait_time.
+ */
+
+/**
+ * @var std::chrono::nanoseconds xml::reader_stats::input_wait_time
+ *
+ * @brief The cumulative time spent waiting for input.
+ *
+ * This is only measured for readers constructed from a @c std::istream.
+ */
+
+/**
+ * @var std::uint64_t xml::reader_stats::string_allocations
+ *
+ * @brief The number of strings allocated by the name and value accessors.
+ */
+
+/**
+ * @var std::size_t xml::reader_stats::memory_in_use
+ *
+ * @brief The number of bytes currently allocated by the underlying parser.
+ *
+ * This is only measured for readers with a @c reader_options::memory_limit
+ * or @c reader_options::memory.
+ */
+
+/**
+ * @var std::size_t xml::reader_stats::memory_high_water
+ *
+ * @brief The largest value @c #memory_in_use has reached.
  */
 
 /**
- * @brief Move assign.
+ * @class xml::reader
+ *
+ * @brief A wrapper that abstracts commonality between libxml's XmlTextReader
+ *        interface and Microsoft's XmlLite.
+ *
+ * There is a lot in common here between the two underlying APIs; and that's
+ * no coincidence, apparently: both APIs are based on the C# XmlReader API.
+ */
+
+namespace
+{
+    //
+    // Divides a stream into documents.  Input is read ahead into a buffer
+    // and scanned for tags, so that each document can be ended just after
+    // the end of its document element.
+    //
+    struct document_framer {
+        xml::detail::markup_scanner scanner;
+        std::string buffer;
+        std::size_t buffer_pos;
+        std::size_t depth;
+        bool bounded;
+        std::uint64_t boundary;
+        std::uint64_t offset;
+
+        document_framer() throw ();
+
+        void find_boundary() throw ();
+    };
+
+    //
+    // The input from a std::istream, as presented to the underlying parser:
+    // a synthetic prefix, then the stream (optionally limited to a number of
+    // bytes), then a synthetic suffix.  The prefix and suffix wrap input
+    // that is read as element content.  In place of a stream, the input may
+    // be a buffer in memory.
+    //
+    struct stream_input {
+        std::istream * in;
+        const char * data_begin;
+        const char * data;
+        const char * data_end;
+        xml::reader_stats * stats;
+        xml::detail::markup_scanner * scanner;
+        std::string prefix;
+        std::string suffix;
+        std::size_t prefix_pos;
+        std::size_t suffix_pos;
+        bool limited;
+        std::uint64_t remaining;
+        std::uint64_t max_bytes;
+        std::uint64_t document_start;
+        bool max_bytes_exceeded;
+        bool stream_done;
+        std::uint64_t delivered;
+        std::unique_ptr<document_framer> framer;
+
+        explicit stream_input(std::istream * in) throw ();
+        stream_input(const char * data, std::size_t size) throw ();
+
+        std::streamsize read(char * buffer, std::streamsize len);
+        bool next_document();
+
+    private:
+        std::streamsize read_stream(char * buffer, std::streamsize len);
+        std::streamsize read_document(char * buffer, std::streamsize len);
+        std::streamsize fill_framer();
+    };
+}
+
+# ifndef HAVE_XMLLITE
+namespace
+{
+    //
+    // Context for xml_reader_errorFunc.
+    //
+    struct reader_error {
+        xml::parse_error last;
+        bool invalid;
+        std::size_t line_offset;
+    };
+}
+# endif
+
+/**
+ * @internal
+ *
+ * @brief Using the pimpl idiom here avoids exposing libxml2/XmlLite types in
+ *        the header.
+ */
+struct xml::reader::impl {
+# ifdef HAVE_XMLLITE
+    IStream * input;
+    IXmlReader * reader;
+# else
+    reader_error error;
+    xmlTextReaderPtr reader;
+    stream_input input;
+# endif
+    detail::memory_account * const memory;
+    const bool collect_stats;
+    reader_stats stats;
+
+    enum class document_state { not_started, in_progress, finished };
+    document_state document;
+    std::chrono::steady_clock::time_point document_start;
+    std::uint64_t document_nodes;
+
+    const reader_options options;
+    const bool limited;
+    std::size_t entity_expansions;
+
+    std::unique_ptr<std::istream> file;
+    std::unique_ptr<detail::markup_scanner> scanner;
+    stream_input * source;
+    const bool wrapped;
+    std::size_t synthetic_elements;
+    const std::size_t line_offset;
+    bool located;
+    source_location location;
+    std::size_t location_end_line;
+    std::size_t location_end_column;
+    detail::markup_scanner::tag_kind location_kind;
+
+    struct open_tag {
+        source_location location;
+        std::size_t end_line;
+    };
+    std::vector<open_tag> open_tags;
+    bool spanned;
+    source_location outer_span;
+    source_location inner_span;
+
+    std::vector<std::string> namespace_uris;
+    std::unordered_map<std::string, std::size_t> namespace_ids;
+# ifdef HAVE_XMLLITE
+    std::string namespace_uri_utf8;
+    std::string name_utf8;
+    std::string value_utf8;
+# else
+    std::unordered_map<const xmlChar *, std::size_t> namespace_ids_by_name;
+    const xmlChar * last_namespace_uri;
+    std::size_t last_namespace_id;
+# endif
+
+    impl(const std::string & filename, const reader_options & options);
+    impl(std::istream & in, const reader_options & options);
+    impl(const char * data, std::size_t size, const reader_options & options);
+    impl(stream_input && in, const reader_options & options);
+    impl(const impl &) = delete;
+    ~impl() throw ();
+
+    impl & operator=(const impl &) = delete;
+
+    void set_input(stream_input & in);
+# ifndef HAVE_XMLLITE
+    void set_schema();
+# endif
+    bool read();
+    bool next_document();
+    void reset(const std::string & filename);
+    void restart();
+    bool read_node();
+    void locate() throw ();
+    void track_span();
+    std::size_t line() const throw ();
+    std::size_t depth() const throw ();
+    void check_limits();
+    void record_node() throw ();
+    std::uint64_t bytes_consumed() const throw ();
+    std::size_t intern_namespace(const string_ref & uri);
+};
+
+/**
+ * @var reader_error xml::reader::impl::error
+ *
+ * @internal
+ *
+ * @brief In the event of an error, the value of this exception is set;
+ *        and validity errors are flagged.
+ *
+ * This value is set by the
+ * <a href="http://www.xmlsoft.org/html/libxml-xmlreader.html#xmlTextReaderErrorFunc">`xmlTextReaderErrorFunc`</a>.
+ * When <a href="http://www.xmlsoft.org/html/libxml-xmlreader.html#xmlTextReaderRead">`xmlTextReaderRead`</a>
+ * indicates a parsing error, the value is thrown.
+ *
+ * @sa xml::reader::read
+ */
+
+/**
+ * @var xmlTextReaderPtr xml::reader::impl::reader
+ *
+ * @internal
+ *
+ * @brief The <a href="http://www.xmlsoft.org/html/libxml-xmlreader.html#xmlTextReader">`xmlTextReader`</a>.
+ */
+
+/**
+ * @var stream_input xml::reader::impl::input
+ *
+ * @internal
+ *
+ * @brief Context passed to the input read callback when reading from a
+ *        @c std::istream.
+ */
+
+/**
+ * @var xml::detail::memory_account * const xml::reader::impl::memory
+ *
+ * @internal
+ *
+ * @brief The account charged for the underlying parser's allocations, or
+ *        @c nullptr if allocations are not accounted.
+ */
+
+/**
+ * @var const bool xml::reader::impl::collect_stats
+ *
+ * @internal
+ *
+ * @brief Whether @c #stats is updated.
+ *
+ * @sa xml::reader_options::collect_stats
+ */
+
+/**
+ * @var xml::reader_stats xml::reader::impl::stats
+ *
+ * @internal
+ *
+ * @brief Counters accumulated when @c #collect_stats is @c true.
+ */
+
+/**
+ * @var xml::reader::impl::document_state xml::reader::impl::document
+ *
+ * @internal
+ *
+ * @brief Progress through the document, for the process-wide metrics.
+ */
+
+/**
+ * @var std::chrono::steady_clock::time_point xml::reader::impl::document_start
+ *
+ * @internal
+ *
+ * @brief When the document was first read.
+ */
+
+/**
+ * @var std::uint64_t xml::reader::impl::document_nodes
+ *
+ * @internal
+ *
+ * @brief The number of nodes read from the document.
+ */
+
+/**
+ * @var const xml::reader_options xml::reader::impl::options
+ *
+ * @internal
+ *
+ * @brief The options the reader was constructed with.
+ */
+
+/**
+ * @var const bool xml::reader::impl::limited
+ *
+ * @internal
+ *
+ * @brief Whether any resource limit other than @c max_entity_expansions
+ *        under XmlLite must be checked when reading.
+ */
+
+/**
+ * @var std::size_t xml::reader::impl::entity_expansions
+ *
+ * @internal
+ *
+ * @brief The number of entity references read.
+ */
+
+/**
+ * @var std::unique_ptr<std::istream> xml::reader::impl::file
+ *
+ * @internal
+ *
+ * @brief The file being read, when a reader constructed from a file name
+ *        needs to process the input itself.
+ *
+ * @sa needs_stream_input
+ */
+
+/**
+ * @var std::unique_ptr<xml::detail::markup_scanner> xml::reader::impl::scanner
+ *
+ * @internal
+ *
+ * @brief Locates tags in the input, if @c reader_options::track_offsets
+ *        is set.
+ */
+
+/**
+ * @var stream_input * xml::reader::impl::source
+ *
+ * @internal
+ *
+ * @brief The input, if it is read through a @c stream_input; otherwise
+ *        @c nullptr.
+ */
+
+/**
+ * @var const bool xml::reader::impl::wrapped
+ *
+ * @internal
+ *
+ * @brief Whether the input is read as element content, wrapped in a
+ *        synthetic element.
+ *
+ * The synthetic element is at depth 0; it is skipped by @c #read, and
+ * depths reported to the user are one less than those of the underlying
+ * reader.
+ */
+
+/**
+ * @var std::size_t xml::reader::impl::synthetic_elements
+ *
+ * @internal
+ *
+ * @brief The number of synthetic start tags at the beginning of the input
+ *        that have yet to be skipped.
+ *
+ * These are the generic wrapper, if @c #wrapped; or else the elements in
+ * @c reader_options::open_elements.
+ */
+
+/**
+ * @var const std::size_t xml::reader::impl::line_offset
+ *
+ * @internal
+ *
+ * @brief Added to the underlying reader's line numbers.
+ *
+ * @sa xml::reader_options::input_line
+ */
+
+/**
+ * @var bool xml::reader::impl::located
+ *
+ * @internal
+ *
+ * @brief Whether @c #location holds the location of the current node's tag.
+ */
+
+/**
+ * @var xml::source_location xml::reader::impl::location
+ *
+ * @internal
+ *
+ * @brief The location of the current node's tag.
+ */
+
+/**
+ * @var std::size_t xml::reader::impl::location_end_line
+ *
+ * @internal
+ *
+ * @brief The line of the byte following the current node's tag.
+ */
+
+/**
+ * @var std::size_t xml::reader::impl::location_end_column
+ *
+ * @internal
+ *
+ * @brief The column of the byte following the current node's tag.
+ */
+
+/**
+ * @var xml::detail::markup_scanner::tag_kind xml::reader::impl::location_kind
+ *
+ * @internal
+ *
+ * @brief The kind of the current node's tag.
+ */
+
+/**
+ * @var std::vector<xml::reader::impl::open_tag> xml::reader::impl::open_tags
+ *
+ * @internal
+ *
+ * @brief The start tags of the open elements that have tags, with the line
+ *        of the byte following each.
+ */
+
+/**
+ * @var bool xml::reader::impl::spanned
+ *
+ * @internal
+ *
+ * @brief Whether @c #outer_span and @c #inner_span hold the spans of the
+ *        element ended by the current node.
+ */
+
+/**
+ * @var xml::source_location xml::reader::impl::outer_span
+ *
+ * @internal
+ *
+ * @brief The span of the element ended by the current node, including its
+ *        tags.
+ */
+
+/**
+ * @var xml::source_location xml::reader::impl::inner_span
+ *
+ * @internal
+ *
+ * @brief The span of the content of the element ended by the current node.
+ */
+
+/**
+ * @var std::vector<std::string> xml::reader::impl::namespace_uris
+ *
+ * @internal
+ *
+ * @brief Interned namespace URIs; the URI with identifier @e n is at index
+ *        @e n - 1.
+ */
+
+/**
+ * @var std::unordered_map<std::string, std::size_t> xml::reader::impl::namespace_ids
+ *
+ * @internal
+ *
+ * @brief Map of interned namespace URIs to their identifiers.
+ */
+
+/**
+ * @var std::string xml::reader::impl::name_utf8
+ *
+ * @internal
+ *
+ * @brief Storage for the UTF-8 name referenced by @c
+ *        xml::reader::local_name_ref or @c xml::reader::qualified_name_ref.
+ */
+
+/**
+ * @var std::string xml::reader::impl::value_utf8
+ *
+ * @internal
+ *
+ * @brief Storage for the UTF-8 value referenced by @c
+ *        xml::reader::value_ref.
+ */
+
+/**
+ * @var std::unordered_map<const xmlChar *, std::size_t> xml::reader::impl::namespace_ids_by_name
+ *
+ * @internal
+ *
+ * @brief Map of namespace URIs in libxml2's dictionary to their
+ *        identifiers.
+ *
+ * libxml2 interns namespace URIs in the reader's dictionary; so a pointer
+ * identifies a URI for the lifetime of the reader, and the identifier can
+ * usually be found without hashing the URI.
+ */
+
+/**
+ * @var const xmlChar * xml::reader::impl::last_namespace_uri
+ *
+ * @internal
+ *
+ * @brief The most recently looked-up dictionary namespace URI.
+ */
+
+/**
+ * @var std::size_t xml::reader::impl::last_namespace_id
+ *
+ * @internal
+ *
+ * @brief The identifier of @c #last_namespace_uri.
+ */
+
+# ifndef HAVE_XMLLITE
+extern "C" {
+    xmlParserInputPtr xml_reader_entityLoader(const char * url,
+                                              const char * id,
+                                              xmlParserCtxtPtr context);
+}
+# endif
+
+namespace
+{
+# ifndef HAVE_XMLLITE
+    //
+    // libxml2's external entity loader is process-global; so it defers to
+    // the resolver of the reader being read on the current thread, if any.
+    //
+    thread_local const xml::entity_resolver * current_entity_resolver =
+        nullptr;
+    xmlExternalEntityLoader default_entity_loader = nullptr;
+
+    void install_entity_loader()
+    {
+        static std::once_flag once;
+        std::call_once(once, []{
+            default_entity_loader = xmlGetExternalEntityLoader();
+            xmlSetExternalEntityLoader(xml_reader_entityLoader);
+        });
+    }
+
+    class entity_resolver_scope {
+        const xml::entity_resolver * const prev_;
+
+    public:
+        explicit entity_resolver_scope(const xml::entity_resolver * resolver)
+            throw ():
+            prev_{current_entity_resolver}
+        {
+            current_entity_resolver = resolver;
+        }
+
+        entity_resolver_scope(const entity_resolver_scope &) = delete;
+
+        ~entity_resolver_scope() throw ()
+        {
+            current_entity_resolver = this->prev_;
+        }
+
+        entity_resolver_scope &
+        operator=(const entity_resolver_scope &) = delete;
+    };
+
+    int parser_options(const xml::reader_options & options)
+    {
+        int result = 0;
+        if (options.entities) {
+            install_entity_loader();
+            result |= XML_PARSE_DTDLOAD | XML_PARSE_DTDATTR | XML_PARSE_NOENT
+                    | XML_PARSE_NONET;
+        }
+        return result;
+    }
+# endif
+
+    bool has_limits(const xml::reader_options & options) throw ()
+    {
+        return options.max_depth != 0
+            || options.max_name_length != 0
+            || options.max_attributes != 0
+            || options.max_text_length != 0
+# ifndef HAVE_XMLLITE
+            || options.max_entity_expansions != 0
+# endif
+            || options.max_bytes != 0;
+    }
+
+    //
+    // Whether the input is wrapped in a generic synthetic element.  Input
+    // with open_elements is instead preceded by start tags for those
+    // elements, which are closed by the input itself.
+    //
+    bool is_wrapped(const xml::reader_options & options) throw ()
+    {
+        return options.open_elements.empty()
+            && (options.fragment
+                || options.input_offset != 0
+                || !options.namespaces.empty());
+    }
+
+    //
+    // Whether the input must pass through a stream_input; if so, a reader
+    // constructed from a file name reads the file through a std::ifstream.
+    //
+    bool needs_stream_input(const xml::reader_options & options) throw ()
+    {
+        return options.multiple_documents
+            || options.track_offsets
+            || options.input_length != 0
+            || options.max_bytes != 0
+            || !options.open_elements.empty()
+            || is_wrapped(options);
+    }
+
+    const char wrapper_name[] = "xmlrw-content";
+
+    std::string synthetic_start_tag(
+        const std::string & name,
+        const std::vector<xml::namespace_binding> & namespaces)
+    {
+        std::string result = '<' + name;
+        for (const auto & ns : namespaces) {
+            result += ns.prefix.empty() ? " xmlns" : " xmlns:" + ns.prefix;
+            result += "=\"";
+            for (const char c : ns.uri) {
+                switch (c) {
+                case '&': result += "&amp;"; break;
+                case '<': result += "&lt;"; break;
+                case '"': result += "&quot;"; break;
+                default: result += c;
+                }
+            }
+            result += '"';
+        }
+        result += '>';
+        return result;
+    }
+
+    stream_input::stream_input(std::istream * const in) throw ():
+        in{in},
+        data_begin{nullptr},
+        data{nullptr},
+        data_end{nullptr},
+        stats{nullptr},
+        scanner{nullptr},
+        prefix_pos{0},
+        suffix_pos{0},
+        limited{false},
+        remaining{0},
+        max_bytes{0},
+        document_start{0},
+        max_bytes_exceeded{false},
+        stream_done{false},
+        delivered{0}
+    {}
+
+    stream_input::stream_input(const char * const data,
+                               const std::size_t size) throw ():
+        in{nullptr},
+        data_begin{data},
+        data{data},
+        data_end{data + size},
+        stats{nullptr},
+        scanner{nullptr},
+        prefix_pos{0},
+        suffix_pos{0},
+        limited{false},
+        remaining{0},
+        max_bytes{0},
+        document_start{0},
+        max_bytes_exceeded{false},
+        stream_done{false},
+        delivered{0}
+    {}
+
+    document_framer::document_framer() throw ():
+        buffer_pos{0},
+        depth{0},
+        bounded{false},
+        boundary{0},
+        offset{0}
+    {}
+
+    //
+    // Look for the end of the current document's document element among
+    // the tags scanned so far.  Tags after it are left for the next
+    // document.
+    //
+    void document_framer::find_boundary() throw ()
+    {
+        using xml::detail::markup_scanner;
+        markup_scanner::tag t;
+        while (!this->bounded && this->scanner.pop(t)) {
+            switch (t.kind) {
+            case markup_scanner::tag_kind::start:
+                ++this->depth;
+                continue;
+            case markup_scanner::tag_kind::end:
+                if (this->depth > 0) { --this->depth; }
+                break;
+            case markup_scanner::tag_kind::empty:
+                break;
+            }
+            if (this->depth == 0) {
+                this->bounded = true;
+                this->boundary = t.end;
+            }
+        }
+    }
+
+    //
+    // Returns the number of bytes read, 0 at the end of the input, or -1
+    // if the stream fails.
+    //
+    std::streamsize stream_input::read(char * const buffer,
+                                       const std::streamsize len)
+    {
+        if (this->prefix_pos < this->prefix.size()) {
+            const std::size_t n =
+                (std::min)(std::size_t(len),
+                           this->prefix.size() - this->prefix_pos);
+            std::memcpy(buffer, this->prefix.data() + this->prefix_pos, n);
+            this->prefix_pos += n;
+            return std::streamsize(n);
+        }
+
+        if (!this->stream_done) {
+            std::streamsize request = len;
+            if (this->limited && std::uint64_t(request) > this->remaining) {
+                request = std::streamsize(this->remaining);
+            }
+            //
+            // Read no more than one byte past reader_options::max_bytes;
+            // so the parser never sees more than that of the input.
+            //
+            if (this->max_bytes != 0) {
+                const std::uint64_t allowed =
+                    this->max_bytes + 1
+                    - (this->delivered - this->document_start);
+                if (std::uint64_t(request) > allowed) {
+                    request = std::streamsize(allowed);
+                }
+            }
+            std::streamsize count = 0;
+            if (request > 0) {
+                count = this->framer ? this->read_document(buffer, request)
+                                     : this->read_stream(buffer, request);
+                if (count < 0) { return -1; }
+            }
+            if (count > 0) {
+                this->delivered += count;
+                if (this->limited) { this->remaining -= count; }
+                if (this->max_bytes != 0
+                    && this->delivered - this->document_start
+                        > this->max_bytes) {
+                    this->max_bytes_exceeded = true;
+                    return -1;
+                }
+                if (this->scanner) { this->scanner->scan(buffer, count); }
+                return count;
+            }
+            this->stream_done = true;
+        }
+
+        const std::size_t n =
+            (std::min)(std::size_t(len),
+                       this->suffix.size() - this->suffix_pos);
+        std::memcpy(buffer, this->suffix.data() + this->suffix_pos, n);
+        this->suffix_pos += n;
+        return std::streamsize(n);
+    }
+
+    std::streamsize stream_input::read_stream(char * const buffer,
+                                              const std::streamsize len)
+    {
+        if (!this->in) {
+            const std::size_t n =
+                (std::min)(std::size_t(len),
+                           std::size_t(this->data_end - this->data));
+            std::memcpy(buffer, this->data, n);
+            this->data += n;
+            return std::streamsize(n);
+        }
+        if (this->stats) {
+            using std::chrono::steady_clock;
+            const steady_clock::time_point start = steady_clock::now();
+            this->in->read(buffer, len);
+            this->stats->input_wait_time += steady_clock::now() - start;
+        } else {
+            this->in->read(buffer, len);
+        }
+        //
+        // Reaching the end of the stream sets failbit along with eofbit;
+        // that is not an error.
+        //
+        if (this->in->bad()) { return -1; }
+        return this->in->gcount();
+    }
+
+    //
+    // Read from the framer's buffer, up to the end of the current
+    // document.  The request is filled completely unless the document or
+    // the stream ends: libxml2 fails on a reset reader whose first read
+    // comes up short.
+    //
+    std::streamsize stream_input::read_document(char * const buffer,
+                                                const std::streamsize len)
+    {
+        document_framer & f = *this->framer;
+        std::size_t total = 0;
+        while (total < std::size_t(len)
+               && !(f.bounded && f.offset == f.boundary)) {
+            if (f.buffer_pos == f.buffer.size()) {
+                const std::streamsize count = this->fill_framer();
+                if (count < 0) { return -1; }
+                if (count == 0) { break; }
+            }
+            std::uint64_t available = f.buffer.size() - f.buffer_pos;
+            if (f.bounded) {
+                available = (std::min)(available, f.boundary - f.offset);
+            }
+            const std::size_t n =
+                std::size_t((std::min)(available,
+                                       std::uint64_t(len - total)));
+            std::memcpy(buffer + total, f.buffer.data() + f.buffer_pos, n);
+            f.buffer_pos += n;
+            f.offset += n;
+            total += n;
+        }
+        return std::streamsize(total);
+    }
+
+    std::streamsize stream_input::fill_framer()
+    {
+        document_framer & f = *this->framer;
+        f.buffer.resize(64 * 1024);
+        const std::streamsize count =
+            this->read_stream(&f.buffer[0], std::streamsize(f.buffer.size()));
+        f.buffer.resize(count > 0 ? std::size_t(count) : 0);
+        f.buffer_pos = 0;
+        if (count > 0) {
+            f.scanner.scan(f.buffer.data(), f.buffer.size());
+            f.find_boundary();
+        }
+        return count;
+    }
+
+    //
+    // Skip the whitespace between documents.  Returns false at the end of
+    // the stream.
+    //
+    bool stream_input::next_document()
+    {
+        document_framer & f = *this->framer;
+        f.bounded = false;
+        f.depth = 0;
+        for (;;) {
+            const std::size_t start = f.buffer_pos;
+            while (f.buffer_pos < f.buffer.size()
+                   && std::isspace(
+                       static_cast<unsigned char>(f.buffer[f.buffer_pos]))) {
+                ++f.buffer_pos;
+            }
+            const std::size_t skipped = f.buffer_pos - start;
+            f.offset += skipped;
+            this->delivered += skipped;
+            if (this->scanner && skipped > 0) {
+                this->scanner->scan(f.buffer.data() + start, skipped);
+            }
+            if (f.buffer_pos < f.buffer.size()) { break; }
+            const std::streamsize count = this->fill_framer();
+            if (count < 0) {
+                throw std::runtime_error{"failed to read input"};
+            }
+            if (count == 0) { return false; }
+        }
+        f.find_boundary();
+        this->stream_done = false;
+        this->suffix_pos = 0;
+        this->document_start = this->delivered;
+        return true;
+    }
+
+    xml::detail::memory_account *
+    make_memory_account(const xml::reader_options & options)
+    {
+        if (options.memory_limit == 0 && !options.memory) { return nullptr; }
+# ifdef HAVE_XMLLITE
+        throw std::runtime_error{
+            "memory limits are not supported with XmlLite"};
+# else
+        if (!xml::detail::memory_hooks_installed()) {
+            throw std::logic_error{
+                "xml::install_memory_hooks has not been called"};
+        }
+        return new xml::detail::memory_account{options.memory,
+                                               options.memory_limit};
+# endif
+    }
+
+    //
+    // Reject options that cannot be honoured, before anything is
+    // allocated for the reader.
+    //
+    const xml::reader_options &
+    checked_options(const xml::reader_options & options)
+    {
+# ifdef HAVE_XMLLITE
+        if (options.entities) {
+            throw std::runtime_error{
+                "entity resolvers are not supported with XmlLite"};
+        }
+        if (options.schema) {
+            throw std::runtime_error{
+                "schema validation is not supported with XmlLite"};
+        }
+# else
+        //
+        // Resolving entities makes libxml2 substitute them as it parses;
+        // so the reader never sees the references it would count.
+        //
+        if (options.entities && options.max_entity_expansions != 0) {
+            throw std::logic_error{
+                "max_entity_expansions cannot be combined with an entity "
+                "resolver"};
+        }
+        //
+        // The elements in an entity's replacement text have no tags in the
+        // input; the scanner would pair them with the tags that follow.
+        //
+        if (options.entities && options.track_offsets) {
+            throw std::logic_error{
+                "offsets cannot be tracked with an entity resolver"};
+        }
+# endif
+        return options;
+    }
+}
+
+# ifndef HAVE_XMLLITE
+extern "C" {
+    void xml_reader_errorFunc(void * arg, const char * msg,
+                              xmlParserSeverities severity,
+                              xmlTextReaderLocatorPtr locator);
+}
+# endif
+
+# ifdef HAVE_XMLLITE
+namespace
+{
+    class com_istream : public ::IStream {
+        stream_input input_;
+        LONG count_;
+
+    public:
+        explicit com_istream(std::istream & in);
+        explicit com_istream(stream_input && in);
+        com_istream(const com_istream &) = delete;
+
+        com_istream & operator=(const com_istream &) = delete;
+
+        stream_input & input() throw ();
+
+        //
+        // IUnknown implementation
+        //
+        virtual HRESULT __stdcall QueryInterface(const IID & iid, void ** ppv);
+        virtual ULONG __stdcall AddRef();
+        virtual ULONG __stdcall Release();
+
+        //
+        // ISequentialStream implementation
+        //
+        virtual HRESULT __stdcall Read(void * pv, ULONG cb, ULONG * pcbRead);
+        virtual HRESULT __stdcall Write(const void * pv, ULONG cb, ULONG * pcbWritten);
+
+        //
+        // IStream implementation
+        //
+        virtual HRESULT __stdcall Seek(LARGE_INTEGER dlibMove, DWORD dwOrigin,
+                                       ULARGE_INTEGER * plibNewPosition);
+        virtual HRESULT __stdcall SetSize(ULARGE_INTEGER libNewSize);
+        virtual HRESULT __stdcall CopyTo(IStream * pstm, ULARGE_INTEGER cb,
+                                         ULARGE_INTEGER * pcbRead,
+                                         ULARGE_INTEGER * pcbWritten);
+        virtual HRESULT __stdcall Commit(DWORD grfCommitFlags);
+        virtual HRESULT __stdcall Revert();
+        virtual HRESULT __stdcall LockRegion(ULARGE_INTEGER libOffset,
+                                             ULARGE_INTEGER cb,
+                                             DWORD dwLockType);
+        virtual HRESULT __stdcall UnlockRegion(ULARGE_INTEGER libOffset,
+                                               ULARGE_INTEGER cb,
+                                               DWORD dwLockType);
+        virtual HRESULT __stdcall Stat(STATSTG * pstatstg, DWORD grfStatFlag);
+        virtual HRESULT __stdcall Clone(IStream ** ppstm);
+    };
+
+}
+# else
+extern "C" {
+    int xml_reader_inputReadCallback(void * context, char * buffer, int len);
+    int xml_reader_inputCloseCallback(void * context);
+}
+# endif
+
+/**
+ * @internal
+ *
+ * @brief Construct using a UTF-8 file name.
+ *
+ * @param[in] filename a UTF-8-encoded file name.
+ * @param[in] options  reader options.
+ *
+ * @exception std::runtime_error   if:
+ *                                  * @p filename cannot be opened; or
+ *                                  * XmlLite/libxml2 setup fails
+ * @exception std::bad_alloc       if memory allocation fails
+ */
+xml::reader::impl::impl(const std::string & filename,
+                        const reader_options & options):
+# ifdef HAVE_XMLLITE
+    input{0},
+# else
+    error{xml::parse_error{0, ""}, false,
+          options.input_line > 0 ? options.input_line - 1 : 0},
+# endif
+    reader{0},
+# ifndef HAVE_XMLLITE
+    input{nullptr},
+# endif
+    memory{make_memory_account(options)},
+    collect_stats{options.collect_stats},
+    document{document_state::not_started},
+    document_nodes{0},
+    options(options),
+    limited{has_limits(options)},
+    entity_expansions{0},
+    source{nullptr},
+    wrapped{is_wrapped(options)},
+    synthetic_elements{is_wrapped(options) ? 1 : options.open_elements.size()},
+    line_offset{options.input_line > 0 ? options.input_line - 1 : 0},
+    located{false},
+    location{0, 0, 0},
+    location_end_line{0},
+    location_end_column{0},
+    location_kind{detail::markup_scanner::tag_kind::start},
+    spanned{false},
+    outer_span{0, 0, 0},
+    inner_span{0, 0, 0}
+# ifndef HAVE_XMLLITE
+    , last_namespace_uri{nullptr}
+    , last_namespace_id{0}
+# endif
+{
+# ifdef HAVE_XMLLITE
+    HRESULT hr;
+    bool succeeded = false;
+
+    if (needs_stream_input(options)) {
+        this->file.reset(new std::ifstream{
+            detail::utf8_to_utf16(filename).c_str(),
+            std::ios_base::in | std::ios_base::binary});
+        if (!*this->file) {
+            throw std::runtime_error{"failed to open file \"" + filename
+                                     + '\"'};
+        }
+        com_istream * const stream = new com_istream{*this->file};
+        this->input = stream;
+        this->set_input(stream->input());
+        hr = S_OK;
+    } else {
+        hr = SHCreateStreamOnFile(
+            reinterpret_cast<LPCWSTR>(detail::utf8_to_utf16(filename).c_str()),
+            STGM_READ,
+            &this->input);
+    }
+    detail::finally f1([&]{
+        if (!succeeded && input != nullptr) { input->Release(); }
+    });
+    if (FAILED(hr)) {
+        if (hr == E_OUTOFMEMORY) {
+            throw std::bad_alloc{};
+        }
+        throw std::runtime_error{"failed to open file \"" + filename
+                                 + '\"'};
+    }
+
+    hr = CreateXmlReader(__uuidof(IXmlReader),
+                         reinterpret_cast<void **>(&this->reader),
+                         0);
+    detail::finally f2([&]{
+        if (!succeeded && this->reader != nullptr) { this->reader->Release(); }
+    });
+    if (FAILED(hr)) {
+        if (hr == E_OUTOFMEMORY) {
+            throw std::bad_alloc{};
+        }
+        throw std::runtime_error{"failed to create XML reader"};
+    }
+
+    hr = this->reader->SetInput(this->input);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to set input for XML reader"};
+    }
+
+    if (options.max_entity_expansions != 0) {
+        hr = this->reader->SetProperty(XmlReaderProperty_MaxEntityExpansion,
+                                       options.max_entity_expansions);
+        if (FAILED(hr)) {
+            throw std::runtime_error{"failed to set XML reader property"};
+        }
+    }
+
+    succeeded = true;
+# else
+    static const char * const encoding = 0;
+    if (needs_stream_input(options)) {
+        this->file.reset(new std::ifstream{
+            filename.c_str(), std::ios_base::in | std::ios_base::binary});
+        if (!*this->file) {
+            if (this->memory) { this->memory->release(); }
+            throw std::runtime_error{"failed to open file \"" + filename
+                                     + '\"'};
+        }
+        this->input.in = this->file.get();
+        this->set_input(this->input);
+        //
+        // The file name is the base URI, as with xmlReaderForFile.
+        //
+        detail::memory_scope scope{this->memory};
+        this->reader = xmlReaderForIO(xml_reader_inputReadCallback,
+                                      xml_reader_inputCloseCallback,
+                                      &this->input,
+                                      filename.c_str(),
+                                      encoding,
+                                      parser_options(options));
+    } else {
+        detail::memory_scope scope{this->memory};
+        this->reader = xmlReaderForFile(filename.c_str(), encoding,
+                                         parser_options(options));
+    }
+    if (!this->reader) {
+        const bool limit_exceeded =
+            this->memory && this->memory->limit_exceeded.load();
+        if (this->memory) { this->memory->release(); }
+        if (limit_exceeded) {
+            throw memory_limit_error{0, "memory limit exceeded"};
+        }
+        throw std::runtime_error{"failed to create XML reader"};
+    }
+    xmlTextReaderSetErrorHandler(this->reader,
+                                 xml_reader_errorFunc,
+                                 &this->error);
+    this->set_schema();
+# endif
+}
+
+/**
+ * @internal
+ *
+ * @brief Construct using an input stream.
+ *
+ * @param[in,out] in        an input stream.
+ * @param[in]     options   reader options.
+ *
+ * @exception std::runtime_error   if XmlLite/libxml2 setup fails
+ * @exception std::bad_alloc       if memory allocation fails
+ */
+xml::reader::impl::impl(std::istream & in, const reader_options & options):
+    impl{stream_input{&in}, options}
+{}
+
+/**
+ * @internal
+ *
+ * @brief Construct using a buffer in memory.
+ *
+ * @param[in] data      the input.
+ * @param[in] size      the size of @p data in bytes.
+ * @param[in] options   reader options.
+ *
+ * @exception std::runtime_error   if XmlLite/libxml2 setup fails
+ * @exception std::bad_alloc       if memory allocation fails
+ */
+xml::reader::impl::impl(const char * const data,
+                        const std::size_t size,
+                        const reader_options & options):
+    impl{stream_input{data, size}, options}
+{}
+
+/**
+ * @internal
+ *
+ * @brief Construct using a @c stream_input.
+ *
+ * @param[in,out] in        the input.
+ * @param[in]     options   reader options.
+ *
+ * @exception std::runtime_error   if XmlLite/libxml2 setup fails
+ * @exception std::bad_alloc       if memory allocation fails
+ */
+xml::reader::impl::impl(stream_input && in, const reader_options & options):
+# ifdef HAVE_XMLLITE
+    input{new com_istream{std::move(in)}},
+# else
+    error{xml::parse_error{0, ""}, false,
+          options.input_line > 0 ? options.input_line - 1 : 0},
+# endif
+    reader{0},
+# ifndef HAVE_XMLLITE
+    input{std::move(in)},
+# endif
+    memory{make_memory_account(options)},
+    collect_stats{options.collect_stats},
+    document{document_state::not_started},
+    document_nodes{0},
+    options(options),
+    limited{has_limits(options)},
+    entity_expansions{0},
+    source{nullptr},
+    wrapped{is_wrapped(options)},
+    synthetic_elements{is_wrapped(options) ? 1 : options.open_elements.size()},
+    line_offset{options.input_line > 0 ? options.input_line - 1 : 0},
+    located{false},
+    location{0, 0, 0},
+    location_end_line{0},
+    location_end_column{0},
+    location_kind{detail::markup_scanner::tag_kind::start},
+    spanned{false},
+    outer_span{0, 0, 0},
+    inner_span{0, 0, 0}
+# ifndef HAVE_XMLLITE
+    , last_namespace_uri{nullptr}
+    , last_namespace_id{0}
+# endif
+{
+# ifdef HAVE_XMLLITE
+    bool succeeded = false;
+    detail::finally f1([&]{
+        if (!succeeded && input != nullptr) { input->Release(); }
+    });
+
+    this->set_input(static_cast<com_istream *>(this->input)->input());
+
+    HRESULT hr;
+
+    static IMalloc * const malloc = 0;
+    IXmlReaderInput * xml_input = 0;
+    static const WCHAR * const base_uri = 0;
+    hr = CreateXmlReaderInputWithEncodingName(this->input,
+                                              malloc,
+                                              L"utf-8",
+                                              FALSE, // Require UTF-8.
+                                              base_uri,
+                                              &xml_input);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to create XML input"};
+    }
+
+    hr = CreateXmlReader(__uuidof(IXmlReader),
+                         reinterpret_cast<void **>(&this->reader),
+                         malloc);
+    detail::finally f2([&]{
+        if (!succeeded && this->reader != nullptr) { this->reader->Release(); }
+    });
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to create XML reader"};
+    }
+
+    hr = this->reader->SetInput(xml_input);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to set input for XML reader"};
+    }
+
+    if (options.max_entity_expansions != 0) {
+        hr = this->reader->SetProperty(XmlReaderProperty_MaxEntityExpansion,
+                                       options.max_entity_expansions);
+        if (FAILED(hr)) {
+            throw std::runtime_error{"failed to set XML reader property"};
+        }
+    }
+
+    succeeded = true;
+# else
+    static const char * const base_uri = 0;
+    static const char * const encoding = 0;
+    this->set_input(this->input);
+    {
+        detail::memory_scope scope{this->memory};
+        this->reader = xmlReaderForIO(xml_reader_inputReadCallback,
+                                      xml_reader_inputCloseCallback,
+                                      &this->input,
+                                      base_uri,
+                                      encoding,
+                                      parser_options(options));
+    }
+    if (!this->reader) {
+        const bool limit_exceeded =
+            this->memory && this->memory->limit_exceeded.load();
+        if (this->memory) { this->memory->release(); }
+        if (limit_exceeded) {
+            throw memory_limit_error{0, "memory limit exceeded"};
+        }
+        throw std::runtime_error{"failed to create XML reader"};
+    }
+    xmlTextReaderSetErrorHandler(this->reader,
+                                 xml_reader_errorFunc,
+                                 &this->error);
+    this->set_schema();
+# endif
+}
+
+/**
+ * @fn xml::reader::impl::impl(const impl &)
+ *
+ * @internal
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @internal
+ *
+ * @brief Destroy.
+ */
+xml::reader::impl::~impl() throw ()
+{
+# ifdef HAVE_XMLLITE
+    this->reader->Release();
+    this->input->Release();
+# else
+    xmlFreeTextReader(this->reader);
+# endif
+    if (this->memory) { this->memory->release(); }
+}
+
+/**
+ * @internal
+ *
+ * @brief Apply the options that concern the input to @p in.
+ *
+ * @param[in,out] in    the input.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::reader::impl::set_input(stream_input & in)
+{
+    this->source = &in;
+    if (this->options.multiple_documents && !this->wrapped
+        && this->options.open_elements.empty()) {
+        in.framer.reset(new document_framer);
+    }
+    if (this->collect_stats) { in.stats = &this->stats; }
+    if (this->options.track_offsets) {
+        this->scanner.reset(
+            new detail::markup_scanner{this->options.input_offset,
+                                       this->options.input_line,
+                                       this->options.input_column});
+        in.scanner = this->scanner.get();
+    }
+    if (this->options.input_length != 0) {
+        in.limited = true;
+        in.remaining = this->options.input_length;
+    }
+    in.max_bytes = this->options.max_bytes;
+    if (this->wrapped) {
+        in.prefix = synthetic_start_tag(wrapper_name,
+                                        this->options.namespaces);
+        in.suffix = std::string{"</"} + wrapper_name + '>';
+    } else if (!this->options.open_elements.empty()) {
+        const auto & elements = this->options.open_elements;
+        in.prefix = synthetic_start_tag(elements.front(),
+                                        this->options.namespaces);
+        for (auto name = elements.begin() + 1; name != elements.end();
+             ++name) {
+            in.prefix += '<' + *name + '>';
+        }
+    }
+}
+
+# ifndef HAVE_XMLLITE
+/**
+ * @internal
+ *
+ * @brief Attach @c reader_options::schema, if any, to the underlying
+ *        reader.
+ *
+ * If this fails, the underlying reader is freed.
+ *
+ * @exception std::runtime_error    if the schema cannot be attached.
+ */
+void xml::reader::impl::set_schema()
+{
+    if (!this->options.schema) { return; }
+    void * const native = detail::native_schema(*this->options.schema);
+    detail::memory_scope scope{this->memory};
+    const int result =
+        (this->options.schema->schema_language() == schema::language::xsd)
+        ? xmlTextReaderSetSchema(this->reader,
+                                 static_cast<xmlSchemaPtr>(native))
+        : xmlTextReaderRelaxNGSetSchema(this->reader,
+                                        static_cast<xmlRelaxNGPtr>(native));
+    if (result != 0) {
+        xmlFreeTextReader(this->reader);
+        if (this->memory) { this->memory->release(); }
+        throw std::runtime_error{"failed to set schema for XML reader"};
+    }
+}
+# endif
+
+/**
+ * @internal
+ *
+ * @brief Advance to the next node to be reported to the user.
+ *
+ * @retval true if the node was read successfully
+ * @retval false if there are no more nodes to read
+ *
+ * @exception xml::parse_error  if there is an error in the input.
+ */
+bool xml::reader::impl::read()
+{
+    if (this->options.cancel
+        && this->options.cancel->load(std::memory_order_relaxed)) {
+        throw cancelled_error{};
+    }
+
+    if (this->document != document_state::in_progress) {
+        if (this->document == document_state::finished) { return false; }
+        this->document = document_state::in_progress;
+        this->document_start = std::chrono::steady_clock::now();
+    }
+
+    bool result = this->read_node();
+
+    //
+    // Skip the synthetic elements that provide the context for input read
+    // as element content.  The synthetic start tags are read first; the
+    // generic wrapper's end tag is the only other node at depth 0.
+    //
+    // Whitespace directly within the generic wrapper is skipped too, as it
+    // would be in a document's prolog or epilog.
+    //
+    while (result) {
+        if (this->synthetic_elements > 0) {
+            --this->synthetic_elements;
+        } else {
+            if (!this->wrapped) { break; }
+# ifdef HAVE_XMLLITE
+            UINT depth = 0;
+            this->reader->GetDepth(&depth);
+            XmlNodeType type = XmlNodeType_None;
+            this->reader->GetNodeType(&type);
+            const bool whitespace = type == XmlNodeType_Whitespace;
+# else
+            const int depth = xmlTextReaderDepth(this->reader);
+            const int type = xmlTextReaderNodeType(this->reader);
+            const bool whitespace =
+                type == XML_READER_TYPE_WHITESPACE
+                || type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE;
+# endif
+            if (depth > 1 || (depth == 1 && !whitespace)) { break; }
+        }
+        result = this->read_node();
+    }
+
+    if (!result) {
+        this->document = document_state::finished;
+        this->located = false;
+        this->spanned = false;
+        detail::record_document(
+            detail::metrics_source::reader,
+            this->bytes_consumed(),
+            this->document_nodes,
+            std::chrono::steady_clock::now() - this->document_start);
+        return false;
+    }
+    if (this->limited) {
+        try {
+            this->check_limits();
+        } catch (const resource_limit_error &) {
+            this->document = document_state::finished;
+            detail::record_error(detail::metrics_source::reader);
+            throw;
+        }
+    }
+    if (this->scanner) {
+        this->locate();
+        this->track_span();
+    }
+    ++this->document_nodes;
+    return true;
+}
+
+/**
+ * @internal
+ *
+ * @brief Set up the underlying reader for the next document in the input.
+ *
+ * @retval true if there is another document
+ * @retval false if the input has ended
+ *
+ * @exception xml::parse_error      if there is an error in the rest of the
+ *                                  current document.
+ * @exception std::logic_error      if the reader does not read multiple
+ *                                  documents.
+ * @exception std::runtime_error    if reading the input fails, or
+ *                                  XmlLite/libxml2 setup fails.
+ */
+bool xml::reader::impl::next_document()
+{
+# ifdef HAVE_XMLLITE
+    stream_input & in = static_cast<com_istream *>(this->input)->input();
+# else
+    stream_input & in = this->input;
+# endif
+    if (!in.framer) {
+        throw std::logic_error{"the reader does not read multiple documents"};
+    }
+    while (this->read()) {}
+    if (!in.next_document()) { return false; }
+
+# ifdef HAVE_XMLLITE
+    const HRESULT hr = this->reader->SetInput(this->input);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to set input for XML reader"};
+    }
+# else
+    //
+    // Resetting the reader keeps its dictionary; so names interned for one
+    // document are shared by the next.
+    //
+    const xmlChar * const base = xmlTextReaderConstBaseUri(this->reader);
+    const std::string base_uri = base
+        ? std::string{reinterpret_cast<const char *>(base)}
+        : std::string{};
+    static const char * const encoding = 0;
+    const int result = [&]{
+        detail::memory_scope scope{this->memory};
+        return xmlReaderNewIO(this->reader,
+                              xml_reader_inputReadCallback,
+                              xml_reader_inputCloseCallback,
+                              &this->input,
+                              base ? base_uri.c_str() : nullptr,
+                              encoding,
+                              parser_options(this->options));
+    }();
+    if (result != 0) {
+        throw std::runtime_error{"failed to reset XML reader"};
+    }
+# endif
+    this->restart();
+    return true;
+}
+
+/**
+ * @internal
+ *
+ * @brief Read a new document from a file, reusing the underlying reader.
+ *
+ * @param[in] filename  a UTF-8-encoded file name.
+ *
+ * @exception std::runtime_error    if @p filename cannot be opened, or
+ *                                  XmlLite/libxml2 setup fails.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+void xml::reader::impl::reset(const std::string & filename)
+{
+# ifdef HAVE_XMLLITE
+    std::unique_ptr<std::istream> file;
+    IStream * input = nullptr;
+    if (needs_stream_input(this->options)) {
+        file.reset(new std::ifstream{
+            detail::utf8_to_utf16(filename).c_str(),
+            std::ios_base::in | std::ios_base::binary});
+        if (!*file) {
+            throw std::runtime_error{"failed to open file \"" + filename
+                                     + '\"'};
+        }
+        com_istream * const stream = new com_istream{*file};
+        input = stream;
+        this->set_input(stream->input());
+    } else {
+        const HRESULT hr = SHCreateStreamOnFile(
+            reinterpret_cast<LPCWSTR>(detail::utf8_to_utf16(filename).c_str()),
+            STGM_READ,
+            &input);
+        if (FAILED(hr)) {
+            if (hr == E_OUTOFMEMORY) { throw std::bad_alloc{}; }
+            throw std::runtime_error{"failed to open file \"" + filename
+                                     + '\"'};
+        }
+        this->source = nullptr;
+    }
+    const HRESULT hr = this->reader->SetInput(input);
+    if (FAILED(hr)) {
+        input->Release();
+        throw std::runtime_error{"failed to set input for XML reader"};
+    }
+    this->input->Release();
+    this->input = input;
+    this->file = std::move(file);
+# else
+    static const char * const encoding = 0;
+    int result;
+    if (needs_stream_input(this->options)) {
+        std::unique_ptr<std::istream> file{new std::ifstream{
+            filename.c_str(), std::ios_base::in | std::ios_base::binary}};
+        if (!*file) {
+            throw std::runtime_error{"failed to open file \"" + filename
+                                     + '\"'};
+        }
+        this->file = std::move(file);
+        this->input = stream_input{this->file.get()};
+        this->set_input(this->input);
+        detail::memory_scope scope{this->memory};
+        result = xmlReaderNewIO(this->reader,
+                                xml_reader_inputReadCallback,
+                                xml_reader_inputCloseCallback,
+                                &this->input,
+                                filename.c_str(),
+                                encoding,
+                                parser_options(this->options));
+    } else {
+        detail::memory_scope scope{this->memory};
+        result = xmlReaderNewFile(this->reader, filename.c_str(), encoding,
+                                  parser_options(this->options));
+        this->source = nullptr;
+    }
+    if (result != 0) {
+        throw std::runtime_error{"failed to open file \"" + filename
+                                 + '\"'};
+    }
+# endif
+    this->synthetic_elements =
+        this->wrapped ? 1 : this->options.open_elements.size();
+    this->restart();
+}
+
+/**
+ * @internal
+ *
+ * @brief Reset the per-document state, once the underlying reader has been
+ *        given new input.
+ *
+ * @exception std::runtime_error    if the schema cannot be attached.
+ */
+void xml::reader::impl::restart()
+{
+# ifndef HAVE_XMLLITE
+    xmlTextReaderSetErrorHandler(this->reader,
+                                 xml_reader_errorFunc,
+                                 &this->error);
+    this->error.last = xml::parse_error{0, ""};
+    this->error.invalid = false;
+    if (this->options.schema) {
+        void * const native = detail::native_schema(*this->options.schema);
+        detail::memory_scope scope{this->memory};
+        const int schema_result =
+            (this->options.schema->schema_language() == schema::language::xsd)
+            ? xmlTextReaderSetSchema(this->reader,
+                                     static_cast<xmlSchemaPtr>(native))
+            : xmlTextReaderRelaxNGSetSchema(
+                  this->reader, static_cast<xmlRelaxNGPtr>(native));
+        if (schema_result != 0) {
+            throw std::runtime_error{"failed to set schema for XML reader"};
+        }
+    }
+    this->namespace_ids_by_name.clear();
+    this->last_namespace_uri = nullptr;
+# endif
+    this->document = document_state::not_started;
+    this->document_nodes = 0;
+    this->entity_expansions = 0;
+    this->located = false;
+    this->open_tags.clear();
+    this->spanned = false;
+}
+
+/**
+ * @internal
+ *
+ * @brief Advance the underlying reader to the next node.
+ *
+ * @retval true if the node was read successfully
+ * @retval false if there are no more nodes to read
+ *
+ * @exception xml::parse_error  if there is an error in the input.
+ */
+bool xml::reader::impl::read_node()
+{
+# ifdef HAVE_XMLLITE
+    HRESULT hr = this->reader->Read(0);
+    if (FAILED(hr)) {
+        if (this->source && this->source->max_bytes_exceeded) {
+            this->document = document_state::finished;
+            detail::record_error(detail::metrics_source::reader);
+            throw resource_limit_error{this->line(), resource_limit::bytes,
+                                       "maximum input size exceeded"};
+        }
+        if (detail::is_xmllite_reader_error(hr)) {
+            this->document = document_state::finished;
+            detail::record_error(detail::metrics_source::reader);
+            detail::throw_parse_error(*this->reader, hr);
+        }
+    }
+    return hr == S_OK;
+# else
+    const int result = [this]{
+        detail::memory_scope scope{this->memory};
+        entity_resolver_scope entities{this->options.entities.get()};
+        return xmlTextReaderRead(this->reader);
+    }();
+    if (result < 0) {
+        this->document = document_state::finished;
+        detail::record_error(detail::metrics_source::reader);
+        if (this->memory && this->memory->limit_exceeded.load()) {
+            throw memory_limit_error{this->error.last.line(),
+                                     "memory limit exceeded"};
+        }
+        if (this->source && this->source->max_bytes_exceeded) {
+            throw resource_limit_error{this->error.last.line(),
+                                       resource_limit::bytes,
+                                       "maximum input size exceeded"};
+        }
+        throw this->error.last;
+    }
+    if (this->error.invalid) {
+        this->document = document_state::finished;
+        detail::record_error(detail::metrics_source::reader);
+        throw validation_error{this->line(), this->error.last.what()};
+    }
+    return result != 0;
+# endif
+}
+
+/**
+ * @internal
+ *
+ * @brief Match the current node with its tag in the input.
+ *
+ * Element nodes correspond to start or empty-element tags, and end element
+ * nodes to end tags, in document order.  Nodes of other types have no tag.
+ */
+void xml::reader::impl::locate() throw ()
+{
+# ifdef HAVE_XMLLITE
+    XmlNodeType type = XmlNodeType_None;
+    this->reader->GetNodeType(&type);
+# else
+    const int type = xmlTextReaderNodeType(this->reader);
+# endif
+    this->located = false;
+    if (type != element_id && type != end_element_id) { return; }
+    detail::markup_scanner::tag t;
+    while (this->scanner->pop(t)) {
+        const bool end = (t.kind == detail::markup_scanner::tag_kind::end);
+        if (end == (type == end_element_id)) {
+            this->location = source_location{t.offset, t.end, t.line};
+            this->location_end_line = t.end_line;
+            this->location_end_column = t.end_column;
+            this->location_kind = t.kind;
+            this->located = true;
+            return;
+        }
+    }
+}
+
+/**
+ * @internal
+ *
+ * @brief Keep track of the start tags of open elements, so that the spans
+ *        of an element are known when it ends.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::reader::impl::track_span()
+{
+    using detail::markup_scanner;
+    this->spanned = false;
+    if (!this->located) { return; }
+    const source_location & tag = this->location;
+    switch (this->location_kind) {
+    case markup_scanner::tag_kind::start:
+        this->open_tags.push_back(open_tag{tag, this->location_end_line});
+        break;
+    case markup_scanner::tag_kind::empty:
+        this->outer_span = tag;
+        this->inner_span =
+            source_location{tag.end, tag.end, this->location_end_line};
+        this->spanned = true;
+        break;
+    case markup_scanner::tag_kind::end:
+        //
+        // The end tags of reader_options::open_elements have no start tag
+        // in the input.
+        //
+        if (this->open_tags.empty()) { break; }
+        {
+            const open_tag start = this->open_tags.back();
+            this->open_tags.pop_back();
+            this->outer_span = source_location{start.location.offset,
+                                               tag.end,
+                                               start.location.line};
+            this->inner_span = source_location{start.location.end,
+                                               tag.offset,
+                                               start.end_line};
+            this->spanned = true;
+        }
+        break;
+    }
+}
+
+/**
+ * @internal
+ *
+ * @brief The line number of the current parsing position.
+ *
+ * @return the line number of the current parsing position.
+ */
+std::size_t xml::reader::impl::line() const throw ()
+{
+# ifdef HAVE_XMLLITE
+    UINT line_number = 0;
+    this->reader->GetLineNumber(&line_number);
+# else
+    const int line_number = xmlTextReaderGetParserLineNumber(this->reader);
+# endif
+    return line_number > 0
+        ? std::size_t(line_number) + this->line_offset
+        : 0;
+}
+
+/**
+ * @internal
+ *
+ * @brief The depth of the current node, as reported to the user.
+ *
+ * @return the depth of the current node.
+ */
+std::size_t xml::reader::impl::depth() const throw ()
+{
+# ifdef HAVE_XMLLITE
+    UINT depth = 0;
+    this->reader->GetDepth(&depth);
+# else
+    const int depth = xmlTextReaderDepth(this->reader);
+# endif
+    const int adjusted = int(depth) - (this->wrapped ? 1 : 0);
+    return adjusted > 0 ? std::size_t(adjusted) : 0;
+}
+
+namespace
+{
+    void check_limit(const std::size_t value,
+                     const std::size_t limit,
+                     const xml::resource_limit which,
+                     const size_t line,
+                     const char * const msg)
+    {
+        if (limit != 0 && value > limit) {
+            throw xml::resource_limit_error{line, which, msg};
+        }
+    }
+}
+
+/**
+ * @internal
+ *
+ * @brief Check the current node against the resource limits.
+ *
+ * @exception xml::resource_limit_error    if a limit is exceeded.
+ */
+void xml::reader::impl::check_limits()
+{
+    using xml::resource_limit;
+
+    const size_t line = this->line();
+# ifdef HAVE_XMLLITE
+    XmlNodeType type = XmlNodeType_None;
+    this->reader->GetNodeType(&type);
+# else
+    const int type = xmlTextReaderNodeType(this->reader);
+# endif
+
+    check_limit(this->bytes_consumed(), this->options.max_bytes,
+                resource_limit::bytes, line,
+                "maximum input size exceeded");
+    check_limit(this->depth(), this->options.max_depth,
+                resource_limit::depth, line,
+                "maximum depth exceeded");
+
+    switch (type) {
+    case element_id:
+    {
+# ifdef HAVE_XMLLITE
+        UINT count = 0;
+        this->reader->GetAttributeCount(&count);
+        const WCHAR * name = 0;
+        UINT name_length = 0;
+        this->reader->GetQualifiedName(&name, &name_length);
+# else
+        const int count =
+            (std::max)(xmlTextReaderAttributeCount(this->reader), 0);
+        const size_t name_length =
+            xmlStrlen(xmlTextReaderConstName(this->reader));
+# endif
+        check_limit(count, this->options.max_attributes,
+                    resource_limit::attribute_count, line,
+                    "maximum attribute count exceeded");
+        check_limit(name_length, this->options.max_name_length,
+                    resource_limit::name_length, line,
+                    "maximum name length exceeded");
+        if (this->options.max_name_length != 0 && count > 0) {
+            //
+            // Lengths are in code units; for XmlLite that's UTF-16, which
+            // can only undercount relative to UTF-8 by a small factor.
+            //
+# ifdef HAVE_XMLLITE
+            for (HRESULT hr = this->reader->MoveToFirstAttribute();
+                 hr == S_OK;
+                 hr = this->reader->MoveToNextAttribute()) {
+                this->reader->GetQualifiedName(&name, &name_length);
+# else
+            for (int result = xmlTextReaderMoveToFirstAttribute(this->reader);
+                 result == 1;
+                 result = xmlTextReaderMoveToNextAttribute(this->reader)) {
+                const size_t name_length =
+                    xmlStrlen(xmlTextReaderConstName(this->reader));
+# endif
+                if (name_length > this->options.max_name_length) {
+                    throw resource_limit_error{
+                        line, resource_limit::name_length,
+                        "maximum name length exceeded"};
+                }
+            }
+# ifdef HAVE_XMLLITE
+            this->reader->MoveToElement();
+# else
+            xmlTextReaderMoveToElement(this->reader);
+# endif
+        }
+        break;
+    }
+    case text_id:
+    case cdata_id:
+    case comment_id:
+    case whitespace_id:
+    case significant_whitespace_id:
+        if (this->options.max_text_length != 0) {
+# ifdef HAVE_XMLLITE
+            const WCHAR * value = 0;
+            UINT length = 0;
+            this->reader->GetValue(&value, &length);
+# else
+            const size_t length =
+                xmlStrlen(xmlTextReaderConstValue(this->reader));
+# endif
+            check_limit(length, this->options.max_text_length,
+                        resource_limit::text_length, line,
+                        "maximum text length exceeded");
+        }
+        break;
+# ifndef HAVE_XMLLITE
+    case XML_READER_TYPE_ENTITY_REFERENCE:
+        check_limit(++this->entity_expansions,
+                    this->options.max_entity_expansions,
+                    resource_limit::entity_expansions, line,
+                    "maximum entity expansions exceeded");
+        break;
+# endif
+    default:
+        break;
+    }
+}
+
+/**
+ * @internal
+ *
+ * @brief The number of input bytes consumed by the parser.
+ *
+ * @return the number of input bytes consumed by the parser.
+ */
+std::uint64_t xml::reader::impl::bytes_consumed() const throw ()
+{
+# ifdef HAVE_XMLLITE
+    //
+    // XmlLite has no equivalent to xmlTextReaderByteConsumed; the position
+    // of the underlying stream is the closest approximation.
+    //
+    LARGE_INTEGER move = {};
+    ULARGE_INTEGER pos = {};
+    return SUCCEEDED(this->input->Seek(move, STREAM_SEEK_CUR, &pos))
+        ? pos.QuadPart
+        : 0;
+# else
+    const long consumed = xmlTextReaderByteConsumed(this->reader);
+    return consumed > 0 ? std::uint64_t(consumed) : 0;
+# endif
+}
+
+/**
+ * @internal
+ *
+ * @brief Get the identifier of a namespace URI, assigning one if
+ *        necessary.
+ *
+ * @param[in] uri   a namespace URI.
+ *
+ * @return the identifier of @p uri; 0 if @p uri is empty.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+std::size_t xml::reader::impl::intern_namespace(const string_ref & uri)
+{
+    if (uri.empty()) { return 0; }
+    const std::string key = uri.str();
+    const auto pos = this->namespace_ids.find(key);
+    if (pos != this->namespace_ids.end()) { return pos->second; }
+    this->namespace_uris.push_back(key);
+    const std::size_t id = this->namespace_uris.size();
+    this->namespace_ids.emplace(key, id);
+    return id;
+}
+
+/**
+ * @internal
+ *
+ * @brief Update @c #stats for the current node.
+ */
+void xml::reader::impl::record_node() throw ()
+{
+# ifdef HAVE_XMLLITE
+    XmlNodeType type = XmlNodeType_None;
+    this->reader->GetNodeType(&type);
+# else
+    const int type = xmlTextReaderNodeType(this->reader);
+# endif
+    //
+    // libxml2 reports some node types (e.g., entity references) that are
+    // not in xml::reader::node_type_id; those are counted as well, provided
+    // they fit.
+    //
+    if (type >= 0 && size_t(type) < reader_stats::node_type_count) {
+        ++this->stats.node_counts[type];
+    }
+    this->stats.max_depth = (std::max)(this->stats.max_depth, this->depth());
+}
+
+/**
+ * @fn xml::reader::impl & xml::reader::impl::operator=(const impl &)
+ *
+ * @internal
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @enum xml::reader::node_type_id
+ *
+ * @brief The node type identifier.
+ *
+ * Due to the common heritage of XmlTextReader and XmlLite, the underlying
+ * APIs report consistent values that can be passed through directly to
+ * the @c xml::reader interface.
+ *
+ * @sa http://xmlsoft.org/html/libxml-xmlreader.html#xmlReaderTypes
+ * @sa http://msdn.microsoft.com/en-us/library/ms753141.aspx
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::none_id
+ *
+ * @brief The &ldquo;null&rdquo; type identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::element_id
+ *
+ * @brief Element identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::attribute_id
+ *
+ * @brief Attribute identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::text_id
+ *
+ * @brief Text identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::cdata_id
+ *
+ * @brief CDATA identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::processing_instruction_id
+ *
+ * @brief Processing instruction identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::comment_id
+ *
+ * @brief Comment identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::document_type_id
+ *
+ * @brief Document type identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::whitespace_id
+ *
+ * @brief Whitespace identifier.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::significant_whitespace_id
+ *
+ * @brief Significant whitespace identifier.
+ *
+ * libxml2 reports whitespace-only text in element content this way unless
+ * a DTD says that the element's content is elements only.  XmlLite does
+ * not distinguish it from @c #whitespace_id.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::end_element_id
+ *
+ * @brief Element end tag identifier.
+ *
+ * Unlike SAX, where you get an &ldquo;end of element&rdquo; callback at
+ * the logical element boundary, @c #node_type only returns this value
+ * when the current node is a literal end tag.
+ */
+
+/**
+ * @var xml::reader::node_type_id xml::reader::xml_declaration_id
+ *
+ * @brief XML declaration identifier.
+ */
+
+/**
+ * @brief Construct from a file name.
+ *
+ * @param[in] filename  the full path to a file.
+ * @param[in] options   reader options.
+ *
+ * @exception std::runtime_error    if opening @p filename or creating the
+ *                                  underlying XML reader fails.
+ * @exception std::logic_error      if @p options combines
+ *                                  @c reader_options::entities with
+ *                                  @c reader_options::max_entity_expansions
+ *                                  or @c reader_options::track_offsets.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::reader::reader(const std::string & filename,
+                    const reader_options & options):
+    impl_{new impl{filename, checked_options(options)}}
+{
+    this->start_pipeline(options);
+}
+
+/**
+ * @brief Construct from an input stream.
+ *
+ * @param[in,out] in        an input stream.
+ * @param[in]     options   reader options.
+ *
+ * @exception std::runtime_error    if creating the underlying XML reader
+ *                                  fails.
+ * @exception std::logic_error      if @p options combines
+ *                                  @c reader_options::entities with
+ *                                  @c reader_options::max_entity_expansions
+ *                                  or @c reader_options::track_offsets.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::reader::reader(std::istream & in, const reader_options & options):
+    impl_{new impl{in, checked_options(options)}}
+{
+    this->start_pipeline(options);
+}
+
+/**
+ * @brief Construct from a buffer in memory.
+ *
+ * The buffer is read in place; it must remain valid, and unchanged, for
+ * the lifetime of the reader.  With @c reader_options::fragment, this
+ * reads a fragment without copying it into a wrapper document.
+ *
+ * @param[in] data      the input.
+ * @param[in] size      the size of @p data in bytes.
+ * @param[in] options   reader options.
+ *
+ * @exception std::runtime_error    if creating the underlying XML reader
+ *                                  fails.
+ * @exception std::logic_error      if @p options combines
+ *                                  @c reader_options::entities with
+ *                                  @c reader_options::max_entity_expansions
+ *                                  or @c reader_options::track_offsets.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::reader::reader(const char * const data,
+                    const std::size_t size,
+                    const reader_options & options):
+    impl_{new impl{data, size, checked_options(options)}}
+{
+    this->start_pipeline(options);
+}
+
+namespace
+{
+    std::istream & seek(std::istream & in, const std::uint64_t offset)
+    {
+        in.clear();
+        if (!in.seekg(std::streamoff(offset))) {
+            throw std::runtime_error{"failed to seek to checkpoint"};
+        }
+        return in;
+    }
+
+    const xml::reader_options
+    resume_options(const xml::reader_checkpoint & from,
+                   const xml::reader_options & options)
+    {
+        xml::reader_options result = options;
+        result.track_offsets = true;
+        result.input_offset = from.offset;
+        result.input_line = from.line;
+        result.input_column = from.column;
+        result.input_length = 0;
+        result.namespaces = from.namespaces;
+        result.open_elements = from.open_elements;
+        return result;
+    }
+}
+
+/**
+ * @brief Resume reading a document from a checkpoint.
+ *
+ * @p in is positioned at the checkpoint, and reading continues with the
+ * node following the one at which the checkpoint was taken.  Offsets are
+ * tracked, so that further checkpoints may be taken.
+ *
+ * @param[in,out] in        the document from which the checkpoint was
+ *                          taken; it must be seekable.
+ * @param[in]     from      a checkpoint.
+ * @param[in]     options   reader options; the @c input_ options,
+ *                          @c namespaces and @c open_elements are set from
+ *                          @p from.
+ *
+ * @exception std::runtime_error    if @p in cannot be positioned, or
+ *                                  XmlLite/libxml2 setup fails.
+ * @exception std::logic_error      if @p options sets
+ *                                  @c reader_options::entities (offsets are
+ *                                  tracked from a checkpoint).
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::reader::reader(std::istream & in,
+                    const reader_checkpoint & from,
+                    const reader_options & options):
+    impl_{new impl{seek(in, from.offset),
+                    checked_options(resume_options(from, options))}}
+{
+    this->start_pipeline(options);
+}
+
+/**
+ * @brief Replay a recording.
+ *
+ * The reader reports the recorded nodes, with their names, values, and
+ * attributes, without parsing.  Column numbers are not recorded, and are
+ * reported as 0; offsets are not tracked, and no counters are maintained.
+ * Only elements have attributes; libxml2 also reports an element's
+ * attributes on its end element.
+ *
+ * @param[in] events    a recording.
+ *
+ * @exception std::runtime_error    on reading, if the recording is
+ *                                  corrupt.
+ * @exception std::bad_alloc        if memory allocation fails.
+ *
+ * @sa xml::record_events
+ */
+xml::reader::reader(const event_recording & events):
+    replay_{new detail::event_replay{events}}
+{}
+
+/**
+ * @fn xml::reader::reader(const reader &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Move constuct.
+ */
+xml::reader::reader(reader && r) throw ():
+    impl_{std::move(r.impl_)},
+    replay_{std::move(r.replay_)},
+    mark_{std::move(r.mark_)},
+    pipeline_{std::move(r.pipeline_)}
+{}
+
+/**
+ * @brief Destroy.
+ */
+xml::reader::~reader() throw ()
+{}
+
+/**
+ * @fn xml::reader & xml::reader::operator=(const reader &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Move assign.
+ */
+xml::reader & xml::reader::operator=(reader && r) throw ()
+{
+    this->impl_ = std::move(r.impl_);
+    this->replay_ = std::move(r.replay_);
+    this->mark_ = std::move(r.mark_);
+    this->pipeline_ = std::move(r.pipeline_);
+    return *this;
+}
+
+/**
+ * @internal
+ *
+ * @brief If @c reader_options::pipelined is set, hand the underlying
+ *        reader to a pipeline that reads it on another thread.
+ *
+ * @param[in] options   reader options.
+ *
+ * @exception std::system_error if the thread cannot be started.
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void xml::reader::start_pipeline(const reader_options & options)
+{
+    if (!options.pipelined) { return; }
+    std::unique_ptr<detail::event_pipeline> pipeline{
+        new detail::event_pipeline{reader{std::move(*this)},
+                                   options.cancel}};
+    this->replay_ = pipeline->start();
+    this->pipeline_ = std::move(pipeline);
+}
+
+/**
+ * @brief Advance to the next node in the stream.
+ *
+ * @retval true if the node was read successfully
+ * @retval false if there are no more nodes to read
+ *
+ * @exception xml::parse_error      if there is an error in the input.
+ * @exception xml::cancelled_error  if reading has been cancelled.
+ */
+bool xml::reader::read()
+{
+    //
+    // The producing thread stops at the flag, but the blocks it has
+    // already passed on must not be read either.
+    //
+    if (this->pipeline_ && this->pipeline_->cancelled()) {
+        throw cancelled_error{};
+    }
+    bool result = false;
+    if (this->replay_) {
+        result = this->replay_->read();
+        //
+        // When the nodes replayed after a rewind run out, reading continues
+        // from where it left off.
+        //
+        while (!result && this->replay_ && this->replay_->rewound) {
+            this->replay_ = std::move(this->replay_->underlying);
+            result = this->replay_ ? this->replay_->read()
+                                   : this->impl_->read();
+        }
+        //
+        // A pipelined reader moves on to the next block; the last one is
+        // kept, so that the reader stays at the end.
+        //
+        while (!result && this->pipeline_) {
+            std::unique_ptr<detail::event_replay> next =
+                this->pipeline_->next();
+            if (!next) { break; }
+            this->replay_ = std::move(next);
+            result = this->replay_->read();
+        }
+    } else if (!this->impl_->collect_stats) {
+        result = this->impl_->read();
+    } else {
+        using std::chrono::steady_clock;
+        const steady_clock::time_point start = steady_clock::now();
+        result = this->impl_->read();
+        this->impl_->stats.read_time += steady_clock::now() - start;
+        if (result) { this->impl_->record_node(); }
+    }
+
+    if (result && this->mark_ && !this->mark_->exceeded) {
+        detail::reader_mark & m = *this->mark_;
+        m.events.node(*this);
+        if (m.events.data().size() > m.lookahead) {
+            m.exceeded = true;
+            std::string{}.swap(m.events.data());
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Read nodes until the input ends or @p budget is used up.
+ *
+ * @p on_node is called with the reader positioned on each node read.
+ * Reading can be resumed with another call, so that reading a large
+ * document can be interleaved with other work.
+ *
+ * @param[in] budget    the limits on the nodes read by this call.
+ * @param[in] on_node   called for each node.
+ *
+ * @retval true if @p budget was used up before the input ended
+ * @retval false if there are no more nodes to read
+ *
+ * @exception xml::parse_error      if there is an error in the input.
+ * @exception xml::cancelled_error  if reading has been cancelled.
+ * @exception ...                   any exception thrown by @p on_node.
+ */
+bool xml::reader::read_for(const read_budget & budget,
+                           const std::function<void (reader &)> & on_node)
+{
+    using std::chrono::steady_clock;
+    const bool timed = budget.time.count() > 0;
+    const steady_clock::time_point deadline =
+        timed ? steady_clock::now() + budget.time : steady_clock::time_point{};
+    for (std::size_t count = 0;
+         budget.nodes == 0 || count < budget.nodes;
+         ++count) {
+        if (timed && steady_clock::now() >= deadline) { return true; }
+        if (!this->read()) { return false; }
+        on_node(*this);
+    }
+    return true;
+}
+
+/**
+ * @brief Skip the content of the current element.
+ *
+ * If the reader is positioned on an element (or one of its attributes)
+ * that is not empty, nodes are read up to and including the element's end
+ * element; otherwise, the reader is not moved.  Either way, if offsets are
+ * tracked, the element's spans are then available from @c #outer_span and
+ * @c #inner_span.
+ *
+ * @exception xml::parse_error      if there is an error in the input.
+ * @exception xml::cancelled_error  if reading has been cancelled.
+ */
+void xml::reader::skip()
+{
+    this->move_to_element();
+    if (this->node_type() != element_id || this->empty_element()) { return; }
+    const std::size_t depth = this->depth();
+    while (this->read()) {
+        if (this->node_type() == end_element_id && this->depth() == depth) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Move on to the next document in the input.
+ *
+ * The reader must have been constructed with
+ * @c reader_options::multiple_documents set.  Any nodes remaining in the
+ * current document are read and discarded, and any mark is abandoned;
+ * then, if another document follows, the reader is positioned before its
+ * first node.  The underlying parser is reused.
+ *
+ * @code
+ * do {
+ *     while (r.read()) {
+ *         // ...
+ *     }
+ * } while (r.next_document());
+ * @endcode
+ *
+ * @retval true if there is another document
+ * @retval false if the input has ended
+ *
+ * @exception xml::parse_error      if there is an error in the rest of the
+ *                                  current document.
+ * @exception std::logic_error      if the reader does not read multiple
+ *                                  documents.
+ * @exception std::runtime_error    if reading the input fails, or
+ *                                  XmlLite/libxml2 setup fails.
+ */
+bool xml::reader::next_document()
+{
+    this->mark_.reset();
+    while (this->replay_ && this->replay_->rewound) {
+        this->replay_ = std::move(this->replay_->underlying);
+    }
+    if (!this->impl_) { return false; }
+    return this->impl_->next_document();
+}
+
+/**
+ * @brief Read a new document from a file, reusing the underlying parser.
+ *
+ * The reader continues with the options it was constructed with, and is
+ * positioned before the first node of the document in @p filename.  Any
+ * mark is abandoned.  This saves setting up a parser for each of many
+ * small documents.
+ *
+ * If @p filename cannot be opened, an exception is thrown and the reader
+ * should not be used further, other than to be reset again or destroyed.
+ *
+ * @param[in] filename  a UTF-8-encoded file name.
+ *
+ * @exception std::logic_error      if the reader replays a recording or
+ *                                  is pipelined.
+ * @exception std::runtime_error    if @p filename cannot be opened, or
+ *                                  XmlLite/libxml2 setup fails.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+void xml::reader::reset(const std::string & filename)
+{
+    this->mark_.reset();
+    while (this->replay_ && this->replay_->rewound) {
+        this->replay_ = std::move(this->replay_->underlying);
+    }
+    if (!this->impl_ || this->pipeline_) {
+        throw std::logic_error{"the reader cannot be reset"};
+    }
+    this->impl_->reset(filename);
+}
+
+/**
+ * @brief The line number of the current parsing position.
+ *
+ * @return the line number of the current parsing position.
+ */
+size_t xml::reader::line() const throw ()
+{
+    if (this->replay_) { return this->replay_->line(); }
+    return this->impl_->line();
+}
+
+/**
+ * @brief The column number of the current parsing position.
+ *
+ * @return the column number of the current parsing position.
+ */
+size_t xml::reader::col() const throw ()
+{
+    if (this->replay_) { return this->replay_->col(); }
+# ifdef HAVE_XMLLITE
+    UINT column_number = 0;
+    this->impl_->reader->GetLinePosition(&column_number);
+    return column_number;
+# else
+    return xmlTextReaderGetParserColumnNumber(this->impl_->reader);
+# endif
+}
+
+/**
+ * @brief The type of the current node.
+ *
+ * @return the type of the current node.
+ */
+xml::reader::node_type_id xml::reader::node_type() const throw ()
+{
+    if (this->replay_) { return this->replay_->node_type(); }
+# ifdef HAVE_XMLLITE
+    XmlNodeType type;
+    this->impl_->reader->GetNodeType(&type);
+    return static_cast<node_type_id>(type);
+# else
+    return static_cast<node_type_id>(
+        xmlTextReaderNodeType(this->impl_->reader));
+# endif
+}
+
+/**
+ * @brief The depth of the current node in the document tree.
+ *
+ * The document element is at depth 0; attributes are one deeper than
+ * their element.
+ *
+ * @return the depth of the current node.
+ */
+std::size_t xml::reader::depth() const throw ()
+{
+    if (this->replay_) { return this->replay_->depth(); }
+    return this->impl_->depth();
+}
+
+/**
+ * @brief Whether the current element is empty.
+ *
+ * @retval true if the current element is empty.
+ * @retval false if the current element is not empty.
+ */
+bool xml::reader::empty_element() const throw ()
+{
+    if (this->replay_) { return this->replay_->empty_element(); }
+# ifdef HAVE_XMLLITE
+    return this->impl_->reader->IsEmptyElement() == TRUE;
+# else
+    //
+    // xmlTextReaderIsEmptyElement may return -1 if the function is not
+    // applicable to the current context.  XmlLite just returns 'false' in
+    // that case.
+    //
+    const int result = xmlTextReaderIsEmptyElement(this->impl_->reader);
+    return result == 1;
+# endif
+}
+
+/**
+ * @brief The local (i.e., unqualified) name of the node.
+ *
+ * @return the local name of the node.
+ *
+ * @exception std::runtime_error    if there is an error getting the name.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+const std::string xml::reader::local_name() const
+{
+    if (this->replay_) { return this->replay_->node_name().local.str(); }
+# ifdef HAVE_XMLLITE
+    const WCHAR * name;
+    UINT length;
+    HRESULT hr = this->impl_->reader->GetLocalName(&name, &length);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to get element name"};
+    }
+    if (this->impl_->collect_stats) { ++this->impl_->stats.string_allocations; }
+    return detail::utf16_to_utf8(name, name + length);
+# else
+    const xmlChar * name = xmlTextReaderConstLocalName(this->impl_->reader);
+    if (name == nullptr) {
+        throw std::runtime_error{"failed to get element name"};
+    }
+    if (this->impl_->collect_stats) { ++this->impl_->stats.string_allocations; }
+    return std::string{name, name + xmlStrlen(name)};
+# endif
+}
+
+/**
+ * @brief The qualified name of the node.
+ *
+ * @return the qualified name of the node.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+const std::string xml::reader::qualified_name() const
+{
+    if (this->replay_) { return this->replay_->node_name().qualified.str(); }
+# ifdef HAVE_XMLLITE
+    const WCHAR * name;
+    UINT length;
+    HRESULT hr = this->impl_->reader->GetQualifiedName(&name, &length);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to get element name"};
+    }
+    if (this->impl_->collect_stats) { ++this->impl_->stats.string_allocations; }
+    return detail::utf16_to_utf8(name, name + length);
+# else
+    const xmlChar * name = xmlTextReaderConstName(this->impl_->reader);
+    if (name == nullptr) {
+        throw std::runtime_error{"failed to get element name"};
+    }
+    if (this->impl_->collect_stats) { ++this->impl_->stats.string_allocations; }
+    return std::string{name, name + xmlStrlen(name)};
+# endif
+}
+
+/**
+ * @brief The text value of the node, if any.
+ *
+ * @return the text value of the node.
+ *
+ * @exception std::runtime_error    if there is an error getting the value.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+const std::string xml::reader::value() const
+{
+    if (this->replay_) { return this->replay_->value().str(); }
+# ifdef HAVE_XMLLITE
+    const WCHAR * val = 0;
+    UINT length = 0;
+    HRESULT hr = this->impl_->reader->GetValue(&val, &length);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to get a value"};
+    }
+    if (this->impl_->collect_stats) { ++this->impl_->stats.string_allocations; }
+    return detail::utf16_to_utf8(val, val + length);
+# else
+    const xmlChar * val = [this]{
+        detail::memory_scope scope{this->impl_->memory};
+        return xmlTextReaderConstValue(this->impl_->reader);
+    }();
+    if (val == nullptr) {
+        //
+        // libxml2 has no value for a processing instruction without data;
+        // XmlLite reports an empty one.
+        //
+        if (xmlTextReaderNodeType(this->impl_->reader)
+            == XML_READER_TYPE_PROCESSING_INSTRUCTION) {
+            return std::string{};
+        }
+        throw std::runtime_error{"failed to get a value"};
+    }
+    if (this->impl_->collect_stats) { ++this->impl_->stats.string_allocations; }
+    return std::string{val, val + xmlStrlen(val)};
+# endif
+}
+
+/**
+ * @brief The local name of the node, without copying it.
+ *
+ * @return the local name of the node.  The referenced string remains valid
+ *         until the reader moves to another node or attribute.
+ *
+ * @exception std::runtime_error    if there is an error getting the name.
+ * @exception std::bad_alloc        if memory allocation fails.
+ *
+ * @sa #local_name
+ */
+xml::string_ref xml::reader::local_name_ref() const
+{
+    if (this->replay_) { return this->replay_->node_name().local; }
+# ifdef HAVE_XMLLITE
+    const WCHAR * name;
+    UINT length;
+    HRESULT hr = this->impl_->reader->GetLocalName(&name, &length);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to get element name"};
+    }
+    this->impl_->name_utf8 = detail::utf16_to_utf8(name, name + length);
+    return string_ref{this->impl_->name_utf8};
+# else
+    const xmlChar * name = xmlTextReaderConstLocalName(this->impl_->reader);
+    if (name == nullptr) {
+        throw std::runtime_error{"failed to get element name"};
+    }
+    return string_ref{reinterpret_cast<const char *>(name),
+                      size_t(xmlStrlen(name))};
+# endif
+}
+
+/**
+ * @brief The qualified name of the node, without copying it.
+ *
+ * @return the qualified name of the node.  The referenced string remains
+ *         valid until the reader moves to another node or attribute.
+ *
+ * @exception std::runtime_error    if there is an error getting the name.
+ * @exception std::bad_alloc        if memory allocation fails.
+ *
+ * @sa #qualified_name
+ */
+xml::string_ref xml::reader::qualified_name_ref() const
+{
+    if (this->replay_) { return this->replay_->node_name().qualified; }
+# ifdef HAVE_XMLLITE
+    const WCHAR * name;
+    UINT length;
+    HRESULT hr = this->impl_->reader->GetQualifiedName(&name, &length);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to get element name"};
+    }
+    this->impl_->name_utf8 = detail::utf16_to_utf8(name, name + length);
+    return string_ref{this->impl_->name_utf8};
+# else
+    const xmlChar * name = xmlTextReaderConstName(this->impl_->reader);
+    if (name == nullptr) {
+        throw std::runtime_error{"failed to get element name"};
+    }
+    return string_ref{reinterpret_cast<const char *>(name),
+                      size_t(xmlStrlen(name))};
+# endif
+}
+
+/**
+ * @brief The text value of the node, if any, without copying it.
+ *
+ * With libxml2, the referenced string is null-terminated.
+ *
+ * @return the text value of the node.  The referenced string remains valid
+ *         until the reader moves to another node or attribute.
+ *
+ * @exception std::runtime_error    if there is an error getting the value.
+ * @exception std::bad_alloc        if memory allocation fails.
+ *
+ * @sa #value
+ */
+xml::string_ref xml::reader::value_ref() const
+{
+    if (this->replay_) { return this->replay_->value(); }
+# ifdef HAVE_XMLLITE
+    const WCHAR * val = 0;
+    UINT length = 0;
+    HRESULT hr = this->impl_->reader->GetValue(&val, &length);
+    if (FAILED(hr)) {
+        throw std::runtime_error{"failed to get a value"};
+    }
+    this->impl_->value_utf8 = detail::utf16_to_utf8(val, val + length);
+    return string_ref{this->impl_->value_utf8};
+# else
+    const xmlChar * val = [this]{
+        detail::memory_scope scope{this->impl_->memory};
+        return xmlTextReaderConstValue(this->impl_->reader);
+    }();
+    if (val == nullptr) {
+        if (xmlTextReaderNodeType(this->impl_->reader)
+            == XML_READER_TYPE_PROCESSING_INSTRUCTION) {
+            return string_ref{};
+        }
+        throw std::runtime_error{"failed to get a value"};
+    }
+    return string_ref{reinterpret_cast<const char *>(val),
+                      size_t(xmlStrlen(val))};
+# endif
+}
+
+/**
+ * @brief The namespace URI of the node, if any.
+ *
+ * @return the namespace URI of the node; or an empty string if the node is
+ *         not in a namespace.  The referenced string remains valid until
+ *         the reader moves to another node or attribute.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+xml::string_ref xml::reader::namespace_uri() const
+{
+    if (this->replay_) { return this->replay_->node_name().uri; }
+# ifdef HAVE_XMLLITE
+    const WCHAR * uri = 0;
+    UINT length = 0;
+    HRESULT hr = this->impl_->reader->GetNamespaceUri(&uri, &length);
+    if (FAILED(hr) || length == 0) { return string_ref{}; }
+    this->impl_->namespace_uri_utf8 = detail::utf16_to_utf8(uri, uri + length);
+    return string_ref{this->impl_->namespace_uri_utf8};
+# else
+    const xmlChar * const uri =
+        xmlTextReaderConstNamespaceUri(this->impl_->reader);
+    if (!uri) { return string_ref{}; }
+    return string_ref{reinterpret_cast<const char *>(uri),
+                      size_t(xmlStrlen(uri))};
+# endif
+}
+
+/**
+ * @brief An identifier for the namespace URI of the node.
+ *
+ * Identifiers are small integers assigned by the reader as it encounters
+ * namespace URIs; a given URI has the same identifier for the lifetime of
+ * the reader.  Comparing identifiers is cheaper than comparing URIs.
+ *
+ * @return an identifier for the namespace URI of the node; 0 if the node
+ *         is not in a namespace.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ *
+ * @sa #namespace_id(const string_ref &) const
+ */
+std::size_t xml::reader::namespace_id() const
+{
+    if (this->replay_) { return this->replay_->node_name().namespace_id; }
+# ifdef HAVE_XMLLITE
+    return this->impl_->intern_namespace(this->namespace_uri());
+# else
+    impl & i = *this->impl_;
+    const xmlChar * const uri = xmlTextReaderConstNamespaceUri(i.reader);
+    if (!uri) { return 0; }
+    if (uri == i.last_namespace_uri) { return i.last_namespace_id; }
+    std::size_t & id = i.namespace_ids_by_name[uri];
+    if (id == 0) {
+        id = i.intern_namespace(
+            string_ref{reinterpret_cast<const char *>(uri),
+                       size_t(xmlStrlen(uri))});
+    }
+    i.last_namespace_uri = uri;
+    i.last_namespace_id = id;
+    return id;
+# endif
+}
+
+/**
+ * @brief The identifier for a namespace URI.
+ *
+ * Use this to obtain identifiers for the namespaces of interest, to compare
+ * against the result of @c #namespace_id().
+ *
+ * @param[in] uri   a namespace URI.
+ *
+ * @return the identifier for @p uri; 0 if @p uri is empty.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+std::size_t xml::reader::namespace_id(const string_ref & uri) const
+{
+    if (this->replay_) { return this->replay_->intern_namespace(uri); }
+    return this->impl_->intern_namespace(uri);
+}
+
+/**
+ * @brief Move from an attribute back to its element.
+ *
+ * Has no effect if the reader is not positioned on an attribute.
+ */
+void xml::reader::move_to_element()
+{
+    if (this->replay_) { return this->replay_->move_to_element(); }
+# ifdef HAVE_XMLLITE
+    this->impl_->reader->MoveToElement();
+# else
+    xmlTextReaderMoveToElement(this->impl_->reader);
+# endif
+}
+
+/**
+ * @brief Move to the first attribute associated with the current node.
+ *
+ * @retval true on success
+ * @retval false if the current node has no attributes
+ *
+ * @exception xml::parse_error  if there is an error in the input.
+ */
+bool xml::reader::move_to_first_attribute()
+{
+    if (this->replay_) { return this->replay_->move_to_first_attribute(); }
+# ifdef HAVE_XMLLITE
+    HRESULT hr = this->impl_->reader->MoveToFirstAttribute();
+    if (FAILED(hr)) {
+        if (detail::is_xmllite_reader_error(hr)) {
+            detail::throw_parse_error(*this->impl_->reader, hr);
+        }
+    }
+    return hr == S_OK;
+# else
+    detail::memory_scope scope{this->impl_->memory};
+    const int result = xmlTextReaderMoveToFirstAttribute(this->impl_->reader);
+    if (result < 0) { throw this->impl_->error.last; }
+    return result;
+# endif
+}
+
+/**
+ * @brief Move to the next attribute associated with the current node.
+ *
+ * @retval true on success
+ * @retval false if the current node has no more attributes
+ *
+ * @exception xml::parse_error  if there is an error in the input.
+ */
+bool xml::reader::move_to_next_attribute()
+{
+    if (this->replay_) { return this->replay_->move_to_next_attribute(); }
+# ifdef HAVE_XMLLITE
+    HRESULT hr = this->impl_->reader->MoveToNextAttribute();
+    if (FAILED(hr)) {
+        if (detail::is_xmllite_reader_error(hr)) {
+            detail::throw_parse_error(*this->impl_->reader, hr);
+        }
+    }
+    return hr == S_OK;
+# else
+    detail::memory_scope scope{this->impl_->memory};
+    const int result = xmlTextReaderMoveToNextAttribute(this->impl_->reader);
+    if (result < 0) { throw this->impl_->error.last; }
+    return result;
+# endif
+}
+
+namespace {
+
+    void throw_invalid_number(const xml::reader & r,
+                              const char * const begin,
+                              const char * const end)
+    {
+        const char * const last =
+            xml::detail::find_number_delimiter(begin, end);
+        throw xml::parse_error{r.line(),
+                               "invalid number \""
+                               + std::string(begin, last) + "\""};
+    }
+
+    //
+    // Converts text that may arrive in several pieces.  A number split
+    // between pieces is joined in a small buffer; everything else is
+    // converted where it lies.
+    //
+    template <typename T>
+    class number_list {
+        const xml::reader & reader_;
+        std::vector<T> & out_;
+        std::string partial_;
+
+    public:
+        number_list(const xml::reader & r, std::vector<T> & out):
+            reader_(r),
+            out_(out)
+        {}
+
+        void add(const xml::string_ref & text, const bool final)
+        {
+            const char * p = text.begin();
+            const char * const end = text.end();
+            if (!this->partial_.empty()) {
+                const char * const last =
+                    xml::detail::find_number_delimiter(p, end);
+                this->partial_.append(p, last);
+                if (last == end && !final) { return; }
+                this->flush();
+                p = last;
+            }
+            if (!xml::detail::parse_numbers(p, end, final, this->out_)) {
+                throw_invalid_number(this->reader_, p, end);
+            }
+            this->partial_.assign(p, end);
+        }
+
+        void flush()
+        {
+            const char * p = this->partial_.data();
+            const char * const end = p + this->partial_.size();
+            if (!xml::detail::parse_numbers(p, end, true, this->out_)) {
+                throw_invalid_number(this->reader_, p, end);
+            }
+            this->partial_.clear();
+        }
+    };
+}
+
+/**
+ * @brief Convert the text content of the current node to a list of
+ *        numbers.
+ *
+ * The numbers are separated by whitespace or commas, as in the numeric
+ * list attributes and content of X3D and similar formats.  They are
+ * converted directly from the parser's buffer and appended to @p out.
+ *
+ * If the reader is positioned on an element, its text content is
+ * converted, and the reader is left on its end element (or on the element,
+ * if it is empty); text in child elements is not included.  If it is on a
+ * text or CDATA node, just that node is converted.
+ *
+ * @c T may be @c std::int32_t, @c std::uint32_t, @c std::int64_t,
+ * @c std::uint64_t, @c float or @c double.
+ *
+ * @param[in,out] out   the numbers are appended to this.
+ *
+ * @return the number of numbers appended.
+ *
+ * @exception xml::parse_error      if a number is not valid for @c T, or
+ *                                  there is an error in the input.
+ * @exception std::logic_error      if the reader is not positioned on an
+ *                                  element or text.
+ * @exception xml::cancelled_error  if reading has been cancelled.
+ * @exception std::bad_alloc        if memory allocation fails.
  */
-xml::reader & xml::reader::operator=(reader && r) throw ()
+template <typename T>
+std::size_t xml::reader::read_numbers(std::vector<T> & out)
 {
-    this->impl_ = std::move(r.impl_);
-    return *this;
+    const std::size_t count = out.size();
+    number_list<T> numbers{*this, out};
+    switch (this->node_type()) {
+    case text_id:
+    case cdata_id:
+    case whitespace_id:
+    case significant_whitespace_id:
+        numbers.add(this->value_ref(), true);
+        return out.size() - count;
+    case element_id:
+        break;
+    default:
+        throw std::logic_error{
+            "numbers can only be read from an element or text"};
+    }
+
+    if (this->empty_element()) { return 0; }
+    const std::size_t depth = this->depth();
+    while (this->read()) {
+        switch (this->node_type()) {
+        case text_id:
+        case cdata_id:
+        case whitespace_id:
+        case significant_whitespace_id:
+            numbers.add(this->value_ref(), false);
+            break;
+        case element_id:
+            this->skip();
+            break;
+        case end_element_id:
+            if (this->depth() == depth) {
+                numbers.flush();
+                return out.size() - count;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    throw parse_error{this->line(), "unexpected end of document"};
 }
 
 /**
- * @brief Advance to the next node in the stream.
+ * @brief Convert the value of an attribute of the current element to a
+ *        list of numbers.
  *
- * @retval true if the node was read successfully
- * @retval false if there are no more nodes to read
+ * The numbers are separated by whitespace or commas, and are converted
+ * directly from the parser's buffer and appended to @p out.  The reader
+ * stays on the element.
  *
- * @exception xml::parse_error  if there is an error in the input.
+ * @c T may be @c std::int32_t, @c std::uint32_t, @c std::int64_t,
+ * @c std::uint64_t, @c float or @c double.
+ *
+ * @param[in]     name  the qualified name of the attribute.
+ * @param[in,out] out   the numbers are appended to this.
+ *
+ * @retval true if the element has the attribute
+ * @retval false otherwise
+ *
+ * @exception xml::parse_error      if a number is not valid for @c T, or
+ *                                  there is an error in the input.
+ * @exception std::bad_alloc        if memory allocation fails.
  */
-bool xml::reader::read()
+template <typename T>
+bool xml::reader::attribute_numbers(const string_ref & name,
+                                    std::vector<T> & out)
 {
-# ifdef HAVE_XMLLITE
-    HRESULT hr = this->impl_->reader->Read(0);
-    if (FAILED(hr)) {
-        if (detail::is_xmllite_reader_error(hr)) {
-            detail::throw_parse_error(*this->impl_->reader, hr);
+    this->move_to_element();
+    if (!this->move_to_first_attribute()) { return false; }
+    do {
+        if (this->qualified_name_ref() == name) {
+            number_list<T> numbers{*this, out};
+            try {
+                numbers.add(this->value_ref(), true);
+            } catch (...) {
+                this->move_to_element();
+                throw;
+            }
+            this->move_to_element();
+            return true;
         }
-    }
-    return hr == S_OK;
-# else
-    const int result = xmlTextReaderRead(this->impl_->reader);
-    if (result < 0) { throw this->impl_->error; }
-    return result;
-# endif
+    } while (this->move_to_next_attribute());
+    this->move_to_element();
+    return false;
 }
 
+template std::size_t
+xml::reader::read_numbers(std::vector<std::int32_t> &);
+template std::size_t
+xml::reader::read_numbers(std::vector<std::uint32_t> &);
+template std::size_t
+xml::reader::read_numbers(std::vector<std::int64_t> &);
+template std::size_t
+xml::reader::read_numbers(std::vector<std::uint64_t> &);
+template std::size_t xml::reader::read_numbers(std::vector<float> &);
+template std::size_t xml::reader::read_numbers(std::vector<double> &);
+
+template bool
+xml::reader::attribute_numbers(const string_ref &,
+                               std::vector<std::int32_t> &);
+template bool
+xml::reader::attribute_numbers(const string_ref &,
+                               std::vector<std::uint32_t> &);
+template bool
+xml::reader::attribute_numbers(const string_ref &,
+                               std::vector<std::int64_t> &);
+template bool
+xml::reader::attribute_numbers(const string_ref &,
+                               std::vector<std::uint64_t> &);
+template bool xml::reader::attribute_numbers(const string_ref &,
+                                             std::vector<float> &);
+template bool xml::reader::attribute_numbers(const string_ref &,
+                                             std::vector<double> &);
+
 /**
- * @brief The line number of the current parsing position.
+ * @brief Mark the current node, so that reading can return to it.
  *
- * @return the line number of the current parsing position.
+ * Nodes read after the mark are kept, compactly, until @c #rewind or
+ * @c #unmark, or until they exceed @p lookahead bytes; thereafter, the
+ * mark is abandoned, and @c #rewind fails.  Marking again replaces the
+ * mark.  If the reader is positioned on an attribute, it moves back to the
+ * element.
+ *
+ * @param[in] lookahead the maximum size, in bytes, of the nodes kept.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ *
+ * @sa #rewind
  */
-size_t xml::reader::line() const throw ()
+void xml::reader::mark(const std::size_t lookahead)
 {
-# ifdef HAVE_XMLLITE
-    UINT line_number = 0;
-    this->impl_->reader->GetLineNumber(&line_number);
-    return line_number;
-# else
-    return xmlTextReaderGetParserLineNumber(this->impl_->reader);
-# endif
+    if (this->mark_) {
+        this->mark_->events.clear();
+    } else {
+        this->mark_.reset(new detail::reader_mark);
+    }
+    detail::reader_mark & m = *this->mark_;
+    m.lookahead = lookahead;
+    m.exceeded = false;
+    this->move_to_element();
+    m.on_node = this->node_type() != none_id;
+    if (m.on_node) { m.events.node(*this); }
 }
 
 /**
- * @brief The column number of the current parsing position.
- *
- * @return the column number of the current parsing position.
+ * @brief Abandon the mark, if any.
  */
-size_t xml::reader::col() const throw ()
+void xml::reader::unmark() throw ()
 {
-# ifdef HAVE_XMLLITE
-    UINT column_number = 0;
-    this->impl_->reader->GetLinePosition(&column_number);
-    return column_number;
-# else
-    return xmlTextReaderGetParserColumnNumber(this->impl_->reader);
-# endif
+    this->mark_.reset();
 }
 
 /**
- * @brief The type of the current node.
+ * @brief Return to the marked node.
  *
- * @return the type of the current node.
+ * The reader is positioned on the node that was current when @c #mark was
+ * called; subsequent reads return the same nodes again, then continue with
+ * the input.  The mark is consumed; it may be set again, anywhere.
+ *
+ * Nodes returned again report no column number, and have no tag location.
+ *
+ * @exception std::logic_error  if there is no mark, or the nodes read
+ *                              since it exceeded its lookahead.
+ * @exception std::bad_alloc    if memory allocation fails.
  */
-xml::reader::node_type_id xml::reader::node_type() const throw ()
+void xml::reader::rewind()
 {
-# ifdef HAVE_XMLLITE
-    XmlNodeType type;
-    this->impl_->reader->GetNodeType(&type);
-    return static_cast<node_type_id>(type);
-# else
-    return static_cast<node_type_id>(
-        xmlTextReaderNodeType(this->impl_->reader));
-# endif
+    if (!this->mark_) { throw std::logic_error{"no mark to rewind to"}; }
+    std::unique_ptr<detail::reader_mark> m = std::move(this->mark_);
+    if (m->exceeded) {
+        throw std::logic_error{"lookahead exceeded since the mark"};
+    }
+    m->events.finish();
+
+    //
+    // Namespace identifiers must stay consistent with those of the
+    // original source.
+    //
+    detail::event_replay::namespace_interner intern;
+    if (this->impl_) {
+        impl * const i = this->impl_.get();
+        intern = [i](const string_ref & uri) {
+            return i->intern_namespace(uri);
+        };
+    } else {
+        detail::event_replay * base = this->replay_.get();
+        while (base->underlying) { base = base->underlying.get(); }
+        intern = [base](const string_ref & uri) {
+            return base->intern_namespace(uri);
+        };
+    }
+
+    std::unique_ptr<detail::event_replay> replay{
+        new detail::event_replay{
+            detail::event_replay::recording(std::move(m->events.data())),
+            intern}};
+    replay->rewound = true;
+    replay->underlying = std::move(this->replay_);
+    this->replay_ = std::move(replay);
+    if (m->on_node) { this->replay_->read(); }
 }
 
 /**
- * @brief Whether the current element is empty.
+ * @brief The number of input bytes passed to the parser.
  *
- * @retval true if the current element is empty.
- * @retval false if the current element is not empty.
+ * This is suitable for reporting progress: the parser reads ahead in
+ * blocks, so it is some way past the current node.  Use @c #tag_location
+ * for the exact location of a tag.
+ *
+ * For input read as element content, this includes
+ * @c reader_options::input_offset; and it is not reset by
+ * @c #next_document.  A pipelined reader reports the offset as of the end
+ * of the block of nodes being read; a reader replaying a recording reports
+ * 0.
+ *
+ * @return the number of input bytes passed to the parser.
  */
-bool xml::reader::empty_element() const throw ()
+std::uint64_t xml::reader::byte_offset() const throw ()
 {
-# ifdef HAVE_XMLLITE
-    return this->impl_->reader->IsEmptyElement() == TRUE;
-# else
-    //
-    // xmlTextReaderIsEmptyElement may return -1 if the function is not
-    // applicable to the current context.  XmlLite just returns 'false' in
-    // that case.
-    //
-    const int result = xmlTextReaderIsEmptyElement(this->impl_->reader);
-    return result == 1;
-# endif
+    if (this->pipeline_) { return this->pipeline_->byte_offset(); }
+    if (!this->impl_) { return 0; }
+    const impl & i = *this->impl_;
+    return i.source ? i.options.input_offset + i.source->delivered
+                    : i.bytes_consumed();
 }
 
 /**
- * @brief The local (i.e., unqualified) name of the node.
+ * @brief The location in the input of the current node's tag.
  *
- * @return the local name of the node.
+ * The reader must have been constructed with
+ * @c reader_options::track_offsets set, and be positioned on an element
+ * (for its start or empty-element tag) or an end element (for its end
+ * tag).  Elements produced by entity expansion have no tag.
  *
- * @exception std::runtime_error    if there is an error getting the name.
- * @exception std::bad_alloc        if memory allocation fails.
+ * @return the location of the current node's tag.
+ *
+ * @exception std::logic_error  if offsets are not tracked, or the current
+ *                              node has no tag.
  */
-const std::string xml::reader::local_name() const
+const xml::source_location xml::reader::tag_location() const
 {
-# ifdef HAVE_XMLLITE
-    const WCHAR * name;
-    UINT length;
-    HRESULT hr = this->impl_->reader->GetLocalName(&name, &length);
-    if (FAILED(hr)) {
-        throw std::runtime_error{"failed to get element name"};
+    if (this->pipeline_) {
+        throw std::logic_error{"offsets are not tracked by a pipelined "
+                               "reader"};
     }
-    return detail::utf16_to_utf8(name, name + length);
-# else
-    const xmlChar * name = xmlTextReaderConstLocalName(this->impl_->reader);
-    if (name == nullptr) {
-        throw std::runtime_error{"failed to get element name"};
+    if (this->replay_) {
+        throw std::logic_error{"offsets are not tracked by this reader"};
     }
-    return std::string{name, name + xmlStrlen(name)};
-# endif
+    if (!this->impl_->scanner) {
+        throw std::logic_error{"offsets are not tracked by this reader"};
+    }
+    if (!this->impl_->located) {
+        throw std::logic_error{"the current node has no tag"};
+    }
+    return this->impl_->location;
 }
 
 /**
- * @brief The qualified name of the node.
+ * @internal
  *
- * @return the qualified name of the node.
+ * @brief Get the text of one of the spans of the element ended by the
+ *        current node.
  *
- * @exception std::bad_alloc    if memory allocation fails.
+ * @param[in] outer whether to get the outer span, rather than the inner.
+ *
+ * @return the text of the span.
+ *
+ * @exception std::logic_error  if the spans of the current node are not
+ *                              available.
  */
-const std::string xml::reader::qualified_name() const
+xml::string_ref xml::reader::span_text(const bool outer) const
 {
-# ifdef HAVE_XMLLITE
-    const WCHAR * name;
-    UINT length;
-    HRESULT hr = this->impl_->reader->GetQualifiedName(&name, &length);
-    if (FAILED(hr)) {
-        throw std::runtime_error{"failed to get element name"};
+    if (this->pipeline_) {
+        throw std::logic_error{"offsets are not tracked by a pipelined "
+                               "reader"};
     }
-    return detail::utf16_to_utf8(name, name + length);
-# else
-    const xmlChar * name = xmlTextReaderConstName(this->impl_->reader);
-    if (name == nullptr) {
-        throw std::runtime_error{"failed to get element name"};
+    if (this->replay_ || !this->impl_->scanner) {
+        throw std::logic_error{"offsets are not tracked by this reader"};
     }
-    return std::string{name, name + xmlStrlen(name)};
-# endif
+    const impl & i = *this->impl_;
+    if (!i.source || !i.source->data_begin) {
+        throw std::logic_error{"the reader is not reading a buffer in memory"};
+    }
+    if (!i.spanned) {
+        throw std::logic_error{"the current node does not end an element"};
+    }
+    const source_location & span = outer ? i.outer_span : i.inner_span;
+    return string_ref{
+        i.source->data_begin + (span.offset - i.options.input_offset),
+        std::size_t(span.end - span.offset)};
 }
 
 /**
- * @brief The text value of the node, if any.
+ * @brief The text of the element ended by the current node, including its
+ *        tags.
  *
- * @return the text value of the node.
+ * The reader must have been constructed from a buffer in memory with
+ * @c reader_options::track_offsets set, and be positioned on an end
+ * element or an empty element; for instance, after @c #skip.  The result
+ * is part of the buffer, exactly as it appears there.
  *
- * @exception std::runtime_error    if there is an error getting the value.
- * @exception std::bad_alloc        if memory allocation fails.
+ * @return the text of the element.
+ *
+ * @exception std::logic_error  if the spans of the current node are not
+ *                              available.
  */
-const std::string xml::reader::value() const
+xml::string_ref xml::reader::outer_span() const
 {
-# ifdef HAVE_XMLLITE
-    const WCHAR * val = 0;
-    UINT length = 0;
-    HRESULT hr = this->impl_->reader->GetValue(&val, &length);
-    if (FAILED(hr)) {
-        throw std::runtime_error{"failed to get a value"};
-    }
-    return detail::utf16_to_utf8(val, val + length);
-# else
-    const xmlChar * val = xmlTextReaderConstValue(this->impl_->reader);
-    if (val == nullptr) {
-        throw std::runtime_error{"failed to get a value"};
-    }
-    return std::string{val, val + xmlStrlen(val)};
-# endif
+    return this->span_text(true);
 }
 
 /**
- * @brief Move to the first attribute associated with the current node.
+ * @brief The text of the content of the element ended by the current node.
  *
- * @retval true on success
- * @retval false if the current node has no attributes
+ * This is the part of @c #outer_span between the element's start and end
+ * tags; it is empty for an empty element.
  *
- * @exception xml::parse_error  if there is an error in the input.
+ * @return the text of the element's content.
+ *
+ * @exception std::logic_error  if the spans of the current node are not
+ *                              available.
  */
-bool xml::reader::move_to_first_attribute()
+xml::string_ref xml::reader::inner_span() const
+{
+    return this->span_text(false);
+}
+
+/**
+ * @brief Take a checkpoint after the current node.
+ *
+ * The reader must have been constructed with
+ * @c reader_options::track_offsets set, and be positioned on an element
+ * or an end element.  A reader constructed from the checkpoint continues
+ * with the node following the current one (for an element, its first
+ * child).
+ *
+ * @return a checkpoint.
+ *
+ * @exception std::logic_error      if offsets are not tracked, or the
+ *                                  current node is not an element or end
+ *                                  element.
+ * @exception std::runtime_error    with the XmlLite backend, which does not
+ *                                  support checkpoints.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+const xml::reader_checkpoint xml::reader::checkpoint() const
 {
+    if (this->pipeline_) {
+        throw std::logic_error{"offsets are not tracked by a pipelined "
+                               "reader"};
+    }
+    if (this->replay_) {
+        throw std::logic_error{"offsets are not tracked by this reader"};
+    }
+    if (!this->impl_->scanner) {
+        throw std::logic_error{"offsets are not tracked by this reader"};
+    }
+    if (!this->impl_->located) {
+        throw std::logic_error{
+            "a checkpoint can only be taken at an element or end element"};
+    }
 # ifdef HAVE_XMLLITE
-    HRESULT hr = this->impl_->reader->MoveToFirstAttribute();
-    if (FAILED(hr)) {
-        if (detail::is_xmllite_reader_error(hr)) {
-            detail::throw_parse_error(*this->impl_->reader, hr);
+    throw std::runtime_error{"checkpoints are not supported with XmlLite"};
+# else
+    reader_checkpoint result;
+    const source_location & location = this->impl_->location;
+    result.offset = location.end;
+    result.line = this->impl_->location_end_line;
+    result.column = this->impl_->location_end_column;
+
+    //
+    // libxml2's reader keeps the ancestors of the current node; so the open
+    // elements and in-scope declarations can be found without tracking
+    // them as the document is read.
+    //
+    xmlNodePtr node = xmlTextReaderCurrentNode(this->impl_->reader);
+    if (node && node->type == XML_ATTRIBUTE_NODE) { node = node->parent; }
+    const bool open = this->node_type() == element_id
+                   && !this->empty_element();
+    std::vector<xmlNodePtr> elements;
+    for (xmlNodePtr n = open ? node : (node ? node->parent : nullptr);
+         n && n->type == XML_ELEMENT_NODE;
+         n = n->parent) {
+        elements.push_back(n);
+    }
+    std::reverse(elements.begin(), elements.end());
+
+    for (const xmlNodePtr n : elements) {
+        for (xmlNsPtr ns = n->nsDef; ns; ns = ns->next) {
+            const std::string prefix =
+                ns->prefix ? reinterpret_cast<const char *>(ns->prefix) : "";
+            const std::string uri =
+                ns->href ? reinterpret_cast<const char *>(ns->href) : "";
+            const auto pos =
+                std::find_if(result.namespaces.begin(),
+                             result.namespaces.end(),
+                             [&prefix](const namespace_binding & b) {
+                                 return b.prefix == prefix;
+                             });
+            if (pos != result.namespaces.end()) {
+                pos->uri = uri;
+            } else {
+                result.namespaces.push_back(namespace_binding{prefix, uri});
+            }
         }
     }
-    return hr == S_OK;
-# else
-    const int result = xmlTextReaderMoveToFirstAttribute(this->impl_->reader);
-    if (result < 0) { throw this->impl_->error; }
+
+    //
+    // The generic wrapper is not part of the document.
+    //
+    const std::size_t first = this->impl_->wrapped ? 1 : 0;
+    for (std::size_t i = first; i < elements.size(); ++i) {
+        const xmlNodePtr n = elements[i];
+        std::string name;
+        if (n->ns && n->ns->prefix) {
+            name = reinterpret_cast<const char *>(n->ns->prefix);
+            name += ':';
+        }
+        name += reinterpret_cast<const char *>(n->name);
+        result.open_elements.push_back(std::move(name));
+    }
     return result;
 # endif
 }
 
 /**
- * @brief Move to the next attribute associated with the current node.
+ * @brief Performance counters for this reader.
  *
- * @retval true on success
- * @retval false if the current node has no more attributes
+ * @c reader_stats::bytes_consumed is always available.  The remaining
+ * counters are only maintained if the reader was constructed with
+ * @c reader_options::collect_stats set; otherwise they are zero.  A
+ * pipelined reader reports the counters as of the end of the block of
+ * nodes being read; a reader replaying a recording reports zeros.
  *
- * @exception xml::parse_error  if there is an error in the input.
+ * @return performance counters for this reader.
  */
-bool xml::reader::move_to_next_attribute()
+const xml::reader_stats xml::reader::stats() const
 {
-# ifdef HAVE_XMLLITE
-    HRESULT hr = this->impl_->reader->MoveToNextAttribute();
-    if (FAILED(hr)) {
-        if (detail::is_xmllite_reader_error(hr)) {
-            detail::throw_parse_error(*this->impl_->reader, hr);
-        }
+    if (this->pipeline_) { return this->pipeline_->stats(); }
+    if (this->replay_) { return reader_stats(); }
+    reader_stats result = this->impl_->stats;
+    if (this->impl_->memory) {
+        result.memory_in_use = this->impl_->memory->in_use.load();
+        result.memory_high_water = this->impl_->memory->high_water.load();
     }
-    return hr == S_OK;
-# else
-    const int result = xmlTextReaderMoveToNextAttribute(this->impl_->reader);
-    if (result < 0) { throw this->impl_->error; }
+    result.bytes_consumed = this->impl_->bytes_consumed();
     return result;
-# endif
 }
 
 # ifdef HAVE_XMLLITE
 namespace
 {
     com_istream::com_istream(std::istream & in):
-        in_{in},
+        input_{&in},
+        count_{1}
+    {}
+
+    com_istream::com_istream(stream_input && in):
+        input_{std::move(in)},
         count_{1}
     {}
 
+    stream_input & com_istream::input() throw ()
+    {
+        return this->input_;
+    }
+
     HRESULT com_istream::QueryInterface(const IID & iid,
                                         void ** ppv)
     {
@@ -810,8 +4328,21 @@ namespace
         }
 
         try {
-            this->in_.read(static_cast<char *>(pv), cb);
-            *pcbRead = static_cast<ULONG>(this->in_.gcount());
+            //
+            // stream_input::read may return less than requested short of
+            // the end of the input (e.g., at the end of the synthetic
+            // prefix); so read until the buffer is full or the input ends.
+            //
+            char * const buf = static_cast<char *>(pv);
+            ULONG total = 0;
+            while (total < cb) {
+                const std::streamsize count =
+                    this->input_.read(buf + total, cb - total);
+                if (count < 0) { return E_FAIL; }
+                if (count == 0) { break; }
+                total += static_cast<ULONG>(count);
+            }
+            *pcbRead = total;
         } catch (const std::ios_base::failure &) {
             return STG_E_ACCESSDENIED;
         } catch (const std::bad_alloc &) {
@@ -834,47 +4365,33 @@ namespace
         return E_NOTIMPL;
     }
 
+    //
+    // The input is a sequence of sources (a synthetic prefix, the stream or
+    // buffer, and a suffix), and may be divided into documents; so it
+    // cannot be repositioned.  Only the current position can be queried:
+    // that is, the number of bytes delivered so far.
+    //
     HRESULT com_istream::Seek(const LARGE_INTEGER dlibMove,
                               const DWORD dwOrigin,
                               ULARGE_INTEGER * const plibNewPosition)
     {
-        try {
-            using std::istream;
-
-            switch (dwOrigin) {
-            case STREAM_SEEK_SET:
-                this->in_.seekg(static_cast<istream::pos_type>(dlibMove.QuadPart));
-                break;
-            case STREAM_SEEK_CUR:
-                this->in_.seekg(static_cast<istream::off_type>(dlibMove.QuadPart),
-                                std::ios_base::cur);
-                break;
-            case STREAM_SEEK_END:
-                this->in_.seekg(static_cast<istream::off_type>(dlibMove.QuadPart),
-                                std::ios_base::end);
-                break;
-            default:
-                return STG_E_INVALIDFUNCTION;
-            }
-
-            if (!this->in_) {
-                return STG_E_INVALIDFUNCTION;
-            }
-
-            if (!plibNewPosition) {
-                return STG_E_INVALIDPOINTER;
+        const std::uint64_t position = this->input_.delivered;
+        switch (dwOrigin) {
+        case STREAM_SEEK_SET:
+            if (dlibMove.QuadPart < 0
+                || std::uint64_t(dlibMove.QuadPart) != position) {
+                return E_NOTIMPL;
             }
-            plibNewPosition->QuadPart = this->in_.tellg();
-        } catch (const std::ios_base::failure &) {
-            return STG_E_ACCESSDENIED;
-        } catch (const std::bad_alloc &) {
-            return E_OUTOFMEMORY;
-        } catch (const std::exception &) {
-            return E_FAIL;
-        } catch (...) {
-            return E_UNEXPECTED;
+            break;
+        case STREAM_SEEK_CUR:
+            if (dlibMove.QuadPart != 0) { return E_NOTIMPL; }
+            break;
+        case STREAM_SEEK_END:
+            return E_NOTIMPL;
+        default:
+            return STG_E_INVALIDFUNCTION;
         }
-
+        if (plibNewPosition) { plibNewPosition->QuadPart = position; }
         return S_OK;
     }
 
@@ -931,21 +4448,32 @@ void xml_reader_errorFunc(void * arg, const char * msg,
                           xmlParserSeverities severity,
                           xmlTextReaderLocatorPtr locator)
 {
-    xml::parse_error & error =
-        *static_cast<xml::parse_error *>(arg);
-    error =
-        xml::parse_error(xmlTextReaderLocatorLineNumber(locator), msg);
+    reader_error & error = *static_cast<reader_error *>(arg);
+    //
+    // Validity errors are relayed without a locator.
+    //
+    const int line = locator ? xmlTextReaderLocatorLineNumber(locator) : 0;
+    //
+    // libxml2's messages end with a newline.
+    //
+    std::string message = msg ? msg : "";
+    while (!message.empty() && message.back() == '\n') {
+        message.pop_back();
+    }
+    error.last = xml::parse_error(line > 0 ? size_t(line) + error.line_offset
+                                           : 0,
+                                  message);
+    if (severity == XML_PARSER_SEVERITY_VALIDITY_ERROR) {
+        error.invalid = true;
+    }
 }
 
 int xml_reader_inputReadCallback(void * const context,
                                  char * const buffer,
                                  const int len)
 {
-    std::istream & in = *static_cast<std::istream *>(context);
-    in.read(buffer, len);
-    return in
-        ? static_cast<int>(in.gcount())
-        : -1;
+    stream_input & input = *static_cast<stream_input *>(context);
+    return static_cast<int>(input.read(buffer, len));
 }
 
 int xml_reader_inputCloseCallback(void * /* context */)
@@ -953,4 +4481,42 @@ int xml_reader_inputCloseCallback(void * /* context */)
     // Don't need to do anything to a std::istream here.
     return 0;
 }
+
+xmlParserInputPtr xml_reader_entityLoader(const char * const url,
+                                          const char * const id,
+                                          const xmlParserCtxtPtr context)
+{
+    const xml::entity_resolver * const resolver = current_entity_resolver;
+    if (!resolver) { return default_entity_loader(url, id, context); }
+
+    const std::string * content = nullptr;
+    try {
+        content = resolver->resolve(id, url);
+    } catch (const std::exception &) {
+        return nullptr;
+    }
+    if (!content) { return nullptr; }
+
+    //
+    // The resolver's content outlives the reader; so the parser can read
+    // it in place.
+    //
+    const xmlParserInputBufferPtr buffer =
+        xmlParserInputBufferCreateStatic(content->data(),
+                                         static_cast<int>(content->size()),
+                                         XML_CHAR_ENCODING_NONE);
+    if (!buffer) { return nullptr; }
+    const xmlParserInputPtr input =
+        xmlNewIOInputStream(context, buffer, XML_CHAR_ENCODING_NONE);
+    if (!input) {
+        xmlFreeParserInputBuffer(buffer);
+        return nullptr;
+    }
+    if (url) {
+        input->filename =
+            reinterpret_cast<const char *>(
+                xmlStrdup(reinterpret_cast<const xmlChar *>(url)));
+    }
+    return input;
+}
 # endif // HAVE_XMLLITE
@@ -27,13 +27,31 @@
 # ifndef XML_READER_H
 #   define XML_READER_H
 
+#   include <array>
+#   include <atomic>
+#   include <chrono>
+#   include <cstdint>
+#   include "string_ref.h"
+#   include <functional>
 #   include <iosfwd>
 #   include <memory>
 #   include <string>
 #   include <stdexcept>
+#   include <vector>
 
 namespace xml
 {
+    class entity_resolver;
+    class event_recording;
+    class memory_resource;
+    class schema;
+
+    namespace detail {
+        class event_pipeline;
+        class event_replay;
+        struct reader_mark;
+    }
+
     class parse_error : public std::runtime_error {
         size_t line_;
 
@@ -43,10 +61,103 @@ namespace xml
         size_t line() const throw ();
     };
 
+    class validation_error : public parse_error {
+    public:
+        validation_error(size_t line, const std::string & msg);
+    };
+
+    class memory_limit_error : public parse_error {
+    public:
+        memory_limit_error(size_t line, const std::string & msg);
+    };
+
+    enum class resource_limit : std::uint8_t {
+        depth,
+        name_length,
+        attribute_count,
+        text_length,
+        entity_expansions,
+        bytes
+    };
+
+    class resource_limit_error : public parse_error {
+        resource_limit limit_;
+
+    public:
+        resource_limit_error(size_t line, resource_limit limit,
+                             const std::string & msg);
+
+        resource_limit limit() const throw ();
+    };
+
+    class cancelled_error : public std::runtime_error {
+    public:
+        cancelled_error();
+    };
+
+    struct namespace_binding {
+        std::string prefix;
+        std::string uri;
+    };
+
+    struct reader_options {
+        bool collect_stats = false;
+        std::size_t memory_limit = 0;
+        memory_resource * memory = nullptr;
+        std::size_t max_depth = 0;
+        std::size_t max_name_length = 0;
+        std::size_t max_attributes = 0;
+        std::size_t max_text_length = 0;
+        std::size_t max_entity_expansions = 0;
+        std::uint64_t max_bytes = 0;
+        std::shared_ptr<const entity_resolver> entities;
+        std::shared_ptr<const xml::schema> schema;
+        bool track_offsets = false;
+        std::uint64_t input_offset = 0;
+        std::size_t input_line = 1;
+        std::size_t input_column = 1;
+        std::uint64_t input_length = 0;
+        std::vector<namespace_binding> namespaces;
+        std::vector<std::string> open_elements;
+        bool fragment = false;
+        bool multiple_documents = false;
+        std::shared_ptr<const std::atomic<bool>> cancel;
+        bool pipelined = false;
+    };
+
+    struct read_budget {
+        std::size_t nodes = 0;
+        std::chrono::nanoseconds time{0};
+    };
+
+    struct source_location {
+        std::uint64_t offset;
+        std::uint64_t end;
+        std::size_t line;
+    };
+
+    struct reader_checkpoint {
+        std::uint64_t offset = 0;
+        std::size_t line = 1;
+        std::size_t column = 1;
+        std::vector<std::string> open_elements;
+        std::vector<namespace_binding> namespaces;
+
+        const std::string str() const;
+        static reader_checkpoint parse(const std::string & str);
+    };
+
+    struct reader_stats;
 
     class reader {
         struct impl;
         std::unique_ptr<impl> impl_;
+        std::unique_ptr<detail::event_replay> replay_;
+        std::unique_ptr<detail::reader_mark> mark_;
+        std::unique_ptr<detail::event_pipeline> pipeline_;
+
+        void start_pipeline(const reader_options & options);
+        string_ref span_text(bool outer) const;
 
     public:
         //
@@ -63,28 +174,78 @@ namespace xml
             comment_id                = 8,
             document_type_id          = 10,
             whitespace_id             = 13,
+            significant_whitespace_id = 14,
             end_element_id            = 15,
             xml_declaration_id        = 17
         };
 
-        explicit reader(const std::string & filename);
-        explicit reader(std::istream & in);
+        explicit reader(const std::string & filename,
+                        const reader_options & options = reader_options());
+        explicit reader(std::istream & in,
+                        const reader_options & options = reader_options());
+        reader(const char * data, std::size_t size,
+               const reader_options & options = reader_options());
+        reader(std::istream & in,
+               const reader_checkpoint & from,
+               const reader_options & options = reader_options());
+        explicit reader(const event_recording & events);
         reader(const reader &) = delete;
         reader(reader &&) throw ();
+        ~reader() throw ();
 
         reader & operator=(const reader &) = delete;
         reader & operator=(reader &&) throw ();
 
         bool read();
+        bool read_for(const read_budget & budget,
+                      const std::function<void (reader &)> & on_node);
+        void skip();
+        bool next_document();
+        void reset(const std::string & filename);
         size_t line() const throw ();
         size_t col() const throw ();
         node_type_id node_type() const throw ();
+        std::size_t depth() const throw ();
         bool empty_element() const throw ();
         const std::string local_name() const;
         const std::string qualified_name() const;
         const std::string value() const;
+        string_ref local_name_ref() const;
+        string_ref qualified_name_ref() const;
+        string_ref value_ref() const;
+        string_ref namespace_uri() const;
+        std::size_t namespace_id() const;
+        std::size_t namespace_id(const string_ref & uri) const;
+        void move_to_element();
         bool move_to_first_attribute();
         bool move_to_next_attribute();
+        template <typename T>
+        std::size_t read_numbers(std::vector<T> & out);
+        template <typename T>
+        bool attribute_numbers(const string_ref & name, std::vector<T> & out);
+        void mark(std::size_t lookahead = 64 * 1024);
+        void unmark() throw ();
+        void rewind();
+        std::uint64_t byte_offset() const throw ();
+        const source_location tag_location() const;
+        string_ref outer_span() const;
+        string_ref inner_span() const;
+        const reader_checkpoint checkpoint() const;
+        const reader_stats stats() const;
+    };
+
+    struct reader_stats {
+        static const std::size_t node_type_count =
+            reader::xml_declaration_id + 1;
+
+        std::uint64_t bytes_consumed = 0;
+        std::array<std::uint64_t, node_type_count> node_counts = {{}};
+        std::size_t max_depth = 0;
+        std::chrono::nanoseconds read_time{0};
+        std::chrono::nanoseconds input_wait_time{0};
+        std::uint64_t string_allocations = 0;
+        std::size_t memory_in_use = 0;
+        std::size_t memory_high_water = 0;
     };
 }
 
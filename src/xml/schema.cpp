@@ -0,0 +1,280 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# include "schema.h"
+# include <map>
+# include <mutex>
+# include <stdexcept>
+# include <utility>
+# ifndef HAVE_XMLLITE
+#   include <libxml/relaxng.h>
+#   include <libxml/xmlschemas.h>
+# endif
+
+/**
+ * @file xml/schema.h
+ *
+ * @brief Compiled schemas for validating readers.
+ */
+
+/**
+ * @class xml::schema
+ *
+ * @brief A compiled W3C XML Schema or RELAX NG schema.
+ *
+ * Once compiled, a schema is immutable; a single instance may be used by
+ * any number of readers on any number of threads.  @c #load additionally
+ * caches compiled schemas for the lifetime of the process; so each schema
+ * file is compiled only once.
+ *
+ * Schema validation is not supported with the XmlLite backend.
+ *
+ * @sa xml::reader_options::schema
+ */
+
+/**
+ * @enum xml::schema::language
+ *
+ * @brief The schema language.
+ */
+
+/**
+ * @var xml::schema::language xml::schema::language::xsd
+ *
+ * @brief W3C XML Schema.
+ */
+
+/**
+ * @var xml::schema::language xml::schema::language::relax_ng
+ *
+ * @brief RELAX NG (XML syntax).
+ */
+
+/**
+ * @internal
+ *
+ * @brief Using the pimpl idiom here avoids exposing libxml2 types in the
+ *        header.
+ */
+struct xml::schema::impl {
+    const language lang;
+# ifndef HAVE_XMLLITE
+    xmlSchemaPtr xsd;
+    xmlRelaxNGPtr rng;
+# endif
+
+    impl(const std::string & filename, language lang);
+    impl(const impl &) = delete;
+    ~impl() throw ();
+
+    impl & operator=(const impl &) = delete;
+};
+
+# ifndef HAVE_XMLLITE
+extern "C" {
+    void xml_schema_structuredErrorFunc(void * arg, xmlErrorPtr error);
+}
+# endif
+
+/**
+ * @internal
+ *
+ * @brief Compile a schema.
+ *
+ * @param[in] filename  the schema file.
+ * @param[in] lang      the schema language.
+ *
+ * @exception std::runtime_error    if the schema cannot be compiled.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::schema::impl::impl(const std::string & filename, const language lang):
+    lang{lang}
+# ifndef HAVE_XMLLITE
+    , xsd{nullptr}
+    , rng{nullptr}
+# endif
+{
+# ifdef HAVE_XMLLITE
+    throw std::runtime_error{
+        "schema validation is not supported with XmlLite"};
+# else
+    std::string message;
+    if (lang == language::xsd) {
+        const xmlSchemaParserCtxtPtr context =
+            xmlSchemaNewParserCtxt(filename.c_str());
+        if (!context) { throw std::bad_alloc{}; }
+        xmlSchemaSetParserStructuredErrors(context,
+                                           xml_schema_structuredErrorFunc,
+                                           &message);
+        this->xsd = xmlSchemaParse(context);
+        xmlSchemaFreeParserCtxt(context);
+    } else {
+        const xmlRelaxNGParserCtxtPtr context =
+            xmlRelaxNGNewParserCtxt(filename.c_str());
+        if (!context) { throw std::bad_alloc{}; }
+        xmlRelaxNGSetParserStructuredErrors(context,
+                                            xml_schema_structuredErrorFunc,
+                                            &message);
+        this->rng = xmlRelaxNGParse(context);
+        xmlRelaxNGFreeParserCtxt(context);
+    }
+    if (!this->xsd && !this->rng) {
+        throw std::runtime_error{"failed to compile schema \"" + filename
+                                 + "\"" + (message.empty() ? "" : ": ")
+                                 + message};
+    }
+# endif
+}
+
+/**
+ * @internal
+ *
+ * @brief Destroy.
+ */
+xml::schema::impl::~impl() throw ()
+{
+# ifndef HAVE_XMLLITE
+    if (this->xsd) { xmlSchemaFree(this->xsd); }
+    if (this->rng) { xmlRelaxNGFree(this->rng); }
+# endif
+}
+
+/**
+ * @brief Get a compiled schema from the process-wide cache, compiling it
+ *        if necessary.
+ *
+ * Schemas are cached by file name and language, for the lifetime of the
+ * process.
+ *
+ * @param[in] filename  the schema file.
+ * @param[in] lang      the schema language.
+ *
+ * @return the compiled schema.
+ *
+ * @exception std::runtime_error    if the schema cannot be compiled.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+std::shared_ptr<const xml::schema>
+xml::schema::load(const std::string & filename, const language lang)
+{
+    typedef std::pair<language, std::string> key_type;
+    static std::mutex mutex;
+    static std::map<key_type, std::shared_ptr<const schema>> cache;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    std::shared_ptr<const schema> & cached =
+        cache[key_type{lang, filename}];
+    if (!cached) {
+        try {
+            cached = std::make_shared<const schema>(filename, lang);
+        } catch (...) {
+            cache.erase(key_type{lang, filename});
+            throw;
+        }
+    }
+    return cached;
+}
+
+/**
+ * @brief Compile a schema.
+ *
+ * Prefer @c #load, unless the schema should not be cached.
+ *
+ * @param[in] filename  the schema file.
+ * @param[in] lang      the schema language.
+ *
+ * @exception std::runtime_error    if the schema cannot be compiled.
+ * @exception std::bad_alloc        if memory allocation fails.
+ */
+xml::schema::schema(const std::string & filename, const language lang):
+    impl_{new impl{filename, lang}}
+{}
+
+/**
+ * @fn xml::schema::schema(const schema &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief Destroy.
+ */
+xml::schema::~schema() throw ()
+{}
+
+/**
+ * @fn xml::schema & xml::schema::operator=(const schema &)
+ *
+ * @brief Not copyable.
+ */
+
+/**
+ * @brief The schema language.
+ *
+ * @return the schema language.
+ */
+xml::schema::language xml::schema::schema_language() const throw ()
+{
+    return this->impl_->lang;
+}
+
+/**
+ * @internal
+ *
+ * @brief The underlying compiled schema.
+ *
+ * @param[in] s a schema.
+ *
+ * @return the @c xmlSchemaPtr or @c xmlRelaxNGPtr, according to the schema
+ *         language.
+ */
+void * xml::detail::native_schema(const schema & s) throw ()
+{
+# ifdef HAVE_XMLLITE
+    return nullptr;
+# else
+    return (s.impl_->lang == schema::language::xsd)
+        ? static_cast<void *>(s.impl_->xsd)
+        : static_cast<void *>(s.impl_->rng);
+# endif
+}
+
+# ifndef HAVE_XMLLITE
+void xml_schema_structuredErrorFunc(void * const arg,
+                                    const xmlErrorPtr error)
+{
+    std::string & message = *static_cast<std::string *>(arg);
+    if (message.empty() && error && error->message) {
+        message = error->message;
+        //
+        // libxml2's messages end with a newline.
+        //
+        while (!message.empty() && message.back() == '\n') {
+            message.pop_back();
+        }
+    }
+}
+# endif
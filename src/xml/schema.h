@@ -0,0 +1,67 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_SCHEMA_H
+#   define XML_SCHEMA_H
+
+#   include <cstdint>
+#   include <memory>
+#   include <string>
+
+namespace xml
+{
+    class schema;
+
+    namespace detail {
+        void * native_schema(const schema & s) throw ();
+    }
+
+    class schema {
+        struct impl;
+        std::unique_ptr<impl> impl_;
+
+        friend void * detail::native_schema(const schema & s) throw ();
+
+    public:
+        enum class language : std::uint8_t {
+            xsd,
+            relax_ng
+        };
+
+        static std::shared_ptr<const schema> load(const std::string & filename,
+                                                  language lang);
+
+        schema(const std::string & filename, language lang);
+        schema(const schema &) = delete;
+        ~schema() throw ();
+
+        schema & operator=(const schema &) = delete;
+
+        language schema_language() const throw ();
+    };
+}
+
+# endif // XML_SCHEMA_H
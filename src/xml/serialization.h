@@ -0,0 +1,245 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_SERIALIZATION_H
+#   define XML_SERIALIZATION_H
+
+#   include "binding.h"
+#   include "writer.h"
+#   include <vector>
+
+/**
+ * @file xml/serialization.h
+ *
+ * @brief Serialization of bound C++ structures through @c xml::writer.
+ *
+ * This is the reverse of @c xml::bind: a structure declared with
+ * @c XMLRW_BINDING is written as an element whose attributes, child
+ * elements and text are given by its field list.  Attribute fields are
+ * written first, followed by the text and element fields in the order
+ * they are declared.
+ *
+ * The field names of each type are encoded as @c xml::qname objects once,
+ * the first time the type is serialized; so writing a field costs only the
+ * formatting of its value.
+ */
+
+namespace xml
+{
+    template <typename T>
+    void serialize(writer & w, const qname & name, const T & object);
+
+    namespace detail {
+
+        template <typename Fields, std::size_t I, std::size_t N>
+        struct field_names_builder {
+            static void build(const Fields & fields,
+                              std::vector<qname> & names)
+            {
+                names.emplace_back(std::string(std::get<I>(fields).name,
+                                               std::get<I>(fields).name_size));
+                field_names_builder<Fields, I + 1, N>::build(fields, names);
+            }
+        };
+
+        template <typename Fields, std::size_t N>
+        struct field_names_builder<Fields, N, N> {
+            static void build(const Fields &, std::vector<qname> &) {}
+        };
+
+        //
+        // The encoded field names of T, indexed like its field tuple.
+        //
+        template <typename T>
+        const std::vector<qname> & field_names()
+        {
+            typedef decltype(fields_of<T>()) fields_type;
+            static const std::vector<qname> names = [] {
+                std::vector<qname> result;
+                result.reserve(std::tuple_size<fields_type>::value);
+                field_names_builder<
+                    fields_type, 0, std::tuple_size<fields_type>::value>
+                    ::build(fields_of<T>(), result);
+                return result;
+            }();
+            return names;
+        }
+
+        template <typename T>
+        const char * format_value(const T & value, format_buffer & buf)
+        {
+            return value_traits<T>::format(value, buf);
+        }
+
+        template <typename T>
+        void serialize_element_value(writer & w, const qname & name,
+                                     const T & value, std::false_type)
+        {
+            format_buffer buf;
+            w.start_element(name);
+            w.text(format_value(value, buf));
+            w.end_element();
+        }
+
+        template <typename T>
+        void serialize_element_value(writer & w, const qname & name,
+                                     const T & value, std::true_type)
+        {
+            serialize(w, name, value);
+        }
+
+        template <typename T>
+        void serialize_element_member(writer & w, const qname & name,
+                                      const T & member, std::false_type)
+        {
+            serialize_element_value(
+                w, name, member,
+                std::integral_constant<bool, has_binding<T>::value>());
+        }
+
+        template <typename T>
+        void serialize_element_member(writer & w, const qname & name,
+                                      const T & member, std::true_type)
+        {
+            typedef typename T::value_type value_type;
+            for (const auto & value : member) {
+                serialize_element_value(
+                    w, name, value,
+                    std::integral_constant<bool,
+                                           has_binding<value_type>::value>());
+            }
+        }
+
+        template <std::size_t I, std::size_t N>
+        struct field_writer {
+            template <typename Fields, typename Class>
+            static void attributes(writer & w,
+                                   const std::vector<qname> & names,
+                                   const Fields & fields,
+                                   const Class & object)
+            {
+                attribute(w, names[I], std::get<I>(fields), object);
+                field_writer<I + 1, N>::attributes(w, names, fields, object);
+            }
+
+            template <typename Class, typename Member>
+            static void
+            attribute(writer & w, const qname & name,
+                      const field<field_kind::attribute, Class, Member> & f,
+                      const Class & object)
+            {
+                format_buffer buf;
+                w.attribute(name, format_value(object.*f.member, buf));
+            }
+
+            template <typename F, typename Class>
+            static void attribute(writer &, const qname &, const F &,
+                                  const Class &)
+            {}
+
+            template <typename Fields, typename Class>
+            static void content(writer & w,
+                                const std::vector<qname> & names,
+                                const Fields & fields,
+                                const Class & object)
+            {
+                content_field(w, names[I], std::get<I>(fields), object);
+                field_writer<I + 1, N>::content(w, names, fields, object);
+            }
+
+            template <typename Class, typename Member>
+            static void
+            content_field(writer & w, const qname & name,
+                          const field<field_kind::element, Class, Member> & f,
+                          const Class & object)
+            {
+                serialize_element_member(
+                    w, name, object.*f.member,
+                    std::integral_constant<bool, is_vector<Member>::value>());
+            }
+
+            template <typename Class, typename Member>
+            static void
+            content_field(writer & w, const qname &,
+                          const field<field_kind::text, Class, Member> & f,
+                          const Class & object)
+            {
+                format_buffer buf;
+                w.text(format_value(object.*f.member, buf));
+            }
+
+            template <typename F, typename Class>
+            static void content_field(writer &, const qname &, const F &,
+                                      const Class &)
+            {}
+        };
+
+        template <std::size_t N>
+        struct field_writer<N, N> {
+            template <typename Fields, typename Class>
+            static void attributes(writer &, const std::vector<qname> &,
+                                   const Fields &, const Class &)
+            {}
+
+            template <typename Fields, typename Class>
+            static void content(writer &, const std::vector<qname> &,
+                                const Fields &, const Class &)
+            {}
+        };
+    }
+
+    /**
+     * @brief Write a structure as an element.
+     *
+     * @tparam T    a type declared with @c XMLRW_BINDING.
+     *
+     * @param[in,out] w         a writer.
+     * @param[in]     name      the element name.
+     * @param[in]     object    the object to write.
+     *
+     * @exception xml::write_error  if there is an error writing.
+     * @exception std::bad_alloc    if memory allocation fails.
+     */
+    template <typename T>
+    void serialize(writer & w, const qname & name, const T & object)
+    {
+        static_assert(detail::has_binding<T>::value,
+                      "T must be declared with XMLRW_BINDING");
+
+        typedef decltype(detail::fields_of<T>()) fields_type;
+        typedef detail::field_writer<0, std::tuple_size<fields_type>::value>
+            field_writer;
+        const fields_type fields = detail::fields_of<T>();
+        const std::vector<qname> & names = detail::field_names<T>();
+
+        w.start_element(name);
+        field_writer::attributes(w, names, fields, object);
+        field_writer::content(w, names, fields, object);
+        w.end_element();
+    }
+}
+
+# endif // XML_SERIALIZATION_H
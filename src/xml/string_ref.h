@@ -0,0 +1,102 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+# ifndef XML_STRING_REF_H
+#   define XML_STRING_REF_H
+
+#   include <cstddef>
+#   include <cstring>
+#   include <string>
+
+namespace xml
+{
+    //
+    // A non-owning reference to a UTF-8 string.  Strings referenced by
+    // xml::reader accessors remain valid until the reader moves to another
+    // node.
+    //
+    class string_ref {
+        const char * data_;
+        std::size_t size_;
+
+    public:
+        typedef const char * const_iterator;
+
+        string_ref() throw ():
+            data_{""},
+            size_{0}
+        {}
+
+        string_ref(const char * data, std::size_t size) throw ():
+            data_{data},
+            size_{size}
+        {}
+
+        string_ref(const char * str) throw ():
+            data_{str},
+            size_{std::strlen(str)}
+        {}
+
+        string_ref(const std::string & str) throw ():
+            data_{str.data()},
+            size_{str.size()}
+        {}
+
+        const char * data() const throw () { return this->data_; }
+        std::size_t size() const throw () { return this->size_; }
+        bool empty() const throw () { return this->size_ == 0; }
+        const_iterator begin() const throw () { return this->data_; }
+        const_iterator end() const throw ()
+        {
+            return this->data_ + this->size_;
+        }
+
+        char operator[](std::size_t pos) const throw ()
+        {
+            return this->data_[pos];
+        }
+
+        const std::string str() const
+        {
+            return std::string{this->data_, this->size_};
+        }
+    };
+
+    inline bool operator==(const string_ref & lhs, const string_ref & rhs)
+        throw ()
+    {
+        return lhs.size() == rhs.size()
+            && std::memcmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+    }
+
+    inline bool operator!=(const string_ref & lhs, const string_ref & rhs)
+        throw ()
+    {
+        return !(lhs == rhs);
+    }
+}
+
+# endif // XML_STRING_REF_H
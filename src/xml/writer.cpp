@@ -26,6 +26,8 @@
 
 # include "writer.h"
 # include "finally.h"
+# include "metrics_recorder.h"
+# include <chrono>
 # include <ostream>
 # ifdef HAVE_XMLLITE
 #   include "stringconvert.h"
@@ -57,6 +59,144 @@ xml::write_error::write_error(const std::string & msg):
     std::runtime_error{msg}
 {}
 
+/**
+ * @class xml::qname
+ *
+ * @brief A qualified name, encoded once for repeated use with
+ *        @c xml::writer.
+ *
+ * Writing with a @c qname avoids converting and joining the name parts on
+ * every call.  Copies share the encoded name.
+ */
+
+/**
+ * @internal
+ *
+ * @brief The name in the form the underlying writer consumes.
+ */
+struct xml::qname::encoded {
+    std::string prefix;
+    std::string local_name;
+    std::string namespace_uri;
+# ifdef HAVE_XMLLITE
+    std::wstring prefix_utf16;
+    std::wstring local_name_utf16;
+    std::wstring namespace_uri_utf16;
+# else
+    std::string qualified_name;
+# endif
+
+    encoded(const std::string & prefix,
+            const std::string & local_name,
+            const std::string & namespace_uri);
+};
+
+/**
+ * @var std::string xml::qname::encoded::qualified_name
+ *
+ * @brief `prefix:local_name`, or just the local name if there is no prefix.
+ *
+ * When no namespace is declared with the name, this is written directly;
+ * libxml would otherwise join the prefix and local name on every call.
+ */
+
+/**
+ * @internal
+ *
+ * @brief Construct.
+ *
+ * @param[in] prefix        namespace prefix.
+ * @param[in] local_name    local name.
+ * @param[in] namespace_uri namespace URI.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+xml::qname::encoded::encoded(const std::string & prefix,
+                             const std::string & local_name,
+                             const std::string & namespace_uri):
+    prefix{prefix},
+    local_name{local_name},
+    namespace_uri{namespace_uri},
+# ifdef HAVE_XMLLITE
+    prefix_utf16{detail::utf8_to_utf16(prefix)},
+    local_name_utf16{detail::utf8_to_utf16(local_name)},
+    namespace_uri_utf16{detail::utf8_to_utf16(namespace_uri)}
+# else
+    qualified_name{prefix.empty() ? local_name : prefix + ':' + local_name}
+# endif
+{}
+
+/**
+ * @brief Construct an unprefixed name.
+ *
+ * @param[in] local_name    local name.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+xml::qname::qname(const std::string & local_name):
+    encoded_{std::make_shared<encoded>(std::string{}, local_name,
+                                       std::string{})}
+{}
+
+/**
+ * @brief Construct a prefixed name whose namespace is declared elsewhere.
+ *
+ * @param[in] prefix        namespace prefix.
+ * @param[in] local_name    local name.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+xml::qname::qname(const std::string & prefix,
+                  const std::string & local_name):
+    encoded_{std::make_shared<encoded>(prefix, local_name, std::string{})}
+{}
+
+/**
+ * @brief Construct a name that declares its namespace where it is written.
+ *
+ * @param[in] prefix        namespace prefix; may be empty.
+ * @param[in] local_name    local name.
+ * @param[in] namespace_uri namespace URI.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+xml::qname::qname(const std::string & prefix,
+                  const std::string & local_name,
+                  const std::string & namespace_uri):
+    encoded_{std::make_shared<encoded>(prefix, local_name, namespace_uri)}
+{}
+
+/**
+ * @brief The namespace prefix.
+ *
+ * @return the namespace prefix.
+ */
+const std::string & xml::qname::prefix() const throw ()
+{
+    return this->encoded_->prefix;
+}
+
+/**
+ * @brief The local name.
+ *
+ * @return the local name.
+ */
+const std::string & xml::qname::local_name() const throw ()
+{
+    return this->encoded_->local_name;
+}
+
+/**
+ * @brief The namespace URI.
+ *
+ * @return the namespace URI, or an empty string if the name does not
+ *         declare its namespace.
+ */
+const std::string & xml::qname::namespace_uri() const throw ()
+{
+    return this->encoded_->namespace_uri;
+}
+
 /**
  * @class xml::writer
  *
@@ -77,6 +217,9 @@ struct xml::writer::impl {
 # else
     xmlTextWriterPtr writer;
 # endif
+    std::chrono::steady_clock::time_point document_start;
+    std::uint64_t document_bytes;
+    std::uint64_t document_nodes;
 
     explicit impl(const std::string & filename);
     explicit impl(std::ostream & out);
@@ -92,6 +235,27 @@ struct xml::writer::impl {
  * @brief The <a href="http://www.xmlsoft.org/html/libxml-xmlwriter.html#xmlTextWriter">`xmlTextWriter`</a>.
  */
 
+/**
+ * @var std::chrono::steady_clock::time_point xml::writer::impl::document_start
+ *
+ * @brief When @c xml::writer::start_document was called.
+ */
+
+/**
+ * @var std::uint64_t xml::writer::impl::document_bytes
+ *
+ * @brief The number of bytes written for the current document.
+ *
+ * This is the sum of the byte counts reported by xmlTextWriter; with
+ * XmlLite, it is only known once the document has been ended.
+ */
+
+/**
+ * @var std::uint64_t xml::writer::impl::document_nodes
+ *
+ * @brief The number of nodes written for the current document.
+ */
+
 namespace {
 # ifdef HAVE_XMLLITE
     // From: <http://msdn.microsoft.com/en-us/library/windows/desktop/dd317756.aspx>
@@ -115,7 +279,9 @@ xml::writer::impl::impl(const std::string & filename):
 # ifdef HAVE_XMLLITE
     output{0},
 # endif
-    writer{0}
+    writer{0},
+    document_bytes{0},
+    document_nodes{0}
 {
 # ifdef HAVE_XMLLITE
     HRESULT hr;
@@ -241,7 +407,9 @@ xml::writer::impl::impl(std::ostream & out):
 # ifdef HAVE_XMLLITE
     output{new com_ostream{out}},
 # endif
-    writer{0}
+    writer{0},
+    document_bytes{0},
+    document_nodes{0}
 {
     bool succeeded = false;
 
@@ -397,6 +565,12 @@ xml::writer::writer(writer && w) throw ():
     impl_{std::move(w.impl_)}
 {}
 
+/**
+ * @brief Destroy.
+ */
+xml::writer::~writer() throw ()
+{}
+
 /**
  * @fn xml::writer & xml::writer::operator=(const writer &)
  *
@@ -422,12 +596,16 @@ xml::writer & xml::writer::operator=(writer && w) throw ()
  */
 void xml::writer::start_document(standalone sa)
 {
+    this->impl_->document_start = std::chrono::steady_clock::now();
+    this->impl_->document_bytes = 0;
+    this->impl_->document_nodes = 0;
 # ifdef HAVE_XMLLITE
     const HRESULT hr =
         this->impl_->writer->WriteStartDocument(
             static_cast<XmlStandalone>(sa));
     if (FAILED(hr)) {
         if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
             detail::throw_write_error(hr);
         }
     }
@@ -444,8 +622,10 @@ void xml::writer::start_document(standalone sa)
                                                          encoding,
                                                          sa_str);
     if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
         throw write_error{"error starting document"};
     }
+    this->impl_->document_bytes += bytes_written;
 # endif
 }
 
@@ -459,12 +639,32 @@ void xml::writer::start_document(standalone sa)
 void xml::writer::end_document()
 {
 # ifdef HAVE_XMLLITE
+    HRESULT hr = this->impl_->writer->WriteEndDocument();
+    if (SUCCEEDED(hr)) { hr = this->impl_->writer->Flush(); }
+    if (FAILED(hr)) {
+        if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
+            detail::throw_write_error(hr);
+        }
+    }
+    LARGE_INTEGER move = {};
+    ULARGE_INTEGER pos = {};
+    if (SUCCEEDED(this->impl_->output->Seek(move, STREAM_SEEK_CUR, &pos))) {
+        this->impl_->document_bytes = pos.QuadPart;
+    }
 # else
     const int bytes_written = xmlTextWriterEndDocument(this->impl_->writer);
     if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
         throw write_error{"error ending document"};
     }
+    this->impl_->document_bytes += bytes_written;
 # endif
+    detail::record_document(
+        detail::metrics_source::writer,
+        this->impl_->document_bytes,
+        this->impl_->document_nodes,
+        std::chrono::steady_clock::now() - this->impl_->document_start);
 }
 
 /**
@@ -488,6 +688,7 @@ void xml::writer::start_element(const std::string & prefix,
             detail::utf8_to_utf16(namespace_uri).c_str());
     if (FAILED(hr)) {
         if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
             detail::throw_write_error(hr);
         }
     }
@@ -499,9 +700,56 @@ void xml::writer::start_element(const std::string & prefix,
             reinterpret_cast<const xmlChar *>(local_name.c_str()),
             reinterpret_cast<const xmlChar *>(namespace_uri.c_str()));
     if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
+        throw write_error{"error starting element"};
+    }
+    this->impl_->document_bytes += bytes_written;
+# endif
+    ++this->impl_->document_nodes;
+}
+
+/**
+ * @brief Start an element with a pre-encoded name.
+ *
+ * @param[in] name  the element name.
+ *
+ * @exception xml::write_error  if there is an error starting the element.
+ */
+void xml::writer::start_element(const qname & name)
+{
+    const qname::encoded & n = *name.encoded_;
+# ifdef HAVE_XMLLITE
+    const HRESULT hr =
+        this->impl_->writer->WriteStartElement(
+            n.prefix.empty() ? nullptr : n.prefix_utf16.c_str(),
+            n.local_name_utf16.c_str(),
+            n.namespace_uri.empty() ? nullptr : n.namespace_uri_utf16.c_str());
+    if (FAILED(hr)) {
+        if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
+            detail::throw_write_error(hr);
+        }
+    }
+# else
+    const int bytes_written =
+        n.namespace_uri.empty()
+        ? xmlTextWriterStartElement(
+            this->impl_->writer,
+            reinterpret_cast<const xmlChar *>(n.qualified_name.c_str()))
+        : xmlTextWriterStartElementNS(
+            this->impl_->writer,
+            n.prefix.empty()
+                ? nullptr
+                : reinterpret_cast<const xmlChar *>(n.prefix.c_str()),
+            reinterpret_cast<const xmlChar *>(n.local_name.c_str()),
+            reinterpret_cast<const xmlChar *>(n.namespace_uri.c_str()));
+    if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
         throw write_error{"error starting element"};
     }
+    this->impl_->document_bytes += bytes_written;
 # endif
+    ++this->impl_->document_nodes;
 }
 
 /**
@@ -515,14 +763,17 @@ void xml::writer::end_element()
     const HRESULT hr = this->impl_->writer->WriteEndElement();
     if (FAILED(hr)) {
         if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
             detail::throw_write_error(hr);
         }
     }
 # else
     const int bytes_written = xmlTextWriterEndElement(this->impl_->writer);
     if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
         throw write_error{"error ending element"};
     }
+    this->impl_->document_bytes += bytes_written;
 # endif
 }
 
@@ -550,6 +801,7 @@ void xml::writer::attribute(const std::string & prefix,
             detail::utf8_to_utf16(value).c_str());
     if (FAILED(hr)) {
         if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
             detail::throw_write_error(hr);
         }
     }
@@ -562,9 +814,120 @@ void xml::writer::attribute(const std::string & prefix,
             reinterpret_cast<const xmlChar *>(namespace_uri.c_str()),
             reinterpret_cast<const xmlChar *>(value.c_str()));
     if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
+        throw write_error{"error writing attribute"};
+    }
+    this->impl_->document_bytes += bytes_written;
+# endif
+    ++this->impl_->document_nodes;
+}
+
+/**
+ * @brief Write an attribute with a pre-encoded name.
+ *
+ * @param[in] name  the attribute name.
+ * @param[in] value attribute value.
+ *
+ * @exception xml::write_error  if there is an error writing the attribute.
+ */
+void xml::writer::attribute(const qname & name, const char * const value)
+{
+    const qname::encoded & n = *name.encoded_;
+# ifdef HAVE_XMLLITE
+    const HRESULT hr =
+        this->impl_->writer->WriteAttributeString(
+            n.prefix.empty() ? nullptr : n.prefix_utf16.c_str(),
+            n.local_name_utf16.c_str(),
+            n.namespace_uri.empty() ? nullptr : n.namespace_uri_utf16.c_str(),
+            detail::utf8_to_utf16(value).c_str());
+    if (FAILED(hr)) {
+        if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
+            detail::throw_write_error(hr);
+        }
+    }
+# else
+    const int bytes_written =
+        n.namespace_uri.empty()
+        ? xmlTextWriterWriteAttribute(
+            this->impl_->writer,
+            reinterpret_cast<const xmlChar *>(n.qualified_name.c_str()),
+            reinterpret_cast<const xmlChar *>(value))
+        : xmlTextWriterWriteAttributeNS(
+            this->impl_->writer,
+            n.prefix.empty()
+                ? nullptr
+                : reinterpret_cast<const xmlChar *>(n.prefix.c_str()),
+            reinterpret_cast<const xmlChar *>(n.local_name.c_str()),
+            reinterpret_cast<const xmlChar *>(n.namespace_uri.c_str()),
+            reinterpret_cast<const xmlChar *>(value));
+    if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
         throw write_error{"error writing attribute"};
     }
+    this->impl_->document_bytes += bytes_written;
+# endif
+    ++this->impl_->document_nodes;
+}
+
+/**
+ * @brief Write an attribute with a pre-encoded name.
+ *
+ * @param[in] name  the attribute name.
+ * @param[in] value attribute value.
+ *
+ * @exception xml::write_error  if there is an error writing the attribute.
+ */
+void xml::writer::attribute(const qname & name, const std::string & value)
+{
+    this->attribute(name, value.c_str());
+}
+
+/**
+ * @brief Write text content.
+ *
+ * Markup characters in @p text are escaped.
+ *
+ * @param[in] text  text content.
+ *
+ * @exception xml::write_error  if there is an error writing the text.
+ */
+void xml::writer::text(const char * const text)
+{
+# ifdef HAVE_XMLLITE
+    const HRESULT hr =
+        this->impl_->writer->WriteString(detail::utf8_to_utf16(text).c_str());
+    if (FAILED(hr)) {
+        if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
+            detail::throw_write_error(hr);
+        }
+    }
+# else
+    const int bytes_written =
+        xmlTextWriterWriteString(this->impl_->writer,
+                                 reinterpret_cast<const xmlChar *>(text));
+    if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
+        throw write_error{"error writing text"};
+    }
+    this->impl_->document_bytes += bytes_written;
 # endif
+    ++this->impl_->document_nodes;
+}
+
+/**
+ * @brief Write text content.
+ *
+ * Markup characters in @p text are escaped.
+ *
+ * @param[in] text  text content.
+ *
+ * @exception xml::write_error  if there is an error writing the text.
+ */
+void xml::writer::text(const std::string & text)
+{
+    this->text(text.c_str());
 }
 
 /**
@@ -581,6 +944,7 @@ void xml::writer::comment(const std::string & text)
         this->impl_->writer->WriteComment(detail::utf8_to_utf16(text).c_str());
     if (FAILED(hr)) {
         if (detail::is_xmllite_writer_error(hr)) {
+            detail::record_error(detail::metrics_source::writer);
             detail::throw_write_error(hr);
         }
     }
@@ -590,9 +954,12 @@ void xml::writer::comment(const std::string & text)
             this->impl_->writer,
             reinterpret_cast<const xmlChar *>(text.c_str()));
     if (bytes_written == -1) {
+        detail::record_error(detail::metrics_source::writer);
         throw write_error{"error writing comment"};
     }
+    this->impl_->document_bytes += bytes_written;
 # endif
+    ++this->impl_->document_nodes;
 }
 
 # ifdef HAVE_XMLLITE
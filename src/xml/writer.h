@@ -39,6 +39,24 @@ namespace xml
         explicit write_error(const std::string & msg);
     };
 
+    class qname {
+        friend class writer;
+
+        struct encoded;
+        std::shared_ptr<const encoded> encoded_;
+
+    public:
+        explicit qname(const std::string & local_name);
+        qname(const std::string & prefix, const std::string & local_name);
+        qname(const std::string & prefix,
+              const std::string & local_name,
+              const std::string & namespace_uri);
+
+        const std::string & prefix() const throw ();
+        const std::string & local_name() const throw ();
+        const std::string & namespace_uri() const throw ();
+    };
+
     class writer {
         struct impl;
         std::unique_ptr<impl> impl_;
@@ -54,6 +72,7 @@ namespace xml
         explicit writer(std::ostream & out);
         writer(const writer &) = delete;
         writer(writer &&) throw ();
+        ~writer() throw ();
 
         writer & operator=(const writer &) = delete;
         writer & operator=(writer &&) throw ();
@@ -63,11 +82,16 @@ namespace xml
         void start_element(const std::string & prefix,
                            const std::string & local_name,
                            const std::string & namespace_uri);
+        void start_element(const qname & name);
         void end_element();
         void attribute(const std::string & prefix,
                        const std::string & local_name,
                        const std::string & namespace_uri,
                        const std::string & value);
+        void attribute(const qname & name, const char * value);
+        void attribute(const qname & name, const std::string & value);
+        void text(const char * text);
+        void text(const std::string & text);
         void comment(const std::string & text);
     };
 }
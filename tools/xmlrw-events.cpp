@@ -0,0 +1,151 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+//
+// xmlrw-events: record a document's events for fast replay, or print a
+// recording.
+//
+//   xmlrw-events [-o recording] document
+//   xmlrw-events -p recording
+//
+// The recording defaults to the document's name with ".xev" appended.
+// Printing writes one line per node: its depth, type, name, and value,
+// with its attributes on the lines following an element.
+//
+
+# include <xml/event_recording.h>
+# include <xml/reader.h>
+# include <cstdlib>
+# include <cstring>
+# include <exception>
+# include <fstream>
+# include <iostream>
+
+namespace {
+
+    void usage(const char * const program)
+    {
+        std::cerr << "usage: " << program
+                  << " [-o recording] document\n"
+                  << "       " << program << " -p recording\n";
+    }
+
+    int record(const std::string & document, const std::string & recording)
+    {
+        xml::reader in{document};
+        std::ofstream out{recording.c_str(),
+                          std::ios_base::out | std::ios_base::binary};
+        if (!out) {
+            std::cerr << "failed to open \"" << recording << "\"\n";
+            return EXIT_FAILURE;
+        }
+        xml::record_events(in, out);
+        return EXIT_SUCCESS;
+    }
+
+    const char * type_name(const xml::reader::node_type_id type)
+    {
+        switch (type) {
+        case xml::reader::element_id:                return "element";
+        case xml::reader::attribute_id:              return "attribute";
+        case xml::reader::text_id:                   return "text";
+        case xml::reader::cdata_id:                  return "cdata";
+        case xml::reader::processing_instruction_id: return "pi";
+        case xml::reader::comment_id:                return "comment";
+        case xml::reader::document_type_id:          return "doctype";
+        case xml::reader::whitespace_id:             return "whitespace";
+        case xml::reader::significant_whitespace_id: return "whitespace";
+        case xml::reader::end_element_id:            return "end";
+        default:                                     break;
+        }
+        return "other";
+    }
+
+    void print_node(const xml::reader & in)
+    {
+        std::cout << in.depth() << ' ' << type_name(in.node_type()) << ' '
+                  << in.qualified_name_ref().str();
+        const xml::string_ref uri = in.namespace_uri();
+        if (!uri.empty()) { std::cout << " {" << uri.str() << '}'; }
+        const xml::string_ref value = in.value_ref();
+        if (!value.empty()) { std::cout << " \"" << value.str() << '"'; }
+        std::cout << '\n';
+    }
+
+    int print(const std::string & recording)
+    {
+        std::ifstream recording_in{recording.c_str(),
+                                   std::ios_base::in
+                                   | std::ios_base::binary};
+        if (!recording_in) {
+            std::cerr << "failed to open \"" << recording << "\"\n";
+            return EXIT_FAILURE;
+        }
+        xml::reader in{xml::event_recording::load(recording_in)};
+        while (in.read()) {
+            print_node(in);
+            for (bool more = in.move_to_first_attribute();
+                 more;
+                 more = in.move_to_next_attribute()) {
+                print_node(in);
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    std::string recording;
+    bool do_print = false;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        const char * const opt = argv[i];
+        if (std::strcmp(opt, "-p") == 0) {
+            do_print = true;
+            continue;
+        }
+        if (std::strcmp(opt, "-o") != 0 || i + 1 == argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        recording = argv[++i];
+    }
+    if (i + 1 != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (do_print) { return print(argv[i]); }
+        const std::string document = argv[i];
+        if (recording.empty()) { recording = document + ".xev"; }
+        return record(document, recording);
+    } catch (const std::exception & ex) {
+        std::cerr << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
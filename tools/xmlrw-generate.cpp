@@ -0,0 +1,1128 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+//
+// xmlrw-generate: generate a reader for the documents described by an XML
+// Schema.
+//
+//   xmlrw-generate [-n namespace] [-o output] schema
+//
+// Writes output.h, declaring a structure for each complex type and
+// functions to read them, and output.cpp, defining those functions.
+// The output defaults to the schema's name without its extension, in the
+// current directory; the namespace, to the output's name.
+//
+// The generated code reads with an xml::reader.  Each type has its own
+// function, which dispatches on the length of a child's local name and
+// then compares the name's bytes with those of each candidate; values are
+// converted in place with xml::value_traits.
+//
+// The supported subset of XML Schema is: global and local elements
+// (including ref), named and anonymous complex types, sequence, choice,
+// all, named groups, attributes, simple content, extension of complex
+// types, and simple types (by their base type).  Elements and attributes
+// are matched by local name and namespace.  A global element is in the
+// target namespace, as is a local one declared qualified (by form or
+// elementFormDefault); an attribute is in no namespace unless it is
+// declared qualified (by form or attributeFormDefault); so namespace
+// declarations and attributes such as xsi:type are not mistaken
+// for the type's own.  An element with maxOccurs greater than 1 is read
+// into a std::vector; an optional element (minOccurs="0", or in a choice)
+// whose type may contain the element's own type is held by a
+// std::unique_ptr, which is null if the element is absent.  Unknown
+// children are skipped.  The value of simple content is a member named
+// "value", or "value_2" (and so on) if an attribute already has that name.
+//
+
+# include <xml/reader.h>
+# include <cctype>
+# include <cstdlib>
+# include <cstring>
+# include <exception>
+# include <fstream>
+# include <iostream>
+# include <map>
+# include <set>
+# include <sstream>
+# include <stdexcept>
+# include <string>
+# include <vector>
+
+namespace {
+
+    const char xsd_namespace[] = "http://www.w3.org/2001/XMLSchema";
+
+    void usage(const char * const program)
+    {
+        std::cerr << "usage: " << program
+                  << " [-n namespace] [-o output] schema\n";
+    }
+
+    //
+    // An element of the schema document.
+    //
+    struct schema_node {
+        std::string name;
+        std::map<std::string, std::string> attributes;
+        std::map<std::string, std::string> namespaces;
+        std::vector<schema_node> children;
+
+        const std::string attribute(const std::string & attribute_name) const
+        {
+            const auto a = this->attributes.find(attribute_name);
+            return a == this->attributes.end() ? std::string{} : a->second;
+        }
+
+        bool has(const std::string & attribute_name) const
+        {
+            return this->attributes.count(attribute_name) != 0;
+        }
+    };
+
+    //
+    // Read the XML Schema elements of a schema document, without its
+    // annotations.
+    //
+    schema_node load_schema(const std::string & file)
+    {
+        xml::reader r{file};
+        schema_node root;
+        std::vector<schema_node *> open;
+        while (r.read()) {
+            switch (r.node_type()) {
+            case xml::reader::element_id:
+            {
+                if (r.namespace_uri() != xsd_namespace
+                    || r.local_name_ref() == "annotation") {
+                    r.skip();
+                    break;
+                }
+                schema_node * node = &root;
+                if (!open.empty()) {
+                    open.back()->children.emplace_back();
+                    node = &open.back()->children.back();
+                    node->namespaces = open.back()->namespaces;
+                }
+                node->name = r.local_name();
+                const bool empty = r.empty_element();
+                if (r.move_to_first_attribute()) {
+                    do {
+                        const std::string name = r.qualified_name();
+                        if (name == "xmlns") {
+                            node->namespaces[std::string{}] = r.value();
+                        } else if (name.compare(0, 6, "xmlns:") == 0) {
+                            node->namespaces[name.substr(6)] = r.value();
+                        } else if (r.namespace_uri().empty()) {
+                            node->attributes[name] = r.value();
+                        }
+                    } while (r.move_to_next_attribute());
+                    r.move_to_element();
+                }
+                if (!empty) { open.push_back(node); }
+                break;
+            }
+            case xml::reader::end_element_id:
+                if (!open.empty()) { open.pop_back(); }
+                break;
+            default:
+                break;
+            }
+        }
+        if (root.name != "schema") {
+            throw std::runtime_error{"\"" + file + "\" is not a schema"};
+        }
+        return root;
+    }
+
+    const std::string local_part(const std::string & qname)
+    {
+        const std::string::size_type colon = qname.find(':');
+        return colon == std::string::npos ? qname : qname.substr(colon + 1);
+    }
+
+    bool is_schema_type(const schema_node & context, const std::string & qname)
+    {
+        const std::string::size_type colon = qname.find(':');
+        const std::string prefix =
+            colon == std::string::npos ? std::string{} : qname.substr(0, colon);
+        const auto ns = context.namespaces.find(prefix);
+        return ns != context.namespaces.end() && ns->second == xsd_namespace;
+    }
+
+    //
+    // The C++ type for a built-in simple type; types without a numeric or
+    // boolean value are strings.
+    //
+    const std::string builtin_type(const std::string & name)
+    {
+        static const std::map<std::string, std::string> types = {
+            { "boolean",            "bool" },
+            { "byte",               "std::int8_t" },
+            { "short",              "std::int16_t" },
+            { "int",                "std::int32_t" },
+            { "long",               "std::int64_t" },
+            { "integer",            "std::int64_t" },
+            { "negativeInteger",    "std::int64_t" },
+            { "nonPositiveInteger", "std::int64_t" },
+            { "unsignedByte",       "std::uint8_t" },
+            { "unsignedShort",      "std::uint16_t" },
+            { "unsignedInt",        "std::uint32_t" },
+            { "unsignedLong",       "std::uint64_t" },
+            { "nonNegativeInteger", "std::uint64_t" },
+            { "positiveInteger",    "std::uint64_t" },
+            { "float",              "float" },
+            { "double",             "double" },
+            { "decimal",            "double" }
+        };
+        const auto t = types.find(name);
+        return t == types.end() ? "std::string" : t->second;
+    }
+
+    const std::string identifier(const std::string & name)
+    {
+        static const std::set<std::string> keywords = {
+            "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand",
+            "bitor", "bool", "break", "case", "catch", "char", "char16_t",
+            "char32_t", "class", "compl", "const", "constexpr",
+            "const_cast", "continue", "decltype", "default", "delete", "do",
+            "double", "dynamic_cast", "else", "enum", "explicit", "export",
+            "extern", "false", "float", "for", "friend", "goto", "if",
+            "inline", "int", "long", "mutable", "namespace", "new",
+            "noexcept", "not", "not_eq", "nullptr", "operator", "or",
+            "or_eq", "private", "protected", "public", "register",
+            "reinterpret_cast", "return", "short", "signed", "sizeof",
+            "static", "static_assert", "static_cast", "struct", "switch",
+            "template", "this", "thread_local", "throw", "true", "try",
+            "typedef", "typeid", "typename", "union", "unsigned", "using",
+            "virtual", "void", "volatile", "wchar_t", "while", "xor",
+            "xor_eq"
+        };
+        std::string result;
+        for (const char c : name) {
+            result += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+        }
+        if (result.empty()
+            || std::isdigit(static_cast<unsigned char>(result[0]))) {
+            result.insert(0, "_");
+        }
+        if (keywords.count(result)) { result += '_'; }
+        return result;
+    }
+
+    const std::string unique(const std::string & name,
+                             std::set<std::string> & used)
+    {
+        std::string result = name;
+        for (int n = 2; used.count(result); ++n) {
+            result = name + "_" + std::to_string(n);
+        }
+        used.insert(result);
+        return result;
+    }
+
+    const std::string string_literal(const std::string & str)
+    {
+        std::string result = "\"";
+        for (const char c : str) {
+            if (c == '"' || c == '\\') { result += '\\'; }
+            result += c;
+        }
+        return result + "\"";
+    }
+
+    bool is_repeated(const schema_node & particle)
+    {
+        const std::string max = particle.attribute("maxOccurs");
+        return max == "unbounded" || (!max.empty() && std::stoul(max) > 1);
+    }
+
+    bool is_optional(const schema_node & particle)
+    {
+        return particle.attribute("minOccurs") == "0";
+    }
+
+    struct field {
+        std::string xml_name;
+        std::string member;
+        std::string type;
+        bool complex;
+        bool repeated;
+        bool optional;
+        bool pointer;
+        std::string namespace_uri;
+    };
+
+    struct type_def {
+        std::string name;
+        std::vector<field> attributes;
+        std::vector<field> elements;
+        std::string text_type;
+        std::string text_member;
+        std::set<std::string> members;
+    };
+
+    struct root_element {
+        std::string xml_name;
+        std::string namespace_uri;
+        std::string function;
+        std::string type;
+    };
+
+    class generator {
+        std::map<std::string, const schema_node *> elements_;
+        std::map<std::string, const schema_node *> complex_types_;
+        std::map<std::string, const schema_node *> simple_types_;
+        std::map<std::string, const schema_node *> groups_;
+        std::vector<type_def> types_;
+        std::map<const schema_node *, std::size_t> defined_;
+        std::set<std::string> type_names_;
+        std::vector<root_element> roots_;
+        std::string target_namespace_;
+        bool elements_qualified_;
+        bool attributes_qualified_;
+
+    public:
+        explicit generator(const schema_node & schema);
+
+        void write_header(std::ostream & out, const std::string & ns,
+                          const std::string & guard,
+                          const std::string & schema_file) const;
+        void write_source(std::ostream & out, const std::string & ns,
+                          const std::string & header,
+                          const std::string & schema_file) const;
+
+    private:
+        const std::string simple_type(const schema_node & context,
+                                      const std::string & qname);
+        const std::string simple_type(const schema_node & simple);
+        std::size_t named_complex_type(const std::string & name);
+        std::size_t complex_type(const std::string & name,
+                                 const schema_node & node);
+        void inherit(std::size_t t, const schema_node & context,
+                     const std::string & base);
+        void add_content(std::size_t t, const schema_node & node,
+                         bool repeated, bool optional);
+        void add_attribute(std::size_t t, const schema_node & attribute);
+        void add_element(std::size_t t, const schema_node & element,
+                         bool repeated, bool optional);
+        void element_type(const std::string & owner,
+                          const schema_node & element, field & f);
+        std::size_t type_index(const std::string & name) const;
+        bool contains(std::size_t from, std::size_t to,
+                      std::vector<bool> & visited) const;
+        void hold_recursive();
+        void order(std::size_t t, std::vector<int> & state,
+                   std::vector<std::size_t> & result) const;
+
+        void write_dispatch(std::ostream & out, const std::string & ns,
+                            const type_def & t, bool attributes) const;
+        void write_read(std::ostream & out, const std::string & ns,
+                        const type_def & t) const;
+    };
+
+    generator::generator(const schema_node & schema):
+        target_namespace_{schema.attribute("targetNamespace")},
+        elements_qualified_{
+            schema.attribute("elementFormDefault") == "qualified"},
+        attributes_qualified_{
+            schema.attribute("attributeFormDefault") == "qualified"}
+    {
+        for (const auto & child : schema.children) {
+            const std::string name = child.attribute("name");
+            if (child.name == "element") {
+                this->elements_[name] = &child;
+            } else if (child.name == "complexType") {
+                this->complex_types_[name] = &child;
+            } else if (child.name == "simpleType") {
+                this->simple_types_[name] = &child;
+            } else if (child.name == "group") {
+                this->groups_[name] = &child;
+            }
+        }
+        for (const auto & child : schema.children) {
+            if (child.name != "element") { continue; }
+            field f{};
+            this->element_type(std::string{}, child, f);
+            if (!f.complex) { continue; }
+            this->roots_.push_back(
+                root_element{child.attribute("name"), f.namespace_uri,
+                             "read_" + identifier(child.attribute("name")),
+                             f.type});
+        }
+        if (this->roots_.empty()) {
+            throw std::runtime_error{
+                "the schema has no global element of complex type"};
+        }
+        this->hold_recursive();
+    }
+
+    //
+    // The C++ type of a simple type, by name.
+    //
+    const std::string generator::simple_type(const schema_node & context,
+                                             const std::string & qname)
+    {
+        if (is_schema_type(context, qname)) {
+            return builtin_type(local_part(qname));
+        }
+        const auto s = this->simple_types_.find(local_part(qname));
+        if (s == this->simple_types_.end()) {
+            throw std::runtime_error{"unknown simple type \"" + qname + "\""};
+        }
+        return this->simple_type(*s->second);
+    }
+
+    //
+    // The C++ type of a simple type definition: the type of the base of a
+    // restriction; a list or a union is a string.
+    //
+    const std::string generator::simple_type(const schema_node & simple)
+    {
+        for (const auto & child : simple.children) {
+            if (child.name != "restriction") { continue; }
+            if (child.has("base")) {
+                return this->simple_type(child, child.attribute("base"));
+            }
+            for (const auto & base : child.children) {
+                if (base.name == "simpleType") {
+                    return this->simple_type(base);
+                }
+            }
+        }
+        return "std::string";
+    }
+
+    std::size_t generator::named_complex_type(const std::string & name)
+    {
+        const auto c = this->complex_types_.find(name);
+        if (c == this->complex_types_.end()) {
+            throw std::runtime_error{"unknown complex type \"" + name + "\""};
+        }
+        return this->complex_type(identifier(name), *c->second);
+    }
+
+    //
+    // The structure for a complex type, defined on first use.  It is
+    // registered before its content is added, so that it may contain
+    // itself.
+    //
+    std::size_t generator::complex_type(const std::string & name,
+                                        const schema_node & node)
+    {
+        const auto d = this->defined_.find(&node);
+        if (d != this->defined_.end()) { return d->second; }
+        const std::size_t t = this->types_.size();
+        this->types_.emplace_back();
+        this->types_[t].name = unique(name, this->type_names_);
+        this->defined_[&node] = t;
+        this->add_content(t, node, false, false);
+        //
+        // The value of simple content is named after the attributes, so
+        // that it cannot take the name of one.
+        //
+        type_def & type = this->types_[t];
+        if (!type.text_type.empty() && type.text_member.empty()) {
+            type.text_member = unique("value", type.members);
+        }
+        return t;
+    }
+
+    //
+    // Derivation from a complex type: the base type's fields come first.
+    // Derivation from a simple type gives the type simple content.
+    //
+    void generator::inherit(const std::size_t t,
+                            const schema_node & context,
+                            const std::string & base)
+    {
+        if (is_schema_type(context, base)
+            || !this->complex_types_.count(local_part(base))) {
+            this->types_[t].text_type = this->simple_type(context, base);
+            return;
+        }
+        const type_def base_type =
+            this->types_[this->named_complex_type(local_part(base))];
+        type_def & derived = this->types_[t];
+        for (const auto & f : base_type.attributes) {
+            derived.attributes.push_back(f);
+            derived.members.insert(f.member);
+        }
+        for (const auto & f : base_type.elements) {
+            derived.elements.push_back(f);
+            derived.members.insert(f.member);
+        }
+        derived.text_type = base_type.text_type;
+        derived.text_member = base_type.text_member;
+        if (!derived.text_member.empty()) {
+            derived.members.insert(derived.text_member);
+        }
+    }
+
+    //
+    // The alternatives of a choice are optional, as is everything in an
+    // optional particle.
+    //
+    void generator::add_content(const std::size_t t,
+                                const schema_node & node,
+                                const bool repeated,
+                                const bool optional)
+    {
+        const bool choice = node.name == "choice";
+        for (const auto & child : node.children) {
+            const std::string & kind = child.name;
+            const bool child_optional =
+                optional || choice || is_optional(child);
+            if (kind == "sequence" || kind == "choice" || kind == "all") {
+                this->add_content(t, child,
+                                  repeated || is_repeated(child),
+                                  child_optional);
+            } else if (kind == "group") {
+                const std::string ref = local_part(child.attribute("ref"));
+                const auto g = this->groups_.find(ref);
+                if (g == this->groups_.end()) {
+                    throw std::runtime_error{"unknown group \"" + ref + "\""};
+                }
+                this->add_content(t, *g->second,
+                                  repeated || is_repeated(child),
+                                  child_optional);
+            } else if (kind == "element") {
+                this->add_element(t, child, repeated || is_repeated(child),
+                                  child_optional);
+            } else if (kind == "attribute") {
+                this->add_attribute(t, child);
+            } else if (kind == "complexContent"
+                       || kind == "simpleContent") {
+                this->add_content(t, child, repeated, optional);
+                if (kind == "simpleContent"
+                    && this->types_[t].text_type.empty()) {
+                    this->types_[t].text_type = "std::string";
+                }
+            } else if (kind == "extension") {
+                this->inherit(t, child, child.attribute("base"));
+                this->add_content(t, child, repeated, optional);
+            } else if (kind == "restriction") {
+                //
+                // A restriction of a complex type repeats the fields it
+                // keeps; a restriction of simple content keeps the base's
+                // value type.
+                //
+                const std::string base = child.attribute("base");
+                if (is_schema_type(child, base)
+                    || !this->complex_types_.count(local_part(base))) {
+                    this->types_[t].text_type =
+                        this->simple_type(child, base);
+                }
+                this->add_content(t, child, repeated, optional);
+            } else if (kind == "any") {
+                throw std::runtime_error{"xs:any is not supported"};
+            } else if (kind == "attributeGroup") {
+                throw std::runtime_error{
+                    "xs:attributeGroup is not supported"};
+            }
+        }
+    }
+
+    void generator::add_attribute(const std::size_t t,
+                                  const schema_node & attribute)
+    {
+        if (attribute.has("ref")) {
+            throw std::runtime_error{
+                "attribute references are not supported"};
+        }
+        field f{};
+        f.xml_name = attribute.attribute("name");
+        if (attribute.has("type")) {
+            f.type = this->simple_type(attribute, attribute.attribute("type"));
+        } else if (!attribute.children.empty()) {
+            f.type = this->simple_type(attribute.children.front());
+        } else {
+            f.type = "std::string";
+        }
+        const std::string form = attribute.attribute("form");
+        if (form == "qualified"
+            || (form.empty() && this->attributes_qualified_)) {
+            f.namespace_uri = this->target_namespace_;
+        }
+        type_def & type = this->types_[t];
+        f.member = unique(identifier(f.xml_name), type.members);
+        type.attributes.push_back(f);
+    }
+
+    void generator::add_element(const std::size_t t,
+                                const schema_node & element,
+                                const bool repeated,
+                                const bool optional)
+    {
+        field f{};
+        this->element_type(this->types_[t].name, element, f);
+        f.repeated = repeated;
+        f.optional = optional;
+        type_def & type = this->types_[t];
+        f.member = unique(identifier(f.xml_name), type.members);
+        type.elements.push_back(f);
+    }
+
+    //
+    // The name, namespace, and type of an element; an anonymous complex
+    // type is named after its owner and the element.  A global element is
+    // in the target namespace; a local one, only if it is qualified (by
+    // form or elementFormDefault).
+    //
+    void generator::element_type(const std::string & owner,
+                                 const schema_node & element, field & f)
+    {
+        const schema_node * e = &element;
+        if (element.has("ref")) {
+            const std::string ref = local_part(element.attribute("ref"));
+            const auto global = this->elements_.find(ref);
+            if (global == this->elements_.end()) {
+                throw std::runtime_error{"unknown element \"" + ref + "\""};
+            }
+            e = global->second;
+        }
+        f.xml_name = e->attribute("name");
+        const std::string form = e->attribute("form");
+        if (owner.empty() || e != &element || form == "qualified"
+            || (form.empty() && this->elements_qualified_)) {
+            f.namespace_uri = this->target_namespace_;
+        }
+        f.complex = false;
+        if (e->has("type")) {
+            const std::string type = e->attribute("type");
+            if (!is_schema_type(*e, type)
+                && this->complex_types_.count(local_part(type))) {
+                f.complex = true;
+                f.type =
+                    this->types_[this->named_complex_type(local_part(type))]
+                        .name;
+            } else {
+                f.type = this->simple_type(*e, type);
+            }
+            return;
+        }
+        for (const auto & child : e->children) {
+            if (child.name == "complexType") {
+                f.complex = true;
+                const std::string name =
+                    (owner.empty() || e != &element)
+                    ? identifier(f.xml_name)
+                    : owner + "_" + identifier(f.xml_name);
+                f.type = this->types_[this->complex_type(name, child)].name;
+                return;
+            }
+            if (child.name == "simpleType") {
+                f.type = this->simple_type(child);
+                return;
+            }
+        }
+        f.type = "std::string";
+    }
+
+    std::size_t generator::type_index(const std::string & name) const
+    {
+        std::size_t u = 0;
+        while (this->types_[u].name != name) { ++u; }
+        return u;
+    }
+
+    //
+    // Whether a structure of type from may hold one of type to, other than
+    // in a std::vector.
+    //
+    bool generator::contains(const std::size_t from, const std::size_t to,
+                             std::vector<bool> & visited) const
+    {
+        if (from == to) { return true; }
+        if (visited[from]) { return false; }
+        visited[from] = true;
+        for (const auto & f : this->types_[from].elements) {
+            if (f.complex && !f.repeated
+                && this->contains(this->type_index(f.type), to, visited)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //
+    // An optional member that may hold a structure of its own type is held
+    // by a pointer.
+    //
+    void generator::hold_recursive()
+    {
+        for (std::size_t t = 0; t < this->types_.size(); ++t) {
+            for (auto & f : this->types_[t].elements) {
+                if (!f.complex || f.repeated || !f.optional) { continue; }
+                std::vector<bool> visited(this->types_.size());
+                f.pointer =
+                    this->contains(this->type_index(f.type), t, visited);
+            }
+        }
+    }
+
+    //
+    // Structures are defined after the types of their members; a member
+    // that is a std::vector or a std::unique_ptr may refer to a structure
+    // defined later.
+    //
+    void generator::order(const std::size_t t, std::vector<int> & state,
+                          std::vector<std::size_t> & result) const
+    {
+        if (state[t] == 2) { return; }
+        if (state[t] == 1) {
+            throw std::runtime_error{
+                "type \"" + this->types_[t].name
+                + "\" contains itself; the element must be optional or "
+                  "repeated"};
+        }
+        state[t] = 1;
+        for (const auto & f : this->types_[t].elements) {
+            if (!f.complex || f.repeated || f.pointer) { continue; }
+            this->order(this->type_index(f.type), state, result);
+        }
+        state[t] = 2;
+        result.push_back(t);
+    }
+
+    void generator::write_header(std::ostream & out,
+                                 const std::string & ns,
+                                 const std::string & guard,
+                                 const std::string & schema_file) const
+    {
+        std::vector<int> state(this->types_.size());
+        std::vector<std::size_t> types;
+        for (std::size_t t = 0; t < this->types_.size(); ++t) {
+            this->order(t, state, types);
+        }
+
+        out << "// Generated by xmlrw-generate from " << schema_file
+            << ".  Do not edit.\n\n"
+            << "# ifndef " << guard << "\n"
+            << "#   define " << guard << "\n\n"
+            << "#   include <xml/reader.h>\n"
+            << "#   include <cstdint>\n"
+            << "#   include <memory>\n"
+            << "#   include <string>\n"
+            << "#   include <vector>\n\n"
+            << "namespace " << ns << " {\n\n";
+        for (const auto & t : this->types_) {
+            out << "    struct " << t.name << ";\n";
+        }
+        for (const std::size_t i : types) {
+            const type_def & t = this->types_[i];
+            out << "\n    struct " << t.name << " {\n";
+            //
+            // Structure types are qualified: a member often has the name
+            // of its type.
+            //
+            auto member = [&out, &ns](const field & f) {
+                const std::string type =
+                    f.complex ? "::" + ns + "::" + f.type : f.type;
+                out << "        ";
+                if (f.repeated) {
+                    out << "std::vector<" << type << "> " << f.member;
+                } else if (f.pointer) {
+                    out << "std::unique_ptr<" << type << "> " << f.member;
+                } else {
+                    out << type << ' ' << f.member;
+                    if (!f.complex && f.type != "std::string") {
+                        out << "{}";
+                    }
+                }
+                out << ";\n";
+            };
+            for (const auto & f : t.attributes) { member(f); }
+            for (const auto & f : t.elements) { member(f); }
+            if (!t.text_type.empty()) {
+                member(field{std::string{}, t.text_member, t.text_type,
+                             false, false, false, false, std::string{}});
+            }
+            out << "    };\n";
+        }
+        out << '\n';
+        for (const auto & t : this->types_) {
+            out << "    void read(xml::reader & r, " << t.name
+                << " & out);\n";
+        }
+        for (const auto & root : this->roots_) {
+            out << "    void " << root.function << "(xml::reader & r, "
+                << root.type << " & out);\n";
+        }
+        out << "}\n\n"
+            << "# endif // " << guard << "\n";
+    }
+
+    //
+    // A function that reads the current attribute or child element into
+    // its field, returning false if it is not one of the type's.  Names
+    // are told apart by their length first; the namespace is checked
+    // last.
+    //
+    void generator::write_dispatch(std::ostream & out,
+                                   const std::string & ns,
+                                   const type_def & t,
+                                   const bool attributes) const
+    {
+        const std::vector<field> & fields =
+            attributes ? t.attributes : t.elements;
+        std::map<std::size_t, std::vector<const field *>> by_length;
+        for (const auto & f : fields) {
+            by_length[f.xml_name.size()].push_back(&f);
+        }
+
+        out << "\n    bool read_" << (attributes ? "attribute" : "element")
+            << "(xml::reader & r, " << ns << "::" << t.name << " & out)\n"
+            << "    {\n"
+            << "        const xml::string_ref name = r.local_name_ref();\n"
+            << "        switch (name.size()) {\n";
+        for (const auto & group : by_length) {
+            out << "        case " << group.first << ":\n";
+            for (const field * const f : group.second) {
+                out << "            if (std::memcmp(name.data(), "
+                    << string_literal(f->xml_name) << ", "
+                    << group.first << ") == 0\n"
+                    << "                && ";
+                if (f->namespace_uri.empty()) {
+                    out << "r.namespace_uri().empty()";
+                } else {
+                    out << "r.namespace_uri() == "
+                        << string_literal(f->namespace_uri);
+                }
+                out << ") {\n";
+                std::string target = "out." + f->member;
+                if (f->repeated) {
+                    out << "                " << target
+                        << ".emplace_back();\n";
+                    target += ".back()";
+                } else if (f->pointer) {
+                    out << "                " << target << ".reset(new ::"
+                        << ns << "::" << f->type << ");\n";
+                    target = "*" + target;
+                }
+                out << "                ";
+                if (attributes) {
+                    out << "parse_value(r, r.value_ref(), " << target
+                        << ");\n";
+                } else if (f->complex) {
+                    out << ns << "::read(r, " << target << ");\n";
+                } else {
+                    out << "read_text(r, " << target << ");\n";
+                }
+                out << "                return true;\n"
+                    << "            }\n";
+            }
+            out << "            return false;\n";
+        }
+        out << "        default:\n"
+            << "            return false;\n"
+            << "        }\n"
+            << "    }\n";
+    }
+
+    void generator::write_read(std::ostream & out, const std::string & ns,
+                               const type_def & t) const
+    {
+        const bool text = !t.text_type.empty();
+        out << "\nvoid " << ns << "::read(xml::reader & r, " << t.name
+            << " & out)\n"
+            << "{\n"
+            << "    const bool empty = r.empty_element();\n";
+        if (!t.attributes.empty()) {
+            out << "    if (r.move_to_first_attribute()) {\n"
+                << "        do {\n"
+                << "            read_attribute(r, out);\n"
+                << "        } while (r.move_to_next_attribute());\n"
+                << "        r.move_to_element();\n"
+                << "    }\n";
+        }
+        if (text) {
+            out << "    text_value<" << t.text_type
+                << "> text{out." << t.text_member << "};\n"
+                << "    if (empty) {\n"
+                << "        text.end(r);\n"
+                << "        return;\n"
+                << "    }\n";
+        } else {
+            out << "    if (empty) { return; }\n";
+        }
+        out << "    const std::size_t depth = r.depth();\n"
+            << "    while (r.read()) {\n"
+            << "        switch (r.node_type()) {\n"
+            << "        case xml::reader::element_id:\n";
+        if (t.elements.empty()) {
+            out << "            r.skip();\n";
+        } else {
+            out << "            if (!read_element(r, out)) { r.skip(); }\n";
+        }
+        out << "            break;\n";
+        if (text) {
+            out << "        case xml::reader::text_id:\n"
+                << "        case xml::reader::cdata_id:\n"
+                << "        case xml::reader::whitespace_id:\n"
+                << "        case xml::reader::significant_whitespace_id:\n"
+                << "            text.add(r);\n"
+                << "            break;\n";
+        }
+        out << "        case xml::reader::end_element_id:\n"
+            << "            if (r.depth() == depth) {\n";
+        if (text) { out << "                text.end(r);\n"; }
+        out << "                return;\n"
+            << "            }\n"
+            << "            break;\n"
+            << "        default:\n"
+            << "            break;\n"
+            << "        }\n"
+            << "    }\n"
+            << "    throw xml::parse_error{r.line(), "
+               "\"unexpected end of document\"};\n"
+            << "}\n";
+    }
+
+    void generator::write_source(std::ostream & out,
+                                 const std::string & ns,
+                                 const std::string & header,
+                                 const std::string & schema_file) const
+    {
+        out << "// Generated by xmlrw-generate from " << schema_file
+            << ".  Do not edit.\n\n"
+            << "# include " << string_literal(header) << "\n"
+            << "# include <xml/binding.h>\n"
+            << "# include <cstring>\n\n"
+            << "namespace {\n\n"
+            << "    template <typename T>\n"
+            << "    void parse_value(const xml::reader & r,\n"
+            << "                     const xml::string_ref & text,\n"
+            << "                     T & value)\n"
+            << "    {\n"
+            << "        if (!xml::value_traits<T>::parse(text, value)) {\n"
+            << "            throw xml::parse_error{r.line(),\n"
+            << "                                   \"invalid value \\\"\" "
+               "+ text.str() + \"\\\"\"};\n"
+            << "        }\n"
+            << "    }\n\n"
+            << "    //\n"
+            << "    // Text content, converted in place unless it is split "
+               "across several\n"
+            << "    // nodes.\n"
+            << "    //\n"
+            << "    template <typename T>\n"
+            << "    class text_value {\n"
+            << "        T & value_;\n"
+            << "        bool found_ = false;\n"
+            << "        bool split_ = false;\n"
+            << "        bool valid_ = false;\n"
+            << "        std::string joined_;\n\n"
+            << "    public:\n"
+            << "        explicit text_value(T & value): value_(value) {}\n\n"
+            << "        void add(const xml::reader & r)\n"
+            << "        {\n"
+            << "            const xml::string_ref text = r.value_ref();\n"
+            << "            if (!this->found_) {\n"
+            << "                this->found_ = true;\n"
+            << "                this->valid_ =\n"
+            << "                    xml::value_traits<T>::parse(text, "
+               "this->value_);\n"
+            << "                this->joined_.assign(text.data(), "
+               "text.size());\n"
+            << "            } else {\n"
+            << "                this->split_ = true;\n"
+            << "                this->joined_.append(text.data(), "
+               "text.size());\n"
+            << "            }\n"
+            << "        }\n\n"
+            << "        void end(const xml::reader & r)\n"
+            << "        {\n"
+            << "            if (!this->found_ || this->split_ || "
+               "!this->valid_) {\n"
+            << "                parse_value(r, xml::string_ref{this->joined_},"
+               "\n"
+            << "                            this->value_);\n"
+            << "            }\n"
+            << "        }\n"
+            << "    };\n\n"
+            << "    //\n"
+            << "    // The text content of the current element, leaving the "
+               "reader on its\n"
+            << "    // end element.\n"
+            << "    //\n"
+            << "    template <typename T>\n"
+            << "    void read_text(xml::reader & r, T & value)\n"
+            << "    {\n"
+            << "        text_value<T> text{value};\n"
+            << "        if (r.empty_element()) {\n"
+            << "            text.end(r);\n"
+            << "            return;\n"
+            << "        }\n"
+            << "        const std::size_t depth = r.depth();\n"
+            << "        while (r.read()) {\n"
+            << "            switch (r.node_type()) {\n"
+            << "            case xml::reader::text_id:\n"
+            << "            case xml::reader::cdata_id:\n"
+            << "            case xml::reader::whitespace_id:\n"
+            << "            case xml::reader::significant_whitespace_id:\n"
+            << "                text.add(r);\n"
+            << "                break;\n"
+            << "            case xml::reader::element_id:\n"
+            << "                r.skip();\n"
+            << "                break;\n"
+            << "            case xml::reader::end_element_id:\n"
+            << "                if (r.depth() == depth) {\n"
+            << "                    text.end(r);\n"
+            << "                    return;\n"
+            << "                }\n"
+            << "                break;\n"
+            << "            default:\n"
+            << "                break;\n"
+            << "            }\n"
+            << "        }\n"
+            << "        throw xml::parse_error{r.line(), "
+               "\"unexpected end of document\"};\n"
+            << "    }\n";
+        for (const auto & t : this->types_) {
+            if (!t.attributes.empty()) {
+                this->write_dispatch(out, ns, t, true);
+            }
+            if (!t.elements.empty()) {
+                this->write_dispatch(out, ns, t, false);
+            }
+        }
+        out << "}\n";
+
+        for (const auto & t : this->types_) {
+            this->write_read(out, ns, t);
+        }
+        for (const auto & root : this->roots_) {
+            out << "\nvoid " << ns << "::" << root.function
+                << "(xml::reader & r, " << root.type << " & out)\n"
+                << "{\n"
+                << "    while (r.node_type() != xml::reader::element_id) {\n"
+                << "        if (!r.read()) {\n"
+                << "            throw xml::parse_error{r.line(), "
+                   "\"no document element\"};\n"
+                << "        }\n"
+                << "    }\n"
+                << "    if (r.local_name_ref() != "
+                << string_literal(root.xml_name) << "\n"
+                << "        || ";
+            if (root.namespace_uri.empty()) {
+                out << "!r.namespace_uri().empty()";
+            } else {
+                out << "r.namespace_uri() != "
+                    << string_literal(root.namespace_uri);
+            }
+            out << ") {\n"
+                << "        throw xml::parse_error{r.line(),\n"
+                << "                               "
+                << string_literal(
+                       "expected element \"" + root.xml_name + "\""
+                       + (root.namespace_uri.empty()
+                          ? std::string{}
+                          : " in namespace \"" + root.namespace_uri
+                                + "\""))
+                << "};\n"
+                << "    }\n"
+                << "    read(r, out);\n"
+                << "}\n";
+        }
+    }
+
+    const std::string base_name(const std::string & path)
+    {
+        const std::string::size_type slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    int generate(const std::string & schema_file,
+                 const std::string & output,
+                 const std::string & ns)
+    {
+        const schema_node schema = load_schema(schema_file);
+        const generator g{schema};
+
+        const std::string name = base_name(output);
+        std::string guard;
+        for (const char c : identifier(name) + "_H") {
+            guard += char(std::toupper(static_cast<unsigned char>(c)));
+        }
+
+        std::ostringstream header;
+        g.write_header(header, ns, guard, base_name(schema_file));
+        std::ostringstream source;
+        g.write_source(source, ns, name + ".h", base_name(schema_file));
+
+        for (const auto & file : { std::make_pair(output + ".h", &header),
+                                   std::make_pair(output + ".cpp",
+                                                  &source) }) {
+            std::ofstream out{file.first.c_str()};
+            if (!(out << file.second->str())) {
+                std::cerr << "failed to write \"" << file.first << "\"\n";
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    std::string ns;
+    std::string output;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        const char * const opt = argv[i];
+        if (std::strlen(opt) != 2 || i + 1 == argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        const char * const arg = argv[++i];
+        switch (opt[1]) {
+        case 'n': ns = arg; break;
+        case 'o': output = arg; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (i + 1 != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string schema_file = argv[i];
+    if (output.empty()) {
+        output = base_name(schema_file);
+        const std::string::size_type dot = output.rfind('.');
+        if (dot != std::string::npos && dot > 0) { output.erase(dot); }
+    }
+    if (ns.empty()) { ns = identifier(base_name(output)); }
+
+    try {
+        return generate(schema_file, output, ns);
+    } catch (const std::exception & ex) {
+        std::cerr << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
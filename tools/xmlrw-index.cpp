@@ -0,0 +1,164 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; fill-column: 78 -*-
+
+//
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 Braden McDaniel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+//
+// xmlrw-index: build a sidecar offset index for a document, or look up an
+// element in one.
+//
+//   xmlrw-index [-d depth] [-k key-attribute] [-o index-file] document
+//   xmlrw-index -l key [-i index-file] document
+//
+// The index file defaults to the document's name with ".idx" appended.
+// A lookup writes the element, verbatim, to the standard output.
+//
+
+# include <xml/offset_index.h>
+# include <cstdlib>
+# include <cstring>
+# include <exception>
+# include <fstream>
+# include <iostream>
+# include <vector>
+
+namespace {
+
+    void usage(const char * const program)
+    {
+        std::cerr << "usage: " << program
+                  << " [-d depth] [-k key-attribute] [-o index-file]"
+                     " document\n"
+                  << "       " << program
+                  << " -l key [-i index-file] document\n";
+    }
+
+    int build(const std::string & document,
+              const std::string & index_file,
+              const std::size_t depth,
+              const std::string & key_attribute)
+    {
+        std::ifstream in{document.c_str(),
+                         std::ios_base::in | std::ios_base::binary};
+        if (!in) {
+            std::cerr << "failed to open \"" << document << "\"\n";
+            return EXIT_FAILURE;
+        }
+        const xml::offset_index index =
+            xml::offset_index::build(in, depth, key_attribute);
+
+        std::ofstream out{index_file.c_str(),
+                          std::ios_base::out | std::ios_base::binary};
+        if (!out) {
+            std::cerr << "failed to open \"" << index_file << "\"\n";
+            return EXIT_FAILURE;
+        }
+        index.save(out);
+        std::cerr << index.entries().size() << " elements indexed\n";
+        return EXIT_SUCCESS;
+    }
+
+    int lookup(const std::string & document,
+               const std::string & index_file,
+               const std::string & key)
+    {
+        std::ifstream index_in{index_file.c_str(),
+                               std::ios_base::in | std::ios_base::binary};
+        if (!index_in) {
+            std::cerr << "failed to open \"" << index_file << "\"\n";
+            return EXIT_FAILURE;
+        }
+        const xml::offset_index index = xml::offset_index::load(index_in);
+        const xml::index_entry * const entry = index.find(key);
+        if (!entry) {
+            std::cerr << "no element with key \"" << key << "\"\n";
+            return EXIT_FAILURE;
+        }
+
+        std::ifstream in{document.c_str(),
+                         std::ios_base::in | std::ios_base::binary};
+        if (!in || !in.seekg(std::streamoff(entry->offset))) {
+            std::cerr << "failed to read \"" << document << "\"\n";
+            return EXIT_FAILURE;
+        }
+        std::vector<char> buf(64 * 1024);
+        for (std::uint64_t remaining = entry->length; remaining > 0; ) {
+            const std::streamsize n =
+                std::streamsize(remaining < buf.size() ? remaining
+                                                       : buf.size());
+            if (!in.read(buf.data(), n)) {
+                std::cerr << "failed to read \"" << document << "\"\n";
+                return EXIT_FAILURE;
+            }
+            std::cout.write(buf.data(), n);
+            remaining -= n;
+        }
+        std::cout << '\n';
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    std::size_t depth = 1;
+    std::string key_attribute = "id";
+    std::string index_file;
+    std::string key;
+    bool do_lookup = false;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        const char * const opt = argv[i];
+        if (std::strlen(opt) != 2 || i + 1 == argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        const char * const arg = argv[++i];
+        switch (opt[1]) {
+        case 'd': depth = std::strtoul(arg, nullptr, 10); break;
+        case 'k': key_attribute = arg; break;
+        case 'o':
+        case 'i': index_file = arg; break;
+        case 'l': key = arg; do_lookup = true; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (i + 1 != argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string document = argv[i];
+    if (index_file.empty()) { index_file = document + ".idx"; }
+
+    try {
+        return do_lookup
+            ? lookup(document, index_file, key)
+            : build(document, index_file, depth, key_attribute);
+    } catch (const std::exception & ex) {
+        std::cerr << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}